@@ -73,6 +73,7 @@ private:
     bool convertClientCall(const Operation &, const Binding &, KODE::Class &);
     void convertClientInputMessage(const Operation &, const Binding &, KODE::Class &);
     void convertClientOutputMessage(const Operation &, const Binding &, KODE::Class &);
+    void convertClientCoroutineCall(const Operation &, const Binding &, KODE::Class &);
     void clientAddOneArgument(KODE::Function &callFunc, const Part &part, KODE::Class &newClass);
     void clientAddArguments(KODE::Function &callFunc, const Message &message, KODE::Class &newClass, const Operation &operation,
                             const Binding &binding);
@@ -99,7 +100,8 @@ private:
 
     // Server Stub
     void convertServerService();
-    void generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass);
+    void generateServerDispatch(KODE::Code &code, const Binding &binding, const Operation::List &operations);
+    void generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass, int operationIndex);
     void generateDelayedReponseMethod(const QString &methodName, const QString &retInputType, const Part &retPart, KODE::Class &newClass,
                                       const Binding &binding, const Message &outputMessage);
 
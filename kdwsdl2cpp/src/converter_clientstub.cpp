@@ -113,6 +113,7 @@ bool Converter::convertClientService()
             newClass.addHeaderInclude(QLatin1String("QtCore/QObject"));
             newClass.addHeaderInclude(QLatin1String("QtCore/QString"));
             newClass.addHeaderInclude(QLatin1String("KDSoapClient/KDSoapClientInterface.h"));
+            newClass.addHeaderInclude(QLatin1String("KDSoapClient/KDSoapAwaitable.h"));
             if (Settings::self()->optionalElementType() == Settings::EBoostOptional) {
                 newClass.addHeaderInclude(QLatin1String("boost/optional.hpp"));
             } else if (Settings::self()->optionalElementType() == Settings::EStdOptional) {
@@ -335,6 +336,10 @@ bool Converter::convertClientService()
                         convertClientInputMessage(operation, binding, newClass);
                         convertClientOutputMessage(operation, binding, newClass);
                         // TODO fault
+                        if (opType == Operation::RequestResponseOperation) {
+                            // awaitable method, for C++20 coroutines
+                            convertClientCoroutineCall(operation, binding, newClass);
+                        }
                     }
                     break;
                 case Operation::SolicitResponseOperation:
@@ -818,6 +823,77 @@ void Converter::convertClientInputMessage(const Operation &operation, const Bind
     }
 }
 
+// Generate the method returning an awaitable, for C++20 coroutines
+void Converter::convertClientCoroutineCall(const Operation &operation, const Binding &binding, KODE::Class &newClass)
+{
+    const QString operationName = operation.name();
+    const Message outputMessage = mWSDL.findMessage(operation.output().message());
+    const Part::List outParts = selectedParts(binding, outputMessage, operation, false /*output*/);
+    if (outParts.count() > 1) {
+        return; // co_await can only return one value, the job class can be used instead
+    }
+    QString retType;
+    if (outParts.count() == 1) {
+        retType = mTypeMap.localType(outParts.first().type(), outParts.first().element());
+        if (retType.isEmpty()) {
+            qWarning("Could not generate awaitable for operation '%s'", qPrintable(operationName));
+            return;
+        }
+    }
+    const bool hasResult = !retType.isEmpty() && retType != QLatin1String("void");
+
+    KODE::Function coFunc(QLatin1String("co") + upperlize(operationName),
+                          hasResult ? QLatin1String("KDSoapCallAwaitable<") + retType + QLatin1String(">") : QLatin1String("KDSoapPendingCall"),
+                          KODE::Function::Public);
+    coFunc.setDocs(QString::fromLatin1("Asynchronous call to %1, meant to be awaited with co_await in a C++20 coroutine.\n%2")
+                       .arg(operationName,
+                            hasResult ? QLatin1String("co_await returns the result, or a default-constructed value in case of a fault.")
+                                      : QLatin1String("co_await returns the response message, which can be a fault.")));
+    const Message inputMessage = mWSDL.findMessage(operation.input().message());
+    clientAddArguments(coFunc, inputMessage, newClass, operation, binding);
+    KODE::Code code;
+    const bool hasAction = clientAddAction(code, binding, operationName);
+    clientGenerateMessage(code, binding, inputMessage, operation);
+
+    QString callLine = QLatin1String("const KDSoapPendingCall pendingCall = clientInterface()->asyncCall(QLatin1String(\"") + operationName
+        + QLatin1String("\"), message");
+    if (hasAction) {
+        callLine += QLatin1String(", action");
+    }
+    callLine += QLatin1String(");");
+    code += callLine;
+
+    if (hasResult) {
+        const Part &retPart = outParts.first();
+        newClass.addHeaderIncludes(mTypeMap.headerIncludes(retPart.type()));
+
+        // WARNING: this is the same logic as the result parsing for async calls, see convertClientOutputMessage
+        code += QLatin1String("return KDSoapCallAwaitable<") + retType + QLatin1String(">(pendingCall, [](const KDSoapMessage &reply) {");
+        code.indent();
+        if (soapStyle(binding) == SoapBinding::DocumentStyle /*no wrapper*/) {
+            code += retType + QLatin1String(" ret;"); // local var
+            code.addBlock(deserializeRetVal(retPart, QLatin1String("reply"), retType, QLatin1String("ret")));
+            code += "return ret;";
+        } else { // RPC style (adds a wrapper) or simple value
+            const QString value = QLatin1String("reply.childValues().child(QLatin1String(\"") + retPart.name() + QLatin1String("\"))");
+            if (mTypeMap.isBuiltinType(retPart.type(), retPart.element())) {
+                code += QLatin1String("return ") + value + QLatin1String(".value().value<") + retType + QLatin1String(">();");
+            } else {
+                code += retType + QLatin1String(" ret;"); // local var
+                code += QLatin1String("ret.deserialize(") + value + QLatin1String(");") + COMMENT;
+                code += "return ret;";
+            }
+        }
+        code.unindent();
+        code += "});";
+    } else {
+        code += "return pendingCall;";
+    }
+
+    coFunc.setBody(code);
+    newClass.addFunction(coFunc);
+}
+
 // Generate signals and the result slot, for async calls
 void Converter::convertClientOutputMessage(const Operation &operation, const Binding &binding, KODE::Class &newClass)
 {
@@ -63,16 +63,26 @@ void Converter::convertServerService()
             PortType portType = mWSDL.findPortType(binding.portTypeName());
             // qDebug() << portType.name();
             const Operation::List operations = portType.operations();
-            for (const Operation &operation : operations) {
-                const Operation::OperationType opType = operation.operationType();
-                switch (opType) {
-                case Operation::OneWayOperation:
-                case Operation::RequestResponseOperation: // the standard case
-                case Operation::SolicitResponseOperation:
-                case Operation::NotificationOperation:
-                    generateServerMethod(body, binding, operation, serverClass);
-                    break;
+            if (!operations.isEmpty()) {
+                serverClass.addInclude(QLatin1String("QtCore/QHash"));
+                generateServerDispatch(body, binding, operations);
+                for (int i = 0; i < operations.count(); ++i) {
+                    const Operation &operation = operations.at(i);
+                    const Operation::OperationType opType = operation.operationType();
+                    switch (opType) {
+                    case Operation::OneWayOperation:
+                    case Operation::RequestResponseOperation: // the standard case
+                    case Operation::SolicitResponseOperation:
+                    case Operation::NotificationOperation:
+                        generateServerMethod(body, binding, operation, serverClass, i);
+                        break;
+                    }
                 }
+                body += "default:";
+                body.indent();
+                body += "break;";
+                body.unindent();
+                body += "}";
             }
 
             body += "KDSoapServerObjectInterface::processRequest(_request, _response, _soapAction);" + COMMENT;
@@ -85,7 +95,56 @@ void Converter::convertServerService()
     }
 }
 
-void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass)
+// The request selects an operation by its element name or by its SOAP action, the first operation matching either one wins.
+// Both are looked up in hash tables built once, rather than compared with each operation in turn,
+// and the generated code switches on the index of the operation.
+void Converter::generateServerDispatch(KODE::Code &code, const Binding &binding, const Operation::List &operations)
+{
+    QStringList methodEntries;
+    QStringList soapActionEntries;
+    QSet<QString> methods;
+    QSet<QString> soapActions;
+    for (int i = 0; i < operations.count(); ++i) {
+        const Operation &operation = operations.at(i);
+        const QString index = QString::number(i);
+        if (!methods.contains(operation.name())) { // keep the first one
+            methods.insert(operation.name());
+            methodEntries += "{\"" + operation.name() + "\", " + index + "},";
+        }
+        if (binding.type() == Binding::SOAPBinding) {
+            const SoapBinding soapBinding(binding.soapBinding());
+            const SoapBinding::Operation op = soapBinding.operations().value(operation.name());
+            if (!op.action().isEmpty() && !soapActions.contains(op.action())) {
+                soapActions.insert(op.action());
+                soapActionEntries += "{\"" + op.action() + "\", " + index + "},";
+            }
+        }
+    }
+
+    code += "static const QHash<QByteArray, int> s_methods = {" + COMMENT;
+    code.indent();
+    for (const QString &entry : std::as_const(methodEntries)) {
+        code += entry;
+    }
+    code.unindent();
+    code += "};";
+    code += "const int methodIndex = s_methods.value(method, -1);";
+    if (soapActionEntries.isEmpty()) {
+        code += "switch (methodIndex) {";
+        return;
+    }
+    code += "static const QHash<QByteArray, int> s_soapActions = {" + COMMENT;
+    code.indent();
+    for (const QString &entry : std::as_const(soapActionEntries)) {
+        code += entry;
+    }
+    code.unindent();
+    code += "};";
+    code += "const int soapActionIndex = s_soapActions.value(_soapAction, -1);";
+    code += "switch (soapActionIndex >= 0 && (methodIndex < 0 || soapActionIndex < methodIndex) ? soapActionIndex : methodIndex) {";
+}
+
+void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, const Operation &operation, KODE::Class &newClass, int operationIndex)
 {
     const QString requestVarName = "_request";
     const QString responseVarName = "_response";
@@ -102,15 +161,7 @@ void Converter::generateServerMethod(KODE::Code &code, const Binding &binding, c
     KODE::Function virtualMethod(methodName);
     virtualMethod.setVirtualMode(KODE::Function::PureVirtual);
 
-    QString condition = "method == \"" + operationName + "\"";
-    if (binding.type() == Binding::SOAPBinding) {
-        const SoapBinding soapBinding(binding.soapBinding());
-        const SoapBinding::Operation op = soapBinding.operations().value(operation.name());
-        if (!op.action().isEmpty()) {
-            condition += " || _soapAction == \"" + op.action() + "\"";
-        }
-    }
-    code += "if (" + condition + ") {";
+    code += "case " + QString::number(operationIndex) + ": {";
     code.indent();
 
     QStringList inputVars;
@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPAWAITABLE_H
+#define KDSOAPAWAITABLE_H
+
+#include "KDSoapPendingCall.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define KDSOAP_HAS_COROUTINES 1
+#endif
+#endif
+
+/**
+ * \file KDSoapAwaitable.h
+ *
+ * Support for C++20 coroutines. When compiling with C++20, a KDSoapPendingCall can be awaited
+ * in any coroutine, which makes it possible to write chains of dependent calls sequentially:
+ *
+ * \code
+ *   const KDSoapMessage reply = co_await client->asyncCall(QLatin1String("getEmployeeCountry"), message);
+ *   if (!reply.isFault()) {
+ *       ...
+ *   }
+ * \endcode
+ *
+ * The coroutine is resumed from the event loop of the thread of the KDSoapClientInterface,
+ * i.e. in the caller's thread. No QObject is created for the call.
+ *
+ * KDSoap doesn't provide a coroutine type itself; use the one from your framework (e.g. QCoro).
+ *
+ * \since 2.3
+ */
+
+#ifdef KDSOAP_HAS_COROUTINES
+/**
+ * Awaiter for a KDSoapPendingCall, returned by operator co_await.
+ * co_await returns the response message, see KDSoapPendingCall::returnMessage().
+ * \since 2.3
+ */
+class KDSoapPendingCallAwaiter
+{
+public:
+    explicit KDSoapPendingCallAwaiter(const KDSoapPendingCall &call)
+        : m_call(call)
+    {
+    }
+
+    bool await_ready() const
+    {
+        return m_call.isFinished();
+    }
+    void await_suspend(std::coroutine_handle<> handle) const
+    {
+        m_call.onFinished([handle]() { handle.resume(); });
+    }
+    KDSoapMessage await_resume() const
+    {
+        return m_call.returnMessage();
+    }
+
+private:
+    KDSoapPendingCall m_call;
+};
+
+inline KDSoapPendingCallAwaiter operator co_await(const KDSoapPendingCall &call)
+{
+    return KDSoapPendingCallAwaiter(call);
+}
+#endif
+
+/**
+ * A pending call whose response is converted to \p T when awaited.
+ *
+ * This is returned by the "co" methods generated by kdwsdl2cpp, e.g.
+ * \code
+ *   const QString country = co_await service.coGetEmployeeCountry(name);
+ * \endcode
+ *
+ * In case of a fault, a default-constructed \p T is returned, like for the blocking calls;
+ * keep the awaitable in a variable to be able to call returnMessage() afterwards.
+ *
+ * The awaitable can be created without C++20, only co_await requires it.
+ * \since 2.3
+ */
+template<typename T>
+class KDSoapCallAwaitable
+{
+public:
+    using Parser = T (*)(const KDSoapMessage &reply);
+
+    KDSoapCallAwaitable(const KDSoapPendingCall &call, Parser parser)
+        : m_call(call)
+        , m_parser(parser)
+    {
+    }
+
+    /**
+     * Returns the underlying pending call
+     */
+    KDSoapPendingCall pendingCall() const
+    {
+        return m_call;
+    }
+
+    /**
+     * Returns the response message sent by the server, once the call has finished.
+     * Could either be a fault (see KDSoapMessage::isFault) or the actual response arguments.
+     */
+    KDSoapMessage returnMessage() const
+    {
+        return m_call.returnMessage();
+    }
+
+    /**
+     * Returns the converted response, once the call has finished.
+     */
+    T result() const
+    {
+        const KDSoapMessage reply = m_call.returnMessage();
+        if (reply.isFault()) {
+            return T();
+        }
+        return m_parser(reply);
+    }
+
+#ifdef KDSOAP_HAS_COROUTINES
+    bool await_ready() const
+    {
+        return m_call.isFinished();
+    }
+    void await_suspend(std::coroutine_handle<> handle) const
+    {
+        m_call.onFinished([handle]() { handle.resume(); });
+    }
+    T await_resume() const
+    {
+        return result();
+    }
+#endif
+
+private:
+    KDSoapPendingCall m_call;
+    Parser m_parser;
+};
+
+#endif // KDSOAPAWAITABLE_H
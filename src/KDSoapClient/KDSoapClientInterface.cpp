@@ -172,7 +172,7 @@ KDSoapPendingCall KDSoapClientInterface::asyncCall(const QString &method, const
 {
     QBuffer *buffer = d->prepareRequestBuffer(method, message, soapAction, headers);
     QNetworkRequest request = d->prepareRequest(method, soapAction);
-    QNetworkReply *reply = d->accessManager()->post(request, buffer);
+    QNetworkReply *reply = d->sendRequest(d->accessManager(), method, soapAction, request, buffer);
     d->setupReply(reply);
     maybeDebugRequest(buffer->data(), reply->request(), reply);
     KDSoapPendingCall call(reply, buffer);
@@ -183,12 +183,15 @@ KDSoapPendingCall KDSoapClientInterface::asyncCall(const QString &method, const
 KDSoapMessage KDSoapClientInterface::call(const QString &method, const KDSoapMessage &message, const QString &soapAction,
                                           const KDSoapHeaders &headers)
 {
-    d->accessManager()->cookieJar(); // create it in the right thread, the secondary thread will use it
     // Problem is: I don't want a nested event loop here. Too dangerous for GUI programs.
     // I wanted a socket->waitFor... but we don't have access to the actual socket in QNetworkAccess.
     // So the only option that remains is a thread and acquiring a semaphore...
     KDSoapThreadTaskData *task = new KDSoapThreadTaskData(this, method, message, soapAction, headers);
     task->m_authentication = d->m_authentication;
+    // Read here rather than in the secondary thread. It only applies them when they changed.
+    task->m_networkConfigGeneration = d->m_networkConfigGeneration;
+    task->m_cookieJar = d->accessManager()->cookieJar(); // create it in the right thread, the secondary thread will use it
+    task->m_proxy = d->accessManager()->proxy();
     d->m_thread.enqueue(task);
     if (!d->m_thread.isRunning()) {
         d->m_thread.start();
@@ -212,6 +215,41 @@ void KDSoapClientInterface::callNoReply(const QString &method, const KDSoapMessa
     QObject::connect(reply, &QNetworkReply::finished, buffer, &QBuffer::deleteLater);
 }
 
+// Used by asyncCall and by the thread for call(). Not by callNoReply, nobody would read the response.
+QNetworkReply *KDSoapClientInterfacePrivate::sendRequest(QNetworkAccessManager *manager, const QString &method, const QString &soapAction,
+                                                         const QNetworkRequest &request, QBuffer *buffer)
+{
+    const int cacheTimeout = m_responseCache.timeout(method, soapAction);
+    if (m_retryPolicy.maxAttempts() > 1) {
+        const QByteArray requestData = buffer->data();
+        // Each attempt is a separate reply, which needs its own SSL error handling.
+        // The timeout (setupReply) applies to the KDSoapRetryingReply, i.e. to all attempts together.
+        // Attempts always go to the network: a hedged attempt must not be coalesced with the first one,
+        // and attempts which aren't needed anymore are aborted, so they can't be shared with other callers.
+        auto sender = [this, manager, request, requestData]() {
+            QNetworkReply *reply = manager->post(request, requestData);
+            setupSslHandling(reply);
+            return reply;
+        };
+        const bool idempotent = m_idempotentOperations.contains(method) || m_idempotentOperations.contains(soapAction);
+        auto sendWithRetries = [this, request, idempotent, sender, method, manager]() -> QNetworkReply * {
+            return new KDSoapRetryingReply(request, m_retryPolicy, idempotent, m_version, sender, &m_latencyStatistics, method, manager);
+        };
+        if (cacheTimeout > 0) {
+            // The cache only sees the final response, which identical calls share
+            return m_responseCache.post(manager, request, requestData, cacheTimeout, sendWithRetries);
+        }
+        return sendWithRetries();
+    }
+    if (cacheTimeout > 0) {
+        const QByteArray requestData = buffer->data();
+        return m_responseCache.post(manager, request, requestData, cacheTimeout, [manager, request, requestData]() {
+            return manager->post(request, requestData);
+        });
+    }
+    return manager->post(request, buffer);
+}
+
 void KDSoapClientInterfacePrivate::_kd_slotAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator)
 {
     m_authentication.handleAuthenticationRequired(reply, authenticator);
@@ -279,6 +317,16 @@ public Q_SLOTS:
 };
 
 void KDSoapClientInterfacePrivate::setupReply(QNetworkReply *reply)
+{
+    setupSslHandling(reply);
+    if (m_timeout >= 0) {
+        TimeoutHandler *timeoutHandler = new TimeoutHandler(reply);
+        connect(timeoutHandler, &TimeoutHandler::timeout, timeoutHandler, &TimeoutHandler::replyTimeout);
+        timeoutHandler->start(m_timeout);
+    }
+}
+
+void KDSoapClientInterfacePrivate::setupSslHandling(QNetworkReply *reply)
 {
 #ifndef QT_NO_SSL
     if (m_ignoreSslErrors) {
@@ -292,12 +340,9 @@ void KDSoapClientInterfacePrivate::setupReply(QNetworkReply *reply)
             new KDSoapReplySslHandler(reply, m_sslHandler);
         }
     }
+#else
+    Q_UNUSED(reply);
 #endif
-    if (m_timeout >= 0) {
-        TimeoutHandler *timeoutHandler = new TimeoutHandler(reply);
-        connect(timeoutHandler, &TimeoutHandler::timeout, timeoutHandler, &TimeoutHandler::replyTimeout);
-        timeoutHandler->start(m_timeout);
-    }
 }
 
 KDSoapHeaders KDSoapClientInterface::lastResponseHeaders() const
@@ -325,6 +370,7 @@ void KDSoapClientInterface::setCookieJar(QNetworkCookieJar *jar)
     QObject *oldParent = jar->parent();
     d->accessManager()->setCookieJar(jar);
     jar->setParent(oldParent); // see comment in QNAM::setCookieJar...
+    ++d->m_networkConfigGeneration;
 }
 
 void KDSoapClientInterface::setRawHTTPHeaders(const QMap<QByteArray, QByteArray> &headers)
@@ -340,6 +386,7 @@ QNetworkProxy KDSoapClientInterface::proxy() const
 void KDSoapClientInterface::setProxy(const QNetworkProxy &proxy)
 {
     d->accessManager()->setProxy(proxy);
+    ++d->m_networkConfigGeneration;
 }
 
 int KDSoapClientInterface::timeout() const
@@ -378,6 +425,60 @@ void KDSoapClientInterface::setSendSoapActionInWsAddressingHeader(bool sendInWsA
     d->m_sendSoapActionInWsAddressingHeader = sendInWsAddressingHeader;
 }
 
+void KDSoapClientInterface::setResponseCacheTimeout(const QString &operation, int msecs)
+{
+    d->m_responseCache.setTimeout(operation, msecs);
+}
+
+int KDSoapClientInterface::responseCacheTimeout(const QString &operation) const
+{
+    return d->m_responseCache.timeout(operation);
+}
+
+void KDSoapClientInterface::setResponseCacheMaxEntries(int entries)
+{
+    d->m_responseCache.setMaxEntries(entries);
+}
+
+int KDSoapClientInterface::responseCacheMaxEntries() const
+{
+    return d->m_responseCache.maxEntries();
+}
+
+void KDSoapClientInterface::clearResponseCache()
+{
+    d->m_responseCache.clear();
+}
+
+KDSoapClientInterface::ResponseCacheStatistics KDSoapClientInterface::responseCacheStatistics() const
+{
+    return d->m_responseCache.statistics();
+}
+
+void KDSoapClientInterface::setRetryPolicy(const KDSoapRetryPolicy &policy)
+{
+    d->m_retryPolicy = policy;
+}
+
+KDSoapRetryPolicy KDSoapClientInterface::retryPolicy() const
+{
+    return d->m_retryPolicy;
+}
+
+void KDSoapClientInterface::setOperationIdempotent(const QString &operation, bool idempotent)
+{
+    if (idempotent) {
+        d->m_idempotentOperations.insert(operation);
+    } else {
+        d->m_idempotentOperations.remove(operation);
+    }
+}
+
+bool KDSoapClientInterface::isOperationIdempotent(const QString &operation) const
+{
+    return d->m_idempotentOperations.contains(operation);
+}
+
 #ifndef QT_NO_OPENSSL
 QSslConfiguration KDSoapClientInterface::sslConfiguration() const
 {
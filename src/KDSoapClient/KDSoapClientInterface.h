@@ -12,6 +12,7 @@
 
 #include "KDSoapMessage.h"
 #include "KDSoapPendingCall.h"
+#include "KDSoapRetryPolicy.h"
 #include <QtCore/QString>
 #include <QtCore/QtGlobal>
 
@@ -385,6 +386,103 @@ public:
      */
     bool sendSoapActionInWsAddressingHeader() const;
 
+    /**
+     * Statistics about the response cache, see responseCacheStatistics().
+     * \since 2.3
+     */
+    struct ResponseCacheStatistics
+    {
+        int hits = 0; ///< calls answered from the cache, without any network request
+        int misses = 0; ///< calls of cached operations which were sent to the server
+        int coalesced = 0; ///< calls which shared the response of an identical call in progress
+        int evictions = 0; ///< cached responses dropped to respect responseCacheMaxEntries()
+    };
+
+    /**
+     * Enables caching of the responses to the operation \p operation, for \p msecs milliseconds.
+     *
+     * This is meant for operations which are pure reads, whose response doesn't change for
+     * a while (currency tables, country lists...). A call to a cached operation with the same
+     * end point, SOAP action, headers and arguments as a previous successful call is answered
+     * from the cache, and concurrent identical calls share a single network request.
+     * Faults and network errors are never cached.
+     * With a retry policy (setRetryPolicy()), the retries and hedged requests of a call are always
+     * sent to the server; concurrent identical calls share the final response instead.
+     *
+     * This applies to call(), asyncCall() and therefore to code generated by kdwsdl2cpp (including jobs).
+     *
+     * \param operation the method name passed to call() or asyncCall(), or the SOAP action
+     * \param msecs time to live of the cached responses; 0 disables caching for this operation (the default)
+     * \since 2.3
+     */
+    void setResponseCacheTimeout(const QString &operation, int msecs);
+
+    /**
+     * Returns the time to live of cached responses for \p operation, in milliseconds.
+     * 0 means that responses to this operation are not cached.
+     * \since 2.3
+     */
+    int responseCacheTimeout(const QString &operation) const;
+
+    /**
+     * Sets the maximum number of responses kept in the cache.
+     * When this number is reached, the least recently used responses are dropped.
+     * The default is 100.
+     * \since 2.3
+     */
+    void setResponseCacheMaxEntries(int entries);
+
+    /**
+     * Returns the maximum number of responses kept in the cache.
+     * \since 2.3
+     */
+    int responseCacheMaxEntries() const;
+
+    /**
+     * Drops all the responses from the cache.
+     * \since 2.3
+     */
+    void clearResponseCache();
+
+    /**
+     * Returns the cache hit/miss statistics since this client interface was created.
+     * \since 2.3
+     */
+    ResponseCacheStatistics responseCacheStatistics() const;
+
+    /**
+     * Sets the policy for sending failed calls again, and for sending duplicate
+     * requests when the server is slow to answer.
+     *
+     * Only operations marked with setOperationIdempotent() are fully retried and hedged.
+     * setTimeout() applies to the whole call, including all retries.
+     *
+     * This applies to call() and asyncCall(), and therefore to code generated by kdwsdl2cpp.
+     * By default, calls are not retried.
+     * \since 2.3
+     */
+    void setRetryPolicy(const KDSoapRetryPolicy &policy);
+
+    /**
+     * Returns the retry policy set with setRetryPolicy().
+     * \since 2.3
+     */
+    KDSoapRetryPolicy retryPolicy() const;
+
+    /**
+     * Declares that \p operation can safely be processed several times by the server,
+     * which allows retrying and hedging it, see setRetryPolicy().
+     * \param operation the method name passed to call() or asyncCall(), or the SOAP action
+     * \since 2.3
+     */
+    void setOperationIdempotent(const QString &operation, bool idempotent = true);
+
+    /**
+     * Returns true if \p operation was marked as idempotent with setOperationIdempotent().
+     * \since 2.3
+     */
+    bool isOperationIdempotent(const QString &operation) const;
+
 private:
     friend class KDSoapThreadTask;
     KDSoapClientInterfacePrivate *const d;
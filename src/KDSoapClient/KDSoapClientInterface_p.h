@@ -18,6 +18,9 @@
 #include "KDSoapAuthentication.h"
 #include "KDSoapClientInterface.h"
 #include "KDSoapClientThread_p.h"
+#include "KDSoapResponseCache_p.h"
+#include "KDSoapRetryingReply_p.h"
+#include <QtCore/QSet>
 QT_BEGIN_NAMESPACE
 class QBuffer;
 QT_END_NAMESPACE
@@ -45,12 +48,17 @@ public:
     KDSoapClientInterface::Style m_style;
     KDSoapMessageAddressingProperties m_messageAddressingProperties;
     KDSoapHeaders m_lastResponseHeaders;
+    KDSoapResponseCache m_responseCache;
+    KDSoapRetryPolicy m_retryPolicy;
+    QSet<QString> m_idempotentOperations;
+    KDSoapLatencyStatistics m_latencyStatistics;
 #ifndef QT_NO_SSL
     QList<QSslError> m_ignoreErrorsList;
     QSslConfiguration m_sslConfiguration;
     KDSoapSslHandler *m_sslHandler;
 #endif
     int m_timeout = 30 * 60 * 1000; // 30 minutes, as documented
+    int m_networkConfigGeneration = 0; // cookie jar and proxy, see KDSoapThreadTask
     bool m_ignoreSslErrors = false;
     bool m_sendSoapActionInHttpHeader = true;
     bool m_sendSoapActionInWsAddressingHeader = false;
@@ -62,7 +70,9 @@ public:
     void writeElementContents(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, const KDSoapValue &element, KDSoapMessage::Use use);
     void writeChildren(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, const KDSoapValueList &args, KDSoapMessage::Use use);
     void writeAttributes(QXmlStreamWriter &writer, const QList<KDSoapValue> &attributes);
+    QNetworkReply *sendRequest(QNetworkAccessManager *manager, const QString &method, const QString &soapAction, const QNetworkRequest &request, QBuffer *buffer);
     void setupReply(QNetworkReply *reply);
+    void setupSslHandling(QNetworkReply *reply);
 
 private Q_SLOTS:
     void _kd_slotAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator);
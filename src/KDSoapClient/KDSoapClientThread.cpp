@@ -12,7 +12,6 @@
 #include "KDSoapClientInterface_p.h"
 #include "KDSoapClientThread_p.h"
 #include "KDSoapPendingCall.h"
-#include "KDSoapPendingCallWatcher.h"
 #include "KDSoapPendingCall_p.h"
 #include <QAuthenticator>
 #include <QBuffer>
@@ -41,12 +40,17 @@ void KDSoapClientThread::enqueue(KDSoapThreadTaskData *taskData)
 
 void KDSoapClientThread::run()
 {
+    // Lives as long as the thread, so that connections to the server are reused between calls
     QNetworkAccessManager accessManager;
     // Use own QEventLoop so its slot quit() is executed in this thread
     // (using QThread::exec/quit would try to call QThread::quit() in main thread,
     //  which is blocked on semaphore)
     QEventLoop eventLoop;
 
+    KDSoapThreadTask task(&accessManager); // must be created here, so that it's in the right thread
+    connect(&task, &KDSoapThreadTask::taskDone, &eventLoop, &QEventLoop::quit);
+    connect(&accessManager, &QNetworkAccessManager::authenticationRequired, &task, &KDSoapThreadTask::slotAuthenticationRequired);
+
     while (true) {
         QMutexLocker locker(&m_mutex);
         while (!m_stopThread && m_queue.isEmpty()) {
@@ -58,18 +62,34 @@ void KDSoapClientThread::run()
         KDSoapThreadTaskData *taskData = m_queue.dequeue();
         locker.unlock();
 
-        KDSoapThreadTask task(taskData); // must be created here, so that it's in the right thread
-        connect(&task, &KDSoapThreadTask::taskDone, &eventLoop, &QEventLoop::quit);
-        connect(&accessManager, &QNetworkAccessManager::authenticationRequired, &task, &KDSoapThreadTask::slotAuthenticationRequired);
-        task.process(accessManager);
+        task.process(taskData);
 
         // Process events until the task tells us the handling of that task is finished
         eventLoop.exec();
     }
 }
 
-void KDSoapThreadTask::process(QNetworkAccessManager &accessManager)
+KDSoapThreadTask::KDSoapThreadTask(QNetworkAccessManager *accessManager)
+    : m_accessManager(accessManager)
+{
+}
+
+void KDSoapThreadTask::applyNetworkConfiguration()
 {
+    if (m_data->m_networkConfigGeneration == m_networkConfigGeneration) {
+        return;
+    }
+    m_networkConfigGeneration = m_data->m_networkConfigGeneration;
+    // The jar belongs to the main thread, so QNAM doesn't take ownership of it
+    m_accessManager->setCookieJar(m_data->m_cookieJar.data());
+    m_accessManager->setProxy(m_data->m_proxy);
+}
+
+void KDSoapThreadTask::process(KDSoapThreadTaskData *data)
+{
+    m_data = data;
+    m_pendingCall.reset();
+
     // Can't use m_iface->asyncCall, it would use the accessmanager from the main thread
     // KDSoapPendingCall pendingCall = m_iface->asyncCall(m_method, m_message, m_action);
 
@@ -78,34 +98,30 @@ void KDSoapThreadTask::process(QNetworkAccessManager &accessManager)
         header.setQualified(true);
     }
 
-    QNetworkCookieJar *jar = m_data->m_iface->d->accessManager()->cookieJar();
-    accessManager.setCookieJar(jar);
+    applyNetworkConfiguration();
 
-    accessManager.setProxy(m_data->m_iface->d->accessManager()->proxy());
-
-    QBuffer *buffer = m_data->m_iface->d->prepareRequestBuffer(m_data->m_method,
-                                                               m_data->m_message,
-                                                               m_data->m_action,
-                                                               m_data->m_headers);
-    QNetworkRequest request = m_data->m_iface->d->prepareRequest(m_data->m_method, m_data->m_action);
-    QNetworkReply *reply = accessManager.post(request, buffer);
-    m_data->m_iface->d->setupReply(reply);
+    KDSoapClientInterfacePrivate *iface = m_data->m_iface->d;
+    QBuffer *buffer = iface->prepareRequestBuffer(m_data->m_method, m_data->m_message, m_data->m_action, m_data->m_headers);
+    QNetworkRequest request = iface->prepareRequest(m_data->m_method, m_data->m_action);
+    QNetworkReply *reply = iface->sendRequest(m_accessManager, m_data->m_method, m_data->m_action, request, buffer);
+    iface->setupReply(reply);
     maybeDebugRequest(buffer->data(), reply->request(), reply);
-    KDSoapPendingCall pendingCall(reply, buffer);
-    pendingCall.d->soapVersion = m_data->m_iface->d->m_version;
+    m_pendingCall = KDSoapPendingCall(reply, buffer);
+    m_pendingCall->d->soapVersion = iface->m_version;
 
-    KDSoapPendingCallWatcher *watcher = new KDSoapPendingCallWatcher(pendingCall, this);
-    connect(watcher, &KDSoapPendingCallWatcher::finished, this, &KDSoapThreadTask::slotFinished);
+    // Rather than a KDSoapPendingCallWatcher for each call
+    connect(reply, &QNetworkReply::finished, this, &KDSoapThreadTask::slotFinished);
 }
 
-void KDSoapThreadTask::slotFinished(KDSoapPendingCallWatcher *watcher)
+void KDSoapThreadTask::slotFinished()
 {
-    m_data->m_response = watcher->returnMessage();
-    m_data->m_responseHeaders = watcher->returnHeaders();
-    m_data->m_semaphore.release();
+    m_data->m_response = m_pendingCall->returnMessage();
+    m_data->m_responseHeaders = m_pendingCall->returnHeaders();
+    KDSoapThreadTaskData *data = m_data;
+    m_data = nullptr;
+    data->m_semaphore.release(); // the caller deletes data now
     // Helgrind bug: says this races with main thread. Looks like it's confused by QSharedDataPointer
     // qDebug() << m_data->m_returnArguments.value();
-    watcher->deleteLater();
 
     emit taskDone();
 }
@@ -119,5 +135,7 @@ void KDSoapClientThread::stop()
 
 void KDSoapThreadTask::slotAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator)
 {
-    m_data->m_authentication.handleAuthenticationRequired(reply, authenticator);
+    if (m_data) {
+        m_data->m_authentication.handleAuthenticationRequired(reply, authenticator);
+    }
 }
@@ -13,14 +13,18 @@
 
 #include "KDSoapAuthentication.h"
 #include "KDSoapMessage.h"
+#include "KDSoapPendingCall.h"
 #include <QtCore/QMutex>
 #include <QtCore/QQueue>
 #include <QtCore/QSemaphore>
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
+#include <QtCore/QPointer>
 #include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkCookieJar>
+#include <QtNetwork/QNetworkProxy>
+#include <optional>
 
-class KDSoapPendingCallWatcher;
 class KDSoapClientInterface;
 QT_BEGIN_NAMESPACE
 class QEventLoop;
@@ -54,6 +58,11 @@ public:
 
     KDSoapClientInterface *m_iface; // used by KDSoapThreadTask::process()
     KDSoapAuthentication m_authentication;
+    // Network configuration of the interface, taken in the caller's thread,
+    // and only applied to the thread's QNetworkAccessManager when the generation changes.
+    int m_networkConfigGeneration = 0;
+    QPointer<QNetworkCookieJar> m_cookieJar;
+    QNetworkProxy m_proxy;
     QString m_method;
     KDSoapMessage m_message;
     QString m_action;
@@ -64,26 +73,30 @@ public:
 };
 
 // clazy:excludeall=ctor-missing-parent-argument
+// Created once per thread, processes the tasks one after the other
 class KDSoapThreadTask : public QObject
 {
     Q_OBJECT
 public:
-    explicit KDSoapThreadTask(KDSoapThreadTaskData *data) // clazy:exclude=ctor-missing-parent-argument
-        : m_data(data)
-    {
-    }
+    explicit KDSoapThreadTask(QNetworkAccessManager *accessManager); // clazy:exclude=ctor-missing-parent-argument
 
-    void process(QNetworkAccessManager &accessManager);
+    void process(KDSoapThreadTaskData *data);
     void slotAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator);
 
 signals:
     void taskDone();
 
 private Q_SLOTS:
-    void slotFinished(KDSoapPendingCallWatcher *watcher);
+    void slotFinished();
 
 private:
-    KDSoapThreadTaskData *m_data;
+    void applyNetworkConfiguration();
+
+    QNetworkAccessManager *m_accessManager;
+    int m_networkConfigGeneration = -1;
+    KDSoapThreadTaskData *m_data = nullptr;
+    // Kept until the next call, the reply can't be deleted while it emits finished()
+    std::optional<KDSoapPendingCall> m_pendingCall;
 };
 
 class KDSoapClientThread : public QThread
@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapDebug.h"
+#include "KDSoapDebug_p.h"
+#include <QAtomicInt>
+
+namespace {
+class DebugSettings
+{
+public:
+    DebugSettings()
+        : client("kdsoap.client", QtInfoMsg)
+        , server("kdsoap.server", QtInfoMsg)
+    {
+        // Read once; from then on, only the KDSoapDebug API changes the settings
+        const QByteArray doDebug = qgetenv("KDSOAP_DEBUG");
+        if (doDebug.trimmed().isEmpty() || doDebug == "0") {
+            return;
+        }
+        client.setEnabled(QtDebugMsg, true);
+        server.setEnabled(QtDebugMsg, true);
+
+        KDSoapDebug::Options opts;
+        const QList<QByteArray> values = doDebug.toLower().split(',');
+        for (const QByteArray &value : values) {
+            if (value == "escape") {
+                opts |= KDSoapDebug::Escape;
+            } else if (value == "http" || value == "https") {
+                opts |= KDSoapDebug::Http;
+            } else if (value == "reformat") {
+                opts |= KDSoapDebug::Reformat;
+            } else if (value.startsWith("indent=")) { // krazy:exclude=strings
+                indentation.storeRelease(value.mid(7).toUShort());
+            }
+        }
+        options.storeRelease(int(opts));
+    }
+
+    QLoggingCategory &category(KDSoapDebug::Category category)
+    {
+        return category == KDSoapDebug::Client ? client : server;
+    }
+
+    QLoggingCategory client;
+    QLoggingCategory server;
+    QAtomicInt options {0};
+    QAtomicInt indentation {4};
+    QAtomicInt samplingInterval {1};
+    QAtomicInt clientCalls {0};
+    QAtomicInt serverCalls {0};
+};
+}
+
+Q_GLOBAL_STATIC(DebugSettings, s_settings)
+
+QLoggingCategory &kdsoapClientDebug()
+{
+    return s_settings()->client;
+}
+
+QLoggingCategory &kdsoapServerDebug()
+{
+    return s_settings()->server;
+}
+
+bool kdsoapShouldDebugCall(KDSoapDebug::Category category)
+{
+    DebugSettings *settings = s_settings();
+    if (!settings->category(category).isDebugEnabled()) {
+        return false;
+    }
+    const int interval = settings->samplingInterval.loadAcquire();
+    if (interval <= 1) {
+        return true;
+    }
+    QAtomicInt &calls = category == KDSoapDebug::Client ? settings->clientCalls : settings->serverCalls;
+    return calls.fetchAndAddRelaxed(1) % interval == 0;
+}
+
+void KDSoapDebug::setEnabled(Category category, bool enabled)
+{
+    s_settings()->category(category).setEnabled(QtDebugMsg, enabled);
+}
+
+bool KDSoapDebug::isEnabled(Category category)
+{
+    return s_settings()->category(category).isDebugEnabled();
+}
+
+void KDSoapDebug::setOptions(Options options)
+{
+    s_settings()->options.storeRelease(int(options));
+}
+
+KDSoapDebug::Options KDSoapDebug::options()
+{
+    return Options(QFlag(s_settings()->options.loadAcquire()));
+}
+
+void KDSoapDebug::setIndentation(int indentation)
+{
+    s_settings()->indentation.storeRelease(indentation);
+}
+
+int KDSoapDebug::indentation()
+{
+    return s_settings()->indentation.loadAcquire();
+}
+
+void KDSoapDebug::setSamplingInterval(int interval)
+{
+    s_settings()->samplingInterval.storeRelease(qMax(1, interval));
+}
+
+int KDSoapDebug::samplingInterval()
+{
+    return s_settings()->samplingInterval.loadAcquire();
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPDEBUG_H
+#define KDSOAPDEBUG_H
+
+#include "KDSoapGlobal.h"
+#include <QtCore/QFlags>
+
+/**
+ * KDSoapDebug controls the logging of the SOAP messages sent and received by KDSoap.
+ *
+ * The messages are logged with qDebug, in the logging categories "kdsoap.client" and "kdsoap.server",
+ * so they can also be enabled with QLoggingCategory::setFilterRules() or QT_LOGGING_RULES.
+ *
+ * The environment variable KDSOAP_DEBUG is read once, when KDSoap first needs to know
+ * whether to log something: setting it to a non-empty value other than "0" enables both categories,
+ * and its comma-separated values set the options (e.g. KDSOAP_DEBUG=http,reformat,indent=2).
+ * The static methods of this class can change all of this at runtime.
+ *
+ * When logging is disabled, no formatting of any kind happens in the request path.
+ *
+ * \since 2.3
+ */
+class KDSOAP_EXPORT KDSoapDebug
+{
+public:
+    /**
+     * The side of the communication being logged
+     */
+    enum Category
+    {
+        Client, ///< messages sent and received by KDSoapClientInterface ("kdsoap.client")
+        Server ///< requests received and responses sent by KDSoapServer ("kdsoap.server")
+    };
+
+    /**
+     * Options for the client-side output
+     */
+    enum Option
+    {
+        NoOption = 0,
+        Escape = 1, ///< output the messages escaped, on a single line ("escape")
+        Http = 2, ///< also output the HTTP headers ("http")
+        Reformat = 4 ///< indent the XML ("reformat")
+    };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    /**
+     * Enables or disables the logging of messages for \p category.
+     */
+    static void setEnabled(Category category, bool enabled);
+    /**
+     * \return true if the messages of \p category are logged
+     */
+    static bool isEnabled(Category category);
+
+    /**
+     * Sets the options for the client-side output
+     */
+    static void setOptions(Options options);
+    /**
+     * \return the options for the client-side output
+     */
+    static Options options();
+
+    /**
+     * Sets the indentation used by the Reformat option. The default is 4.
+     */
+    static void setIndentation(int indentation);
+    /**
+     * \return the indentation used by the Reformat option
+     */
+    static int indentation();
+
+    /**
+     * Only logs one call out of \p interval, e.g. 100 to log 1% of the calls.
+     * For a call which is logged, both the request and the response are logged.
+     * The default is 1, i.e. all calls are logged.
+     */
+    static void setSamplingInterval(int interval);
+    /**
+     * \return the sampling interval, see setSamplingInterval()
+     */
+    static int samplingInterval();
+
+private:
+    KDSoapDebug() = delete;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KDSoapDebug::Options)
+
+#endif // KDSOAPDEBUG_H
@@ -0,0 +1,25 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPDEBUG_P_H
+#define KDSOAPDEBUG_P_H
+
+#include "KDSoapDebug.h"
+#include <QtCore/QLoggingCategory>
+
+// For use with qCDebug
+KDSOAP_EXPORT QLoggingCategory &kdsoapClientDebug();
+KDSOAP_EXPORT QLoggingCategory &kdsoapServerDebug();
+
+// Returns true if the call about to be made (or handled) should be logged:
+// logging is enabled for this category, and the call is selected by the sampling.
+// Cheap when logging is disabled.
+KDSOAP_EXPORT bool kdsoapShouldDebugCall(KDSoapDebug::Category category);
+
+#endif // KDSOAPDEBUG_P_H
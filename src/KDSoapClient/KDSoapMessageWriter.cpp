@@ -12,6 +12,7 @@
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapNamespacePrefixes_p.h"
 #include "KDSoapValue.h"
+#include <QBuffer>
 #include <QDebug>
 #include <QVariant>
 
@@ -114,3 +115,81 @@ QByteArray KDSoapMessageWriter::messageToXml(const KDSoapMessage &message, const
 
     return data;
 }
+
+class KDSoapStreamedMessageWriter::Private
+{
+public:
+    Private(KDSoap::SoapVersion version, const QString &messageNamespace, KDSoapValue::Use use)
+        : writer(&buffer)
+        , version(version)
+        , messageNamespace(messageNamespace)
+        , use(use)
+    {
+        buffer.open(QIODevice::WriteOnly);
+    }
+
+    QByteArray takeData()
+    {
+        const QByteArray data = buffer.data();
+        buffer.buffer().clear();
+        buffer.seek(0);
+        return data;
+    }
+
+    QBuffer buffer;
+    QXmlStreamWriter writer;
+    KDSoapNamespacePrefixes namespacePrefixes;
+    KDSoap::SoapVersion version;
+    QString messageNamespace;
+    KDSoapValue::Use use;
+};
+
+KDSoapStreamedMessageWriter::KDSoapStreamedMessageWriter(KDSoap::SoapVersion version, const QString &messageNamespace, KDSoapValue::Use use)
+    : d(new Private(version, messageNamespace, use))
+{
+}
+
+KDSoapStreamedMessageWriter::~KDSoapStreamedMessageWriter()
+{
+    delete d;
+}
+
+// Same output as KDSoapMessageWriter::messageToXml, minus the message contents
+QByteArray KDSoapStreamedMessageWriter::start(const QString &elementName, const KDSoapHeaders &headers)
+{
+    QXmlStreamWriter &writer = d->writer;
+    writer.writeStartDocument();
+    d->namespacePrefixes.writeStandardNamespaces(writer, d->version);
+
+    const QString soapEnvelope =
+        d->version == KDSoap::SOAP1_2 ? KDSoapNamespaceManager::soapEnvelope200305() : KDSoapNamespaceManager::soapEnvelope();
+    writer.writeStartElement(soapEnvelope, QLatin1String("Envelope"));
+    if (!headers.isEmpty()) {
+        d->namespacePrefixes.writeNamespace(writer, d->messageNamespace, QLatin1String("n1"));
+        writer.writeStartElement(soapEnvelope, QLatin1String("Header"));
+        for (const KDSoapMessage &header : headers) {
+            header.writeChildren(d->namespacePrefixes, writer, header.use(), d->messageNamespace, true);
+        }
+        writer.writeEndElement(); // Header
+    } else {
+        d->namespacePrefixes.insert(d->messageNamespace, QString::fromLatin1("n1"));
+    }
+    writer.writeStartElement(soapEnvelope, QLatin1String("Body"));
+    writer.writeStartElement(d->messageNamespace, elementName);
+    return d->takeData();
+}
+
+QByteArray KDSoapStreamedMessageWriter::writeValue(const KDSoapValue &value)
+{
+    value.writeElement(d->namespacePrefixes, d->writer, d->use, d->messageNamespace, false);
+    return d->takeData();
+}
+
+QByteArray KDSoapStreamedMessageWriter::finish()
+{
+    d->writer.writeEndElement(); // the response element
+    d->writer.writeEndElement(); // Body
+    d->writer.writeEndElement(); // Envelope
+    d->writer.writeEndDocument();
+    return d->takeData();
+}
@@ -45,4 +45,28 @@ private:
     KDSoap::SoapVersion m_version;
 };
 
+/**
+ * \internal
+ * Writes a response message piece by piece, for KDSoapResponseStream in the server lib.
+ * Each method returns the XML produced since the previous call, so that it can be sent right away.
+ */
+class KDSOAP_EXPORT KDSoapStreamedMessageWriter
+{
+public:
+    KDSoapStreamedMessageWriter(KDSoap::SoapVersion version, const QString &messageNamespace, KDSoapValue::Use use);
+    ~KDSoapStreamedMessageWriter();
+
+    // Envelope, headers, Body and the start of the \p elementName element
+    QByteArray start(const QString &elementName, const KDSoapHeaders &headers);
+    // One child element of the \p elementName element
+    QByteArray writeValue(const KDSoapValue &value);
+    // Closes all open elements
+    QByteArray finish();
+
+private:
+    Q_DISABLE_COPY(KDSoapStreamedMessageWriter)
+    class Private;
+    Private *const d;
+};
+
 #endif // KDSOAPMESSAGEWRITER_P_H
@@ -8,6 +8,7 @@
 **
 ****************************************************************************/
 #include "KDSoapPendingCall.h"
+#include "KDSoapDebug_p.h"
 #include "KDSoapMessageReader_p.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapPendingCall_p.h"
@@ -16,17 +17,11 @@
 
 static void debugHelper(const QByteArray &data, const QList<QNetworkReply::RawHeaderPair> &headerList)
 {
-    const QByteArray doDebug = qgetenv("KDSOAP_DEBUG");
-    const QList<QByteArray> options = doDebug.toLower().split(',');
-    const bool optEscape = options.contains("escape");
-    const bool optHttp = options.contains("http") || options.contains("https");
-    const bool optReformat = options.contains("reformat");
-    quint8 indentation = 4;
-    for (const QByteArray &opt : std::as_const(options)) {
-        if (opt.startsWith("indent=")) { // krazy:exclude=strings
-            indentation = opt.mid(7).toUShort();
-        }
-    }
+    const KDSoapDebug::Options options = KDSoapDebug::options();
+    const bool optEscape = options.testFlag(KDSoapDebug::Escape);
+    const bool optHttp = options.testFlag(KDSoapDebug::Http);
+    const bool optReformat = options.testFlag(KDSoapDebug::Reformat);
+    const int indentation = KDSoapDebug::indentation();
 
     QByteArray toOutput;
     if (optHttp) {
@@ -59,17 +54,17 @@ static void debugHelper(const QByteArray &data, const QList<QNetworkReply::RawHe
     }
 
     if (optEscape) {
-        qDebug() << toOutput;
+        qCDebug(kdsoapClientDebug) << toOutput;
     } else {
-        qDebug().noquote() << toOutput;
+        qCDebug(kdsoapClientDebug).noquote() << toOutput;
     }
 }
 
 // Log the HTTP and XML of a response from the server.
 static void maybeDebugResponse(const QByteArray &data, QNetworkReply *reply)
 {
-    const QByteArray doDebug = qgetenv("KDSOAP_DEBUG");
-    if (doDebug.trimmed().isEmpty() || doDebug == "0") {
+    // Only if the request was logged, see maybeDebugRequest
+    if (!kdsoapClientDebug().isDebugEnabled() || !reply->property("kdsoap_debug_call").toBool()) {
         return;
     }
 
@@ -80,13 +75,13 @@ static void maybeDebugResponse(const QByteArray &data, QNetworkReply *reply)
 // (not static, because this is used in KDSoapClientInterface)
 void maybeDebugRequest(const QByteArray &data, const QNetworkRequest &request, QNetworkReply *reply)
 {
-    const QByteArray doDebug = qgetenv("KDSOAP_DEBUG");
-    if (doDebug.trimmed().isEmpty() || doDebug == "0") {
+    if (!kdsoapShouldDebugCall(KDSoapDebug::Client)) {
         return;
     }
 
     QList<QNetworkReply::RawHeaderPair> headerList;
     if (reply) {
+        reply->setProperty("kdsoap_debug_call", true);
         QByteArray method;
         switch (reply->operation()) {
         default:
@@ -155,6 +150,21 @@ bool KDSoapPendingCall::isFinished() const
     return d->reply.data()->isFinished();
 }
 
+void KDSoapPendingCall::onFinished(const std::function<void()> &callback) const
+{
+    QNetworkReply *reply = d->reply.data();
+    if (!reply) {
+        return;
+    }
+    // Queued, so that the callback can delete the call (and therefore the reply) safely.
+    // Using the reply as context drops the callback if the call is canceled.
+    if (reply->isFinished()) {
+        QMetaObject::invokeMethod(reply, callback, Qt::QueuedConnection);
+    } else {
+        QObject::connect(reply, &QNetworkReply::finished, reply, callback, Qt::QueuedConnection);
+    }
+}
+
 KDSoapMessage KDSoapPendingCall::returnMessage() const
 {
     d->parseReply();
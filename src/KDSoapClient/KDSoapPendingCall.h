@@ -12,6 +12,7 @@
 
 #include "KDSoapMessage.h"
 #include <QtCore/QExplicitlySharedDataPointer>
+#include <functional>
 QT_BEGIN_NAMESPACE
 class QNetworkReply;
 class QBuffer;
@@ -90,6 +91,19 @@ public:
      */
     bool isFinished() const;
 
+    /**
+     * Calls \p callback once the call has finished, from the event loop of the thread
+     * of the KDSoapClientInterface which made the call.
+     *
+     * This is a lightweight alternative to KDSoapPendingCallWatcher, which doesn't need a QObject.
+     * It is what makes KDSoapPendingCall awaitable with C++20 co_await, see KDSoapAwaitable.h.
+     *
+     * \note The callback isn't called if the call is canceled, i.e. if the last copy of
+     * this KDSoapPendingCall or the KDSoapClientInterface is deleted first.
+     * \since 2.3
+     */
+    void onFinished(const std::function<void()> &callback) const;
+
 private:
     friend class KDSoapClientInterface;
     friend class KDSoapThreadTask;
@@ -0,0 +1,280 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapResponseCache_p.h"
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
+
+KDSoapCachedResponse KDSoapCachedResponse::fromReply(QNetworkReply *reply)
+{
+    KDSoapCachedResponse response;
+    // peek rather than read, the data is still needed by the caller who sent this request
+    if (KDSoapCachedReply *cachedReply = qobject_cast<KDSoapCachedReply *>(reply)) {
+        response.data = cachedReply->data(); // e.g. a KDSoapRetryingReply, unbuffered
+    } else if (reply->isOpen()) {
+        response.data = reply->peek(reply->bytesAvailable());
+    }
+    response.rawHeaders = reply->rawHeaderPairs();
+    response.httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() == QNetworkReply::OperationCanceledError && reply->property("kdsoap_reply_timed_out").toBool()) { // see KDSoapClientInterface.cpp
+        response.error = QNetworkReply::TimeoutError;
+        response.errorString = QString::fromLatin1("Operation timed out");
+    } else {
+        response.error = reply->error();
+        response.errorString = reply->errorString();
+    }
+    return response;
+}
+
+KDSoapCachedReply::KDSoapCachedReply(const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply(parent)
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::PostOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void KDSoapCachedReply::abort()
+{
+    if (!isFinished()) {
+        setError(QNetworkReply::OperationCanceledError, tr("Operation canceled"));
+        setFinished(true);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        emit errorOccurred(QNetworkReply::OperationCanceledError);
+#else
+        emit error(QNetworkReply::OperationCanceledError);
+#endif
+        emit finished();
+    }
+    close();
+}
+
+qint64 KDSoapCachedReply::bytesAvailable() const
+{
+    return m_data.size() - m_offset + QNetworkReply::bytesAvailable();
+}
+
+qint64 KDSoapCachedReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 len = qMin<qint64>(maxSize, m_data.size() - m_offset);
+    if (len <= 0) {
+        return isFinished() ? -1 : 0;
+    }
+    memcpy(data, m_data.constData() + m_offset, len);
+    m_offset += len;
+    return len;
+}
+
+void KDSoapCachedReply::setResponse(const KDSoapCachedResponse &response)
+{
+    if (isFinished()) { // e.g. aborted by the timeout
+        return;
+    }
+    m_data = response.data;
+    for (const QNetworkReply::RawHeaderPair &header : response.rawHeaders) {
+        setRawHeader(header.first, header.second);
+    }
+    if (response.httpStatusCode != 0) {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, response.httpStatusCode);
+    }
+    if (response.error != QNetworkReply::NoError) {
+        setError(response.error, response.errorString);
+    }
+    setFinished(true);
+
+    emit metaDataChanged();
+    if (response.error != QNetworkReply::NoError) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        emit errorOccurred(response.error);
+#else
+        emit error(response.error);
+#endif
+    }
+    if (!m_data.isEmpty()) {
+        emit readyRead();
+    }
+    emit finished();
+}
+
+////
+
+KDSoapInFlightRequest::KDSoapInFlightRequest(KDSoapResponseCache *cache, const QByteArray &key, int msecs, QNetworkReply *reply)
+    : QObject(reply)
+    , m_cache(cache)
+    , m_key(key)
+    , m_timeout(msecs)
+{
+    connect(reply, &QNetworkReply::finished, this, &KDSoapInFlightRequest::slotFinished);
+}
+
+KDSoapInFlightRequest::~KDSoapInFlightRequest()
+{
+    // The reply was deleted before finishing, e.g. because its KDSoapPendingCall was dropped.
+    // Don't leave the callers who were waiting for the same response hanging.
+    if (!m_done) {
+        KDSoapCachedResponse response;
+        response.error = QNetworkReply::OperationCanceledError;
+        response.errorString = QString::fromLatin1("Operation canceled");
+        done(response);
+    }
+}
+
+void KDSoapInFlightRequest::slotFinished()
+{
+    done(KDSoapCachedResponse::fromReply(static_cast<QNetworkReply *>(parent())));
+}
+
+void KDSoapInFlightRequest::done(const KDSoapCachedResponse &response)
+{
+    if (m_done) {
+        return;
+    }
+    m_done = true;
+    if (m_cache) {
+        m_cache->requestFinished(this, response);
+    }
+    emit responseAvailable(response);
+}
+
+////
+
+KDSoapResponseCache::KDSoapResponseCache()
+    : m_entries(100)
+{
+    qRegisterMetaType<KDSoapCachedResponse>();
+}
+
+KDSoapResponseCache::~KDSoapResponseCache()
+{
+    // The replies (and their KDSoapInFlightRequest children) can outlive us, see ~KDSoapClientInterfacePrivate
+    QMutexLocker locker(&m_mutex);
+    for (KDSoapInFlightRequest *inFlight : std::as_const(m_inFlight)) {
+        inFlight->m_cache = nullptr;
+    }
+}
+
+void KDSoapResponseCache::setTimeout(const QString &operation, int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (msecs > 0) {
+        m_timeouts.insert(operation, msecs);
+    } else {
+        m_timeouts.remove(operation);
+    }
+}
+
+int KDSoapResponseCache::timeout(const QString &operation) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_timeouts.value(operation);
+}
+
+int KDSoapResponseCache::timeout(const QString &method, const QString &soapAction) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_timeouts.isEmpty()) {
+        return 0;
+    }
+    const int msecs = m_timeouts.value(method);
+    return msecs > 0 ? msecs : m_timeouts.value(soapAction);
+}
+
+void KDSoapResponseCache::setMaxEntries(int entries)
+{
+    QMutexLocker locker(&m_mutex);
+    const int before = int(m_entries.size());
+    m_entries.setMaxCost(qMax(0, entries));
+    m_statistics.evictions += before - int(m_entries.size());
+}
+
+int KDSoapResponseCache::maxEntries() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_entries.maxCost());
+}
+
+void KDSoapResponseCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+}
+
+KDSoapClientInterface::ResponseCacheStatistics KDSoapResponseCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+QByteArray KDSoapResponseCache::cacheKey(const QNetworkRequest &request, const QByteArray &requestData)
+{
+    // The message writer always produces the same bytes for the same message,
+    // so hashing them is enough to recognize identical requests.
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(request.url().toEncoded() + "\r\n");
+    const QList<QByteArray> rawHeaders = request.rawHeaderList();
+    for (const QByteArray &header : rawHeaders) {
+        hash.addData(header + ": " + request.rawHeader(header) + "\r\n");
+    }
+    hash.addData(requestData);
+    return hash.result();
+}
+
+QNetworkReply *KDSoapResponseCache::post(QNetworkAccessManager *manager, const QNetworkRequest &request, const QByteArray &requestData, int msecs,
+                                         const Sender &sender)
+{
+    const QByteArray key = cacheKey(request, requestData);
+
+    QMutexLocker locker(&m_mutex);
+    if (Entry *entry = m_entries.object(key)) {
+        if (!entry->expiry.hasExpired()) {
+            ++m_statistics.hits;
+            KDSoapCachedReply *reply = new KDSoapCachedReply(request, manager);
+            // Queued, so that the caller has a chance to connect to finished()
+            QMetaObject::invokeMethod(reply, "setResponse", Qt::QueuedConnection, Q_ARG(KDSoapCachedResponse, entry->response));
+            return reply;
+        }
+        m_entries.remove(key);
+    }
+
+    if (KDSoapInFlightRequest *inFlight = m_inFlight.value(key)) {
+        ++m_statistics.coalesced;
+        KDSoapCachedReply *reply = new KDSoapCachedReply(request, manager);
+        // Queued if the identical request was sent by another thread (e.g. asyncCall vs call)
+        QObject::connect(inFlight, &KDSoapInFlightRequest::responseAvailable, reply, &KDSoapCachedReply::setResponse);
+        return reply;
+    }
+
+    ++m_statistics.misses;
+    QNetworkReply *reply = sender();
+    m_inFlight.insert(key, new KDSoapInFlightRequest(this, key, msecs, reply));
+    return reply;
+}
+
+void KDSoapResponseCache::requestFinished(KDSoapInFlightRequest *inFlight, const KDSoapCachedResponse &response)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_inFlight.constFind(inFlight->m_key);
+    if (it != m_inFlight.constEnd() && it.value() == inFlight) {
+        m_inFlight.erase(it);
+    }
+    // Faults come with HTTP status 500, don't cache those
+    if (response.error == QNetworkReply::NoError && response.httpStatusCode == 200) {
+        insert(inFlight->m_key, new Entry {response, QDeadlineTimer(inFlight->m_timeout)});
+    }
+}
+
+void KDSoapResponseCache::insert(const QByteArray &key, Entry *entry)
+{
+    const int before = int(m_entries.size()) + (m_entries.contains(key) ? 0 : 1);
+    m_entries.insert(key, entry);
+    m_statistics.evictions += qMax(0, before - int(m_entries.size()));
+}
+
+#include "moc_KDSoapResponseCache_p.cpp"
@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPRESPONSECACHE_P_H
+#define KDSOAPRESPONSECACHE_P_H
+
+#include "KDSoapClientInterface.h"
+#include <QtCore/QCache>
+#include <QtCore/QDeadlineTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtNetwork/QNetworkReply>
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QNetworkAccessManager;
+QT_END_NAMESPACE
+
+// What we remember from a reply, in order to replay it later
+struct KDSoapCachedResponse
+{
+    QByteArray data;
+    QList<QNetworkReply::RawHeaderPair> rawHeaders;
+    int httpStatusCode = 0;
+    QNetworkReply::NetworkError error = QNetworkReply::NoError;
+    QString errorString;
+
+    // Doesn't consume the data of \p reply
+    static KDSoapCachedResponse fromReply(QNetworkReply *reply);
+};
+Q_DECLARE_METATYPE(KDSoapCachedResponse)
+
+// A reply which doesn't go to the network, it's fed with a response
+// from the cache or from an identical request already in flight.
+class KDSoapCachedReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    KDSoapCachedReply(const QNetworkRequest &request, QObject *parent);
+
+    void abort() override;
+    qint64 bytesAvailable() const override;
+
+    // The whole response data, including what was read already
+    QByteArray data() const
+    {
+        return m_data;
+    }
+
+public Q_SLOTS:
+    void setResponse(const KDSoapCachedResponse &response);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+
+private:
+    QByteArray m_data;
+    qint64 m_offset = 0;
+};
+
+class KDSoapResponseCache;
+
+// Child of a network reply sent for a cacheable operation.
+// Other callers waiting for the same response connect to responseAvailable().
+class KDSoapInFlightRequest : public QObject
+{
+    Q_OBJECT
+public:
+    KDSoapInFlightRequest(KDSoapResponseCache *cache, const QByteArray &key, int msecs, QNetworkReply *reply);
+    ~KDSoapInFlightRequest() override;
+
+Q_SIGNALS:
+    void responseAvailable(const KDSoapCachedResponse &response);
+
+private Q_SLOTS:
+    void slotFinished();
+
+private:
+    friend class KDSoapResponseCache;
+    void done(const KDSoapCachedResponse &response);
+
+    KDSoapResponseCache *m_cache;
+    QByteArray m_key;
+    int m_timeout;
+    bool m_done = false;
+};
+
+// Thread-safe: used both by asyncCall (main thread) and by call (KDSoapClientThread)
+class KDSoapResponseCache
+{
+public:
+    KDSoapResponseCache();
+    ~KDSoapResponseCache();
+
+    void setTimeout(const QString &operation, int msecs);
+    int timeout(const QString &operation) const;
+    int timeout(const QString &method, const QString &soapAction) const;
+
+    void setMaxEntries(int entries);
+    int maxEntries() const;
+
+    void clear();
+    KDSoapClientInterface::ResponseCacheStatistics statistics() const;
+
+    using Sender = std::function<QNetworkReply *()>;
+
+    // Returns a reply answering \p request: from the cache if possible, otherwise
+    // attached to an identical request in flight, otherwise the reply returned by \p sender,
+    // which then becomes the request in flight for the next identical ones.
+    QNetworkReply *post(QNetworkAccessManager *manager, const QNetworkRequest &request, const QByteArray &requestData, int msecs, const Sender &sender);
+
+private:
+    friend class KDSoapInFlightRequest;
+    struct Entry
+    {
+        KDSoapCachedResponse response;
+        QDeadlineTimer expiry;
+    };
+
+    static QByteArray cacheKey(const QNetworkRequest &request, const QByteArray &requestData);
+    void requestFinished(KDSoapInFlightRequest *inFlight, const KDSoapCachedResponse &response);
+    void insert(const QByteArray &key, Entry *entry);
+
+    mutable QMutex m_mutex;
+    QHash<QString, int> m_timeouts;
+    QCache<QByteArray, Entry> m_entries;
+    QHash<QByteArray, KDSoapInFlightRequest *> m_inFlight;
+    KDSoapClientInterface::ResponseCacheStatistics m_statistics;
+};
+
+#endif // KDSOAPRESPONSECACHE_P_H
@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapRetryPolicy.h"
+
+class KDSoapRetryPolicy::Private
+{
+public:
+    int maxAttempts = 1;
+    int initialBackoff = 100;
+    double backoffMultiplier = 2.0;
+    int maxBackoff = 10000;
+    QList<QNetworkReply::NetworkError> retryableNetworkErrors = {
+        QNetworkReply::ConnectionRefusedError,
+        QNetworkReply::RemoteHostClosedError,
+        QNetworkReply::TimeoutError,
+        QNetworkReply::TemporaryNetworkFailureError,
+        QNetworkReply::NetworkSessionFailedError,
+        QNetworkReply::ProxyConnectionClosedError,
+        QNetworkReply::ServiceUnavailableError,
+    };
+    QStringList retryableFaultCodes;
+    int hedgingDelay = 0;
+    int hedgingPercentile = 0;
+};
+
+KDSoapRetryPolicy::KDSoapRetryPolicy()
+    : d(new Private)
+{
+}
+
+KDSoapRetryPolicy::KDSoapRetryPolicy(const KDSoapRetryPolicy &other)
+    : d(new Private)
+{
+    *d = *other.d;
+}
+
+KDSoapRetryPolicy::~KDSoapRetryPolicy()
+{
+    delete d;
+}
+
+KDSoapRetryPolicy &KDSoapRetryPolicy::operator=(const KDSoapRetryPolicy &other)
+{
+    *d = *other.d;
+    return *this;
+}
+
+void KDSoapRetryPolicy::setMaxAttempts(int attempts)
+{
+    d->maxAttempts = qMax(1, attempts);
+}
+
+int KDSoapRetryPolicy::maxAttempts() const
+{
+    return d->maxAttempts;
+}
+
+void KDSoapRetryPolicy::setInitialBackoff(int msecs)
+{
+    d->initialBackoff = qMax(0, msecs);
+}
+
+int KDSoapRetryPolicy::initialBackoff() const
+{
+    return d->initialBackoff;
+}
+
+void KDSoapRetryPolicy::setBackoffMultiplier(double multiplier)
+{
+    d->backoffMultiplier = qMax(1.0, multiplier);
+}
+
+double KDSoapRetryPolicy::backoffMultiplier() const
+{
+    return d->backoffMultiplier;
+}
+
+void KDSoapRetryPolicy::setMaxBackoff(int msecs)
+{
+    d->maxBackoff = qMax(0, msecs);
+}
+
+int KDSoapRetryPolicy::maxBackoff() const
+{
+    return d->maxBackoff;
+}
+
+void KDSoapRetryPolicy::setRetryableNetworkErrors(const QList<QNetworkReply::NetworkError> &errors)
+{
+    d->retryableNetworkErrors = errors;
+}
+
+QList<QNetworkReply::NetworkError> KDSoapRetryPolicy::retryableNetworkErrors() const
+{
+    return d->retryableNetworkErrors;
+}
+
+void KDSoapRetryPolicy::setRetryableFaultCodes(const QStringList &faultCodes)
+{
+    d->retryableFaultCodes = faultCodes;
+}
+
+QStringList KDSoapRetryPolicy::retryableFaultCodes() const
+{
+    return d->retryableFaultCodes;
+}
+
+void KDSoapRetryPolicy::setHedgingDelay(int msecs)
+{
+    d->hedgingDelay = qMax(0, msecs);
+}
+
+int KDSoapRetryPolicy::hedgingDelay() const
+{
+    return d->hedgingDelay;
+}
+
+void KDSoapRetryPolicy::setHedgingPercentile(int percentile)
+{
+    d->hedgingPercentile = qBound(0, percentile, 100);
+}
+
+int KDSoapRetryPolicy::hedgingPercentile() const
+{
+    return d->hedgingPercentile;
+}
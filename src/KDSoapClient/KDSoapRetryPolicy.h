@@ -0,0 +1,138 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPRETRYPOLICY_H
+#define KDSOAPRETRYPOLICY_H
+
+#include "KDSoapGlobal.h"
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtNetwork/QNetworkReply>
+
+/**
+ * KDSoapRetryPolicy describes how a failed call is sent again to the server,
+ * and optionally how a duplicate request is sent when the server is slow to answer ("hedging").
+ *
+ * Only operations marked as idempotent with KDSoapClientInterface::setOperationIdempotent()
+ * are retried and hedged, since the server might process the request several times.
+ * Other operations are only retried after QNetworkReply::ConnectionRefusedError (when it is
+ * one of the retryable errors), where the request can't have reached the server.
+ *
+ * \see KDSoapClientInterface::setRetryPolicy()
+ * \since 2.3
+ */
+class KDSOAP_EXPORT KDSoapRetryPolicy
+{
+public:
+    /**
+     * Constructs a retry policy which doesn't retry anything (maxAttempts() is 1).
+     */
+    KDSoapRetryPolicy();
+    /**
+     * Constructs a copy of \p other.
+     */
+    KDSoapRetryPolicy(const KDSoapRetryPolicy &other);
+    /**
+     * Destructs the object
+     */
+    ~KDSoapRetryPolicy();
+    /**
+     * Assigns the contents of \p other to this retry policy.
+     */
+    KDSoapRetryPolicy &operator=(const KDSoapRetryPolicy &other);
+
+    /**
+     * Sets the maximum number of requests sent for a single call, including the first one
+     * and the hedged requests. The default is 1, which disables retrying and hedging.
+     */
+    void setMaxAttempts(int attempts);
+    /**
+     * \return the maximum number of requests sent for a single call
+     */
+    int maxAttempts() const;
+
+    /**
+     * Sets the delay before the first retry, in milliseconds. The default is 100.
+     * The delay is multiplied by backoffMultiplier() after each retry, up to maxBackoff().
+     */
+    void setInitialBackoff(int msecs);
+    /**
+     * \return the delay before the first retry, in milliseconds
+     */
+    int initialBackoff() const;
+
+    /**
+     * Sets the factor applied to the delay after each retry. The default is 2.
+     */
+    void setBackoffMultiplier(double multiplier);
+    /**
+     * \return the factor applied to the delay after each retry
+     */
+    double backoffMultiplier() const;
+
+    /**
+     * Sets the maximum delay between two retries, in milliseconds. The default is 10000.
+     */
+    void setMaxBackoff(int msecs);
+    /**
+     * \return the maximum delay between two retries, in milliseconds
+     */
+    int maxBackoff() const;
+
+    /**
+     * Sets the network errors after which a call is retried.
+     * The default is ConnectionRefusedError, RemoteHostClosedError, TimeoutError,
+     * TemporaryNetworkFailureError, NetworkSessionFailedError, ProxyConnectionClosedError
+     * and ServiceUnavailableError (HTTP 503).
+     */
+    void setRetryableNetworkErrors(const QList<QNetworkReply::NetworkError> &errors);
+    /**
+     * \return the network errors after which a call is retried
+     */
+    QList<QNetworkReply::NetworkError> retryableNetworkErrors() const;
+
+    /**
+     * Sets the SOAP fault codes after which a call is retried, for instance "Server.Busy".
+     * A fault code matches with or without its namespace prefix. The default is an empty list.
+     */
+    void setRetryableFaultCodes(const QStringList &faultCodes);
+    /**
+     * \return the SOAP fault codes after which a call is retried
+     */
+    QStringList retryableFaultCodes() const;
+
+    /**
+     * Sets the time after which a duplicate request is sent if no response arrived yet,
+     * in milliseconds. The first response to arrive is used, the other requests are aborted.
+     * The default is 0, which disables hedging unless hedgingPercentile() is set.
+     */
+    void setHedgingDelay(int msecs);
+    /**
+     * \return the time after which a duplicate request is sent, in milliseconds
+     */
+    int hedgingDelay() const;
+
+    /**
+     * Sends the duplicate request once the call takes longer than \p percentile percent
+     * of the recent successful calls of the same operation (for instance 95).
+     * hedgingDelay() is used until enough calls were made to compute the percentile.
+     * The default is 0 (disabled).
+     */
+    void setHedgingPercentile(int percentile);
+    /**
+     * \return the latency percentile after which a duplicate request is sent
+     */
+    int hedgingPercentile() const;
+
+private:
+    class Private;
+    Private *const d;
+};
+
+#endif // KDSOAPRETRYPOLICY_H
@@ -0,0 +1,187 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapRetryingReply_p.h"
+#include "KDSoapMessageReader_p.h"
+#include <algorithm>
+
+void KDSoapLatencyStatistics::addSample(const QString &operation, int msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    Samples &samples = m_samples[operation];
+    if (samples.values.size() < MaxSamples) {
+        samples.values.append(msecs);
+    } else {
+        samples.values[samples.next] = msecs;
+        samples.next = (samples.next + 1) % MaxSamples;
+    }
+}
+
+int KDSoapLatencyStatistics::percentile(const QString &operation, int percentile) const
+{
+    QVector<int> values;
+    {
+        QMutexLocker locker(&m_mutex);
+        values = m_samples.value(operation).values;
+    }
+    if (values.size() < MinSamples) {
+        return -1;
+    }
+    const auto nth = values.begin() + (values.size() - 1) * percentile / 100;
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+////
+
+KDSoapRetryingReply::KDSoapRetryingReply(const QNetworkRequest &request, const KDSoapRetryPolicy &policy, bool idempotent,
+                                         KDSoap::SoapVersion soapVersion, const Sender &sender, KDSoapLatencyStatistics *statistics,
+                                         const QString &operation, QObject *parent)
+    : KDSoapCachedReply(request, parent)
+    , m_policy(policy)
+    , m_idempotent(idempotent)
+    , m_soapVersion(soapVersion)
+    , m_sender(sender)
+    , m_statistics(statistics)
+    , m_operation(operation)
+    , m_backoff(policy.initialBackoff())
+{
+    m_retryTimer.setSingleShot(true);
+    connect(&m_retryTimer, &QTimer::timeout, this, &KDSoapRetryingReply::sendAttempt);
+    m_hedgingTimer.setSingleShot(true);
+    connect(&m_hedgingTimer, &QTimer::timeout, this, &KDSoapRetryingReply::sendAttempt);
+    m_elapsed.start();
+    sendAttempt();
+}
+
+KDSoapRetryingReply::~KDSoapRetryingReply()
+{
+    cancelAttempts();
+}
+
+void KDSoapRetryingReply::abort()
+{
+    cancelAttempts();
+    KDSoapCachedReply::abort();
+}
+
+void KDSoapRetryingReply::sendAttempt()
+{
+    ++m_attemptCount;
+    QNetworkReply *attempt = m_sender();
+    m_attempts.insert(attempt, m_elapsed.elapsed());
+    connect(attempt, &QNetworkReply::finished, this, [this, attempt]() { attemptFinished(attempt); });
+    connect(attempt, &QObject::destroyed, this, [this, attempt]() { m_attempts.remove(attempt); });
+
+    if (m_idempotent && m_attemptCount < m_policy.maxAttempts()) {
+        const int delay = hedgingDelay();
+        if (delay > 0) {
+            m_hedgingTimer.start(delay);
+        }
+    }
+}
+
+void KDSoapRetryingReply::attemptFinished(QNetworkReply *attempt)
+{
+    const qint64 startTime = m_attempts.take(attempt);
+    attempt->disconnect(this);
+    const KDSoapCachedResponse response = KDSoapCachedResponse::fromReply(attempt);
+    attempt->deleteLater();
+
+    if (!isRetryable(response)) {
+        if (response.error == QNetworkReply::NoError) {
+            m_statistics->addSample(m_operation, int(m_elapsed.elapsed() - startTime));
+        }
+        finish(response);
+        return;
+    }
+    if (!m_attempts.isEmpty()) {
+        return; // a hedged request is still running, it might succeed
+    }
+    if (m_attemptCount >= m_policy.maxAttempts()) {
+        finish(response);
+        return;
+    }
+    m_hedgingTimer.stop();
+    m_retryTimer.start(m_backoff);
+    m_backoff = qMin(int(m_backoff * m_policy.backoffMultiplier()), m_policy.maxBackoff());
+}
+
+bool KDSoapRetryingReply::isRetryable(const KDSoapCachedResponse &response) const
+{
+    if (response.error == QNetworkReply::NoError) {
+        return false;
+    }
+    if (!m_idempotent && response.error != QNetworkReply::ConnectionRefusedError) {
+        return false; // the server might have processed the request already
+    }
+    if (m_policy.retryableNetworkErrors().contains(response.error)) {
+        return true;
+    }
+    const QStringList retryableFaultCodes = m_policy.retryableFaultCodes();
+    if (retryableFaultCodes.isEmpty() || response.data.isEmpty()) {
+        return false;
+    }
+
+    KDSoapMessage message;
+    KDSoapMessageReader reader;
+    reader.xmlToMessage(response.data, &message, nullptr, nullptr, m_soapVersion);
+    if (!message.isFault()) {
+        return false;
+    }
+    QStringList faultCodes;
+    if (m_soapVersion == KDSoap::SOAP1_2) {
+        KDSoapValue faultCode = message.childValues().child(QLatin1String("Code"));
+        while (!faultCode.isNull()) {
+            faultCodes.append(faultCode.childValues().child(QLatin1String("Value")).value().toString());
+            faultCode = faultCode.childValues().child(QLatin1String("Subcode"));
+        }
+    } else {
+        faultCodes.append(message.childValues().child(QLatin1String("faultcode")).value().toString());
+    }
+    for (const QString &faultCode : std::as_const(faultCodes)) {
+        const QString withoutPrefix = faultCode.mid(faultCode.indexOf(QLatin1Char(':')) + 1);
+        if (retryableFaultCodes.contains(faultCode) || retryableFaultCodes.contains(withoutPrefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int KDSoapRetryingReply::hedgingDelay() const
+{
+    if (m_policy.hedgingPercentile() > 0) {
+        const int delay = m_statistics->percentile(m_operation, m_policy.hedgingPercentile());
+        if (delay >= 0) {
+            return qMax(1, delay);
+        }
+    }
+    return m_policy.hedgingDelay();
+}
+
+void KDSoapRetryingReply::finish(const KDSoapCachedResponse &response)
+{
+    cancelAttempts();
+    setResponse(response);
+}
+
+void KDSoapRetryingReply::cancelAttempts()
+{
+    m_retryTimer.stop();
+    m_hedgingTimer.stop();
+    const QList<QNetworkReply *> attempts = m_attempts.keys();
+    m_attempts.clear();
+    for (QNetworkReply *attempt : attempts) {
+        attempt->disconnect(this);
+        attempt->abort();
+        attempt->deleteLater();
+    }
+}
+
+#include "moc_KDSoapRetryingReply_p.cpp"
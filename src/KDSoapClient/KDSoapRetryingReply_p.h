@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPRETRYINGREPLY_P_H
+#define KDSOAPRETRYINGREPLY_P_H
+
+#include "KDSoapResponseCache_p.h"
+#include "KDSoapRetryPolicy.h"
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <functional>
+
+// Latencies of the recent successful calls, per operation, used for hedging.
+// Thread-safe: used both by asyncCall (main thread) and by call (KDSoapClientThread)
+class KDSoapLatencyStatistics
+{
+public:
+    void addSample(const QString &operation, int msecs);
+    // Returns -1 if there aren't enough samples yet
+    int percentile(const QString &operation, int percentile) const;
+
+private:
+    enum {
+        MaxSamples = 100,
+        MinSamples = 20
+    };
+    struct Samples
+    {
+        QVector<int> values;
+        int next = 0;
+    };
+    mutable QMutex m_mutex;
+    QHash<QString, Samples> m_samples;
+};
+
+// The reply seen by KDSoapPendingCall when a retry policy is set.
+// It sends the actual requests ("attempts") and finishes with the response of the one which counts.
+class KDSoapRetryingReply : public KDSoapCachedReply
+{
+    Q_OBJECT
+public:
+    using Sender = std::function<QNetworkReply *()>;
+
+    KDSoapRetryingReply(const QNetworkRequest &request, const KDSoapRetryPolicy &policy, bool idempotent, KDSoap::SoapVersion soapVersion,
+                        const Sender &sender, KDSoapLatencyStatistics *statistics, const QString &operation, QObject *parent);
+    ~KDSoapRetryingReply() override;
+
+    void abort() override;
+
+private Q_SLOTS:
+    void sendAttempt();
+
+private:
+    void attemptFinished(QNetworkReply *attempt);
+    bool isRetryable(const KDSoapCachedResponse &response) const;
+    int hedgingDelay() const;
+    void finish(const KDSoapCachedResponse &response);
+    void cancelAttempts();
+
+    const KDSoapRetryPolicy m_policy;
+    const bool m_idempotent;
+    const KDSoap::SoapVersion m_soapVersion;
+    const Sender m_sender;
+    KDSoapLatencyStatistics *const m_statistics;
+    const QString m_operation;
+
+    QHash<QNetworkReply *, qint64> m_attempts; // in flight, with their start time
+    int m_attemptCount = 0;
+    int m_backoff;
+    QElapsedTimer m_elapsed;
+    QTimer m_retryTimer;
+    QTimer m_hedgingTimer;
+};
+
+#endif // KDSOAPRETRYINGREPLY_P_H
@@ -278,6 +278,7 @@ private:
     KDSoapValue(QString, QString, QString);
 
     friend class KDSoapMessageWriter;
+    friend class KDSoapStreamedMessageWriter;
     void writeElement(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use, const QString &messageNamespace,
                       bool forceQualified) const;
     void writeElementContents(KDSoapNamespacePrefixes &namespacePrefixes, QXmlStreamWriter &writer, KDSoapValue::Use use,
@@ -0,0 +1,122 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapHttpHeaders_p.h"
+
+#include <cstring>
+
+// Same order as KnownHeader
+static const struct
+{
+    const char *name;
+    int length;
+} s_knownHeaders[] = {
+    {"accept-encoding", 15},
+    {"authorization", 13},
+    {"connection", 10},
+    {"content-length", 14},
+    {"content-type", 12},
+    {"if-modified-since", 17},
+    {"if-none-match", 13},
+    {"range", 5},
+    {"soapaction", 10},
+    {"transfer-encoding", 17},
+};
+static_assert(sizeof(s_knownHeaders) / sizeof(*s_knownHeaders) == KDSoapHttpHeaders::KnownHeaderCount, "s_knownHeaders must match KnownHeader");
+
+KDSoapHttpHeaders::KDSoapHttpHeaders()
+{
+    m_data.reserve(1024); // also makes clear() keep the capacity
+    clear();
+}
+
+void KDSoapHttpHeaders::clear()
+{
+    m_data.resize(0);
+    m_fields.clear();
+    for (int &index : m_known) {
+        index = -1;
+    }
+    m_hasRequestLine = false;
+    m_requestType = m_path = m_query = m_httpVersion = Part{0, 0};
+}
+
+KDSoapHttpHeaders::Part KDSoapHttpHeaders::store(const char *data, int length)
+{
+    const Part part{int(m_data.size()), length};
+    m_data.append(data, length);
+    return part;
+}
+
+void KDSoapHttpHeaders::setRequestLine(const char *requestType, int requestTypeLength, const QByteArray &path, const char *query, int queryLength,
+                                       const char *httpVersion, int httpVersionLength)
+{
+    m_hasRequestLine = true;
+    m_requestType = store(requestType, requestTypeLength);
+    m_path = store(path.constData(), path.size());
+    m_query = store(query, queryLength);
+    m_httpVersion = store(httpVersion, httpVersionLength);
+}
+
+void KDSoapHttpHeaders::append(const char *name, int nameLength, const char *value, int valueLength)
+{
+    const Field field{store(name, nameLength), store(value, valueLength)};
+    m_fields.append(field);
+    for (int i = 0; i < KnownHeaderCount; ++i) {
+        if (s_knownHeaders[i].length == nameLength && qstrnicmp(s_knownHeaders[i].name, name, nameLength) == 0) {
+            m_known[i] = m_fields.size() - 1;
+            break;
+        }
+    }
+}
+
+QByteArray KDSoapHttpHeaders::value(KnownHeader header) const
+{
+    const int index = m_known[header];
+    return index >= 0 ? part(m_fields.at(index).value) : QByteArray();
+}
+
+// RFC 7230 section 3.2: "Each header field consists of a case-insensitive field name"
+int KDSoapHttpHeaders::indexOf(const char *name, int nameLength) const
+{
+    const char *data = m_data.constData();
+    for (int i = m_fields.size() - 1; i >= 0; --i) {
+        const Part &fieldName = m_fields.at(i).name;
+        if (fieldName.length == nameLength && qstrnicmp(data + fieldName.offset, name, nameLength) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool KDSoapHttpHeaders::contains(const char *name) const
+{
+    return indexOf(name, int(strlen(name))) >= 0;
+}
+
+QByteArray KDSoapHttpHeaders::value(const char *name) const
+{
+    const int index = indexOf(name, int(strlen(name)));
+    return index >= 0 ? part(m_fields.at(index).value) : QByteArray();
+}
+
+QMap<QByteArray, QByteArray> KDSoapHttpHeaders::toMap() const
+{
+    QMap<QByteArray, QByteArray> map;
+    for (const Field &field : m_fields) {
+        map.insert(part(field.name).toLower(), detached(part(field.value)));
+    }
+    if (m_hasRequestLine) {
+        map.insert("_requestType", detached(requestType()));
+        map.insert("_path", detached(path()));
+        map.insert("_query", detached(query()));
+        map.insert("_httpVersion", detached(httpVersion()));
+    }
+    return map;
+}
@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPHTTPHEADERS_P_H
+#define KDSOAPHTTPHEADERS_P_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QVarLengthArray>
+
+/**
+ * The header fields (and request line) of an HTTP request, as parsed by KDSoapHttpRequestParser.
+ *
+ * All names and values are stored one after the other in a single buffer, which keeps its capacity
+ * from one request to the next, and the fields are a flat array of offsets into it.
+ * Storing the headers of a request therefore doesn't allocate anything in the usual case,
+ * unlike a QMap which allocates a node and two byte arrays per field.
+ *
+ * Lookups are case-insensitive, the headers used by the server are indexed while parsing.
+ * When the same field appears several times, the last one wins.
+ *
+ * The byte arrays returned by the getters don't copy anything: they point into the buffer,
+ * and are only valid until clear(). Callers which keep a value longer use detached().
+ */
+class KDSoapHttpHeaders
+{
+public:
+    // The headers which the server looks at, found without searching
+    enum KnownHeader
+    {
+        AcceptEncoding,
+        Authorization,
+        Connection,
+        ContentLength,
+        ContentType,
+        IfModifiedSince,
+        IfNoneMatch,
+        Range,
+        SoapAction,
+        TransferEncoding,
+        KnownHeaderCount
+    };
+
+    KDSoapHttpHeaders();
+
+    void clear();
+    void setRequestLine(const char *requestType, int requestTypeLength, const QByteArray &path, const char *query, int queryLength,
+                        const char *httpVersion, int httpVersionLength);
+    void append(const char *name, int nameLength, const char *value, int valueLength);
+
+    QByteArray requestType() const
+    {
+        return part(m_requestType);
+    }
+    QByteArray path() const
+    {
+        return part(m_path);
+    }
+    QByteArray query() const
+    {
+        return part(m_query);
+    }
+    QByteArray httpVersion() const
+    {
+        return part(m_httpVersion);
+    }
+
+    bool contains(KnownHeader header) const
+    {
+        return m_known[header] >= 0;
+    }
+    QByteArray value(KnownHeader header) const;
+    // \p name is case-insensitive
+    bool contains(const char *name) const;
+    QByteArray value(const char *name) const;
+
+    int count() const
+    {
+        return m_fields.size();
+    }
+    bool isEmpty() const
+    {
+        return m_fields.isEmpty();
+    }
+
+    // The map given to KDSoapServerRawXMLInterface and KDSoapServerCustomVerbRequestInterface:
+    // lowercase names, plus "_requestType", "_path", "_query" and "_httpVersion" for the request line.
+    // Unlike the getters, it holds copies of the data.
+    QMap<QByteArray, QByteArray> toMap() const;
+
+    // A copy of \p value which stays valid after clear()
+    static QByteArray detached(const QByteArray &value)
+    {
+        return QByteArray(value.constData(), value.size());
+    }
+
+private:
+    struct Part
+    {
+        int offset;
+        int length;
+    };
+    struct Field
+    {
+        Part name;
+        Part value;
+    };
+
+    Part store(const char *data, int length);
+    QByteArray part(const Part &part) const
+    {
+        return QByteArray::fromRawData(m_data.constData() + part.offset, part.length);
+    }
+    int indexOf(const char *name, int nameLength) const;
+
+    QByteArray m_data;
+    QVarLengthArray<Field, 32> m_fields;
+    int m_known[KnownHeaderCount];
+    bool m_hasRequestLine;
+    Part m_requestType;
+    Part m_path;
+    Part m_query;
+    Part m_httpVersion;
+};
+
+#endif // KDSOAPHTTPHEADERS_P_H
@@ -0,0 +1,438 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapHttpRequestParser_p.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QLocale>
+#include <QVarLengthArray>
+
+#include <cstring>
+#include <limits>
+
+// Longest chunk-size line (with its extensions) or trailer line we accept
+static const int s_maxChunkLineLength = 8192;
+// Longest request line or header line, and largest header section (request line included) we accept
+static const int s_maxHeaderLineLength = 16 * 1024;
+static const int s_maxHeaderSize = 64 * 1024;
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+KDSoapHttpRequestParser::KDSoapHttpRequestParser()
+    : m_state(RequestLine)
+    , m_writePos(0)
+    , m_pos(0)
+    , m_scanPos(0)
+    , m_bodyStart(0)
+    , m_remainingBodySize(0)
+    , m_chunked(false)
+    , m_chunkState(ChunkSizeLine)
+    , m_decodedEnd(0)
+    , m_chunkRemaining(0)
+    , m_headersTooLarge(false)
+{
+}
+
+char *KDSoapHttpRequestParser::prepareWrite(int size)
+{
+    m_writePos = m_buffer.size();
+    // QByteArray grows its capacity geometrically, and never shrinks it when resizing down (see commitWrite)
+    m_buffer.resize(m_writePos + size);
+    return m_buffer.data() + m_writePos;
+}
+
+void KDSoapHttpRequestParser::commitWrite(int written)
+{
+    m_buffer.resize(m_writePos + qMax(0, written));
+}
+
+KDSoapHttpRequestParser::State KDSoapHttpRequestParser::parse()
+{
+    while (m_state == RequestLine || m_state == Headers) {
+        const char *data = m_buffer.constData();
+        const char *newLine = static_cast<const char *>(memchr(data + m_scanPos, '\n', m_buffer.size() - m_scanPos));
+        // Don't let a peer which never ends its line (or its headers) make the buffer grow without bound
+        const int lineEnd = newLine ? int(newLine - data) : m_buffer.size();
+        if (lineEnd - m_pos > s_maxHeaderLineLength || lineEnd > s_maxHeaderSize) {
+            qDebug() << "HTTP request headers too large";
+            m_headersTooLarge = true;
+            m_state = Error;
+            return m_state;
+        }
+        if (!newLine) {
+            m_scanPos = m_buffer.size();
+            return m_state; // incomplete line, wait for more data
+        }
+        const char *line = data + m_pos;
+        int length = lineEnd - m_pos;
+        if (length > 0 && line[length - 1] == '\r') {
+            --length;
+        }
+        m_pos = lineEnd + 1;
+        m_scanPos = m_pos;
+
+        if (m_state == RequestLine) {
+            if (length == 0) {
+                continue; // RFC 7230 section 3.5: ignore empty lines before the request line
+            }
+            if (!parseRequestLine(line, length)) {
+                m_state = Error;
+                return m_state;
+            }
+            m_state = Headers;
+        } else if (length == 0) { // end of headers
+            startBody();
+        } else {
+            parseHeaderLine(line, length, m_headers);
+        }
+    }
+
+    if (m_state == Body) {
+        if (m_buffer.size() - m_bodyStart >= m_remainingBodySize) {
+            m_state = Complete;
+        }
+    } else if (m_state == ChunkedBody) {
+        parseChunks();
+    }
+    return m_state;
+}
+
+bool KDSoapHttpRequestParser::parseRequestLine(const char *line, int length)
+{
+    // request-line = method SP request-target SP HTTP-version
+    const char *end = line + length;
+    const char *firstSpace = static_cast<const char *>(memchr(line, ' ', length));
+    const char *lastSpace = end;
+    while (lastSpace > line && *(lastSpace - 1) != ' ') {
+        --lastSpace;
+    }
+    --lastSpace;
+    if (!firstSpace || lastSpace <= firstSpace) {
+        qDebug() << "Malformed HTTP request:" << QByteArray(line, length);
+        return false;
+    }
+
+    // Grammar from https://datatracker.ietf.org/doc/html/rfc7230#section-5.3.1
+    //  origin-form    = absolute-path [ "?" query ]
+    // and https://datatracker.ietf.org/doc/html/rfc3986#section-3.3
+    // says the path ends at the first '?' or '#' character
+    const char *target = firstSpace + 1;
+    const int targetLength = lastSpace - target;
+    const char *query = static_cast<const char *>(memchr(target, '?', targetLength));
+    const QByteArray cleanedPath = cleanPath(target, query ? int(query - target) : targetLength);
+    m_headers.setRequestLine(line, int(firstSpace - line), cleanedPath, query, query ? int(lastSpace - query) : 0, lastSpace + 1, int(end - lastSpace - 1));
+    return true;
+}
+
+static bool isSeparator(char c)
+{
+#ifdef Q_OS_WIN
+    return c == '/' || c == '\\'; // like QDir::fromNativeSeparators
+#else
+    return c == '/';
+#endif
+}
+
+// Whether the last segment of \p path, starting at \p start (with its leading '/', if any), is ".."
+static bool isDotDotSegment(const QByteArray &path, int start)
+{
+    if (path.at(start) == '/') {
+        ++start;
+    }
+    return path.size() - start == 2 && path.endsWith("..");
+}
+
+// Same result as QDir::cleanPath, without going through QString:
+// removes duplicate separators, "." segments and trailing separators, and resolves ".." where possible.
+// Leading ".." segments are kept, so that callers can reject paths going above the root.
+QByteArray KDSoapHttpRequestParser::cleanPath(const char *path, int length)
+{
+    const char *end = path + length;
+    const bool absolute = length > 0 && isSeparator(*path);
+    QByteArray result;
+    result.reserve(length + 1);
+    // Where each segment of the result starts, including its leading '/', for ".." to remove it
+    QVarLengthArray<int, 32> segmentStarts;
+    const char *segment = path;
+    while (segment < end) {
+        const char *segmentEnd = segment;
+        while (segmentEnd < end && !isSeparator(*segmentEnd)) {
+            ++segmentEnd;
+        }
+        const int segmentLength = int(segmentEnd - segment);
+        const bool dot = segmentLength == 1 && segment[0] == '.';
+        const bool dotDot = segmentLength == 2 && segment[0] == '.' && segment[1] == '.';
+        if (segmentLength == 0 || dot) {
+            // nothing to add
+        } else if (dotDot && !segmentStarts.isEmpty() && !isDotDotSegment(result, segmentStarts.last())) {
+            result.truncate(segmentStarts.last());
+            segmentStarts.removeLast();
+        } else {
+            segmentStarts.append(result.size());
+            if (absolute || !result.isEmpty()) {
+                result += '/';
+            }
+            result.append(segment, segmentLength);
+        }
+        segment = segmentEnd + 1;
+    }
+    if (result.isEmpty()) {
+        if (absolute) {
+            result = "/";
+        } else if (length > 0) {
+            result = ".";
+        }
+    }
+    return result;
+}
+
+void KDSoapHttpRequestParser::parseHeaderLine(const char *line, int length, KDSoapHttpHeaders &fields)
+{
+    const char *colon = static_cast<const char *>(memchr(line, ':', length));
+    if (!colon) {
+        qDebug() << "Malformed HTTP header:" << QByteArray(line, length);
+        return;
+    }
+    // remove spaces around the value
+    const char *value = colon + 1;
+    const char *end = line + length;
+    while (value < end && isSpace(*value)) {
+        ++value;
+    }
+    while (end > value && isSpace(*(end - 1))) {
+        --end;
+    }
+    fields.append(line, int(colon - line), value, int(end - value));
+}
+
+void KDSoapHttpRequestParser::startBody()
+{
+    m_bodyStart = m_pos;
+    if (m_headers.value(KDSoapHttpHeaders::TransferEncoding) == "chunked") {
+        m_chunked = true;
+        m_chunkState = ChunkSizeLine;
+        m_decodedEnd = m_bodyStart;
+        m_state = ChunkedBody;
+        return;
+    }
+    m_remainingBodySize = qMax(0LL, m_headers.value(KDSoapHttpHeaders::ContentLength).toLongLong());
+    m_state = Body;
+}
+
+void KDSoapHttpRequestParser::parseChunks()
+{
+    char *data = m_buffer.data();
+    const int size = m_buffer.size();
+    while (m_state == ChunkedBody) {
+        if (m_chunkState == ChunkData) {
+            const int available = int(qMin<qint64>(m_chunkRemaining, size - m_pos));
+            if (available == 0) {
+                break;
+            }
+            if (m_decodedEnd != m_pos) {
+                memmove(data + m_decodedEnd, data + m_pos, available);
+            }
+            m_decodedEnd += available;
+            m_pos += available;
+            m_scanPos = m_pos;
+            m_chunkRemaining -= available;
+            if (m_chunkRemaining == 0) {
+                m_chunkState = ChunkDataEnd;
+            }
+            continue;
+        }
+
+        // All other parts of the chunked encoding are lines
+        const char *newLine = static_cast<const char *>(memchr(data + m_scanPos, '\n', size - m_scanPos));
+        if (!newLine) {
+            m_scanPos = size;
+            if (size - m_pos > s_maxChunkLineLength) {
+                m_state = Error;
+            }
+            break;
+        }
+        const int lineEnd = newLine - data;
+        const char *line = data + m_pos;
+        int length = lineEnd - m_pos;
+        if (length > 0 && line[length - 1] == '\r') {
+            --length;
+        }
+        m_pos = lineEnd + 1;
+        m_scanPos = m_pos;
+
+        switch (m_chunkState) {
+        case ChunkSizeLine:
+            if (!parseChunkSize(line, length)) {
+                m_state = Error;
+            }
+            break;
+        case ChunkDataEnd:
+            // The chunk data must be followed by CRLF
+            if (length != 0) {
+                m_state = Error;
+            }
+            m_chunkState = ChunkSizeLine;
+            break;
+        case Trailers:
+            if (length == 0) {
+                m_state = Complete;
+            } else {
+                parseHeaderLine(line, length, m_trailers);
+            }
+            break;
+        case ChunkData:
+            Q_UNREACHABLE();
+            break;
+        }
+    }
+
+    // Drop the chunk framing parsed so far, it's never looked at again.
+    // Since chunk data is consumed as soon as it arrives, only a partial line (or the next request) is moved here.
+    const int parsed = m_pos - m_decodedEnd;
+    if (parsed > 0) {
+        m_buffer.remove(m_decodedEnd, parsed);
+        m_pos -= parsed;
+        m_scanPos -= parsed;
+    }
+}
+
+bool KDSoapHttpRequestParser::parseChunkSize(const char *line, int length)
+{
+    // chunk = chunk-size [ chunk-ext ] CRLF, with chunk-ext = *( ";" chunk-ext-name [ "=" chunk-ext-val ] )
+    // We don't know any extension, so they are ignored, as required by RFC 7230 section 4.1.1
+    const char *extensions = static_cast<const char *>(memchr(line, ';', length));
+    if (extensions) {
+        length = extensions - line;
+    }
+    while (length > 0 && isSpace(line[length - 1])) {
+        --length;
+    }
+    if (length == 0 || length > 8) { // more than 4 GB in a single chunk? Certainly not for SOAP.
+        return false;
+    }
+    qint64 chunkSize = 0;
+    for (int i = 0; i < length; ++i) {
+        const int value = hexValue(line[i]);
+        if (value < 0) {
+            return false;
+        }
+        chunkSize = chunkSize * 16 + value;
+    }
+    if (chunkSize == 0) { // last chunk, trailers follow
+        m_chunkState = Trailers;
+        return true;
+    }
+    if (chunkSize > std::numeric_limits<int>::max() - m_decodedEnd) {
+        return false;
+    }
+    m_chunkRemaining = chunkSize;
+    m_chunkState = ChunkData;
+    return true;
+}
+
+QByteArray KDSoapHttpRequestParser::body() const
+{
+    if (m_chunked) {
+        return QByteArray::fromRawData(m_buffer.constData() + m_bodyStart, m_decodedEnd - m_bodyStart);
+    }
+    if (m_state != Body && m_state != Complete) {
+        return QByteArray();
+    }
+    const int size = int(qMin<qint64>(m_buffer.size() - m_bodyStart, m_remainingBodySize));
+    return QByteArray::fromRawData(m_buffer.constData() + m_bodyStart, size);
+}
+
+void KDSoapHttpRequestParser::consumeBody()
+{
+    if (m_chunked) {
+        const int size = m_decodedEnd - m_bodyStart;
+        m_buffer.remove(m_bodyStart, size);
+        m_decodedEnd = m_bodyStart;
+        m_pos -= size;
+        m_scanPos -= size;
+        return;
+    }
+    if (m_state != Body && m_state != Complete) {
+        return;
+    }
+    const int size = int(qMin<qint64>(m_buffer.size() - m_bodyStart, m_remainingBodySize));
+    m_buffer.remove(m_bodyStart, size);
+    m_remainingBodySize -= size;
+}
+
+qint64 KDSoapHttpRequestParser::remainingBodySize() const
+{
+    switch (m_state) {
+    case Body:
+        return qMax<qint64>(0, m_remainingBodySize - (m_buffer.size() - m_bodyStart));
+    case ChunkedBody:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+void KDSoapHttpRequestParser::reset()
+{
+    if (m_state == Complete) {
+        // Keep the beginning of the next request, if the client sent it already
+        const int requestEnd = m_chunked ? m_pos : int(m_bodyStart + m_remainingBodySize);
+        m_buffer.remove(0, requestEnd);
+    } else {
+        m_buffer.clear();
+    }
+    m_state = RequestLine;
+    m_writePos = 0;
+    m_pos = 0;
+    m_scanPos = 0;
+    m_headers.clear();
+    m_bodyStart = 0;
+    m_remainingBodySize = 0;
+    m_chunked = false;
+    m_chunkState = ChunkSizeLine;
+    m_decodedEnd = 0;
+    m_chunkRemaining = 0;
+    m_trailers.clear();
+    m_headersTooLarge = false;
+}
+
+// RFC 7231 section 7.1.1.1
+static const char s_httpDateFormat[] = "ddd, dd MMM yyyy hh:mm:ss 'GMT'";
+
+QByteArray KDSoapHttpRequestParser::toHttpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), QLatin1String(s_httpDateFormat)).toLatin1();
+}
+
+qint64 KDSoapHttpRequestParser::parseHttpDate(const QByteArray &httpDate)
+{
+    const QDateTime dateTime = QLocale::c().toDateTime(QString::fromLatin1(httpDate), QLatin1String(s_httpDateFormat));
+    if (!dateTime.isValid()) {
+        return -1;
+    }
+    // The date and time are in UTC
+    return QDate(1970, 1, 1).daysTo(dateTime.date()) * 86400 + QTime(0, 0).secsTo(dateTime.time());
+}
@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPHTTPREQUESTPARSER_P_H
+#define KDSOAPHTTPREQUESTPARSER_P_H
+
+#include "KDSoapHttpHeaders_p.h"
+#include <QByteArray>
+
+QT_BEGIN_NAMESPACE
+class QDateTime;
+QT_END_NAMESPACE
+
+/**
+ * Incremental HTTP/1.1 request parser, used by KDSoapServerSocket.
+ *
+ * The socket reads straight into the parser's buffer (prepareWrite/commitWrite),
+ * then parse() advances as far as the received data allows, without ever rescanning
+ * what was already parsed. The request line and the headers are parsed in place,
+ * and the body is handed over as a view on the buffer, not as a copy.
+ */
+class KDSoapHttpRequestParser
+{
+public:
+    enum State
+    {
+        RequestLine,
+        Headers,
+        Body, // reading a body with a Content-Length
+        ChunkedBody, // reading a body with Transfer-Encoding: chunked
+        Complete,
+        Error
+    };
+
+    KDSoapHttpRequestParser();
+
+    // Returns a pointer to \p size bytes at the end of the buffer, for the socket to read into.
+    char *prepareWrite(int size);
+    // Call after prepareWrite(), with the number of bytes actually written.
+    void commitWrite(int written);
+
+    // Parses as much as possible of the data received so far, and returns the new state.
+    State parse();
+    State state() const
+    {
+        return m_state;
+    }
+    // In the Error state: whether the request line or the headers exceeded the size limits (431), rather than being malformed (400)
+    bool headersTooLarge() const
+    {
+        return m_headersTooLarge;
+    }
+
+    // The request line and the HTTP headers. Available once the state is Body, ChunkedBody or Complete.
+    const KDSoapHttpHeaders &headers() const
+    {
+        return m_headers;
+    }
+    // The trailer fields sent after a chunked body. Available once the state is Complete.
+    const KDSoapHttpHeaders &trailers() const
+    {
+        return m_trailers;
+    }
+
+    // The (decoded) body received so far and not consumed yet. Once the state is Complete, this is the full body.
+    // This is a view on the parser's buffer: it's only valid until the next call to prepareWrite(), consumeBody() or reset().
+    QByteArray body() const;
+    // Discards body(), for callers which process the body while it's being received.
+    void consumeBody();
+    // The number of bytes of the body which weren't received yet, or -1 for a chunked body, whose size isn't known in advance.
+    qint64 remainingBodySize() const;
+
+    // Gets ready for the next request. Data received after the end of a complete request
+    // (i.e. pipelined requests) is kept, call parse() to parse it.
+    void reset();
+    // Returns true if some data was received and not consumed yet
+    bool hasData() const
+    {
+        return !m_buffer.isEmpty();
+    }
+
+    // Normalizes the path of a request, see the .cpp file
+    static QByteArray cleanPath(const char *path, int length);
+
+    // Formats \p dateTime as an HTTP date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    static QByteArray toHttpDate(const QDateTime &dateTime);
+    // Returns the number of seconds since the epoch, or -1 if \p httpDate can't be parsed
+    static qint64 parseHttpDate(const QByteArray &httpDate);
+
+private:
+    enum ChunkState
+    {
+        ChunkSizeLine,
+        ChunkData,
+        ChunkDataEnd,
+        Trailers
+    };
+
+    bool parseRequestLine(const char *line, int length);
+    static void parseHeaderLine(const char *line, int length, KDSoapHttpHeaders &fields);
+    void startBody();
+    void parseChunks();
+    bool parseChunkSize(const char *line, int length);
+
+    State m_state;
+    QByteArray m_buffer;
+    int m_writePos; // set by prepareWrite
+    int m_pos; // start of the data which wasn't parsed yet
+    int m_scanPos; // where to resume looking for the end of the current line
+    KDSoapHttpHeaders m_headers;
+
+    int m_bodyStart;
+    qint64 m_remainingBodySize; // Content-Length body, not consumed yet
+
+    // Chunked bodies are decoded in place: the data of each chunk is moved down to m_decodedEnd,
+    // and the chunk framing is dropped from the buffer, so the buffer only ever holds
+    // [headers][decoded body][data not parsed yet, at m_pos]
+    bool m_chunked;
+    ChunkState m_chunkState;
+    int m_decodedEnd;
+    qint64 m_chunkRemaining;
+    KDSoapHttpHeaders m_trailers;
+    bool m_headersTooLarge;
+};
+
+#endif // KDSOAPHTTPREQUESTPARSER_P_H
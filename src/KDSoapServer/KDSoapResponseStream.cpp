@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapResponseStream.h"
+#include "KDSoapServerSocket_p.h"
+#include <KDSoapClient/KDSoapMessageWriter_p.h>
+
+class KDSoapResponseStream::Private
+{
+public:
+    Private(KDSoapServerSocket *socket, KDSoapStreamedMessageWriter *writer)
+        : m_socket(socket)
+        , m_writer(writer)
+        , m_finished(false)
+        , m_aborted(false)
+    {
+    }
+    ~Private()
+    {
+        delete m_writer;
+    }
+
+    KDSoapServerSocket *m_socket; // our parent
+    KDSoapStreamedMessageWriter *m_writer;
+    bool m_finished;
+    bool m_aborted;
+};
+
+KDSoapResponseStream::KDSoapResponseStream(KDSoapServerSocket *socket, KDSoapStreamedMessageWriter *writer)
+    : QObject(socket)
+    , d(new Private(socket, writer))
+{
+    connect(socket, &QIODevice::bytesWritten, this, [this]() {
+        if (!d->m_finished && !d->m_aborted && d->m_socket->isOutputDrained()) {
+            emit readyForMoreData();
+        }
+    });
+    connect(socket, &QAbstractSocket::disconnected, this, [this]() {
+        if (!d->m_finished) {
+            d->m_aborted = true;
+            emit aborted();
+        }
+    });
+}
+
+KDSoapResponseStream::~KDSoapResponseStream()
+{
+    delete d;
+}
+
+bool KDSoapResponseStream::writeValue(const KDSoapValue &value)
+{
+    if (d->m_finished || d->m_aborted) {
+        return false;
+    }
+    d->m_socket->writeResponseChunk(d->m_writer->writeValue(value));
+    return true;
+}
+
+bool KDSoapResponseStream::canWriteMore() const
+{
+    return !d->m_finished && !d->m_aborted && d->m_socket->canWriteMore();
+}
+
+bool KDSoapResponseStream::isAborted() const
+{
+    return d->m_aborted;
+}
+
+void KDSoapResponseStream::finish()
+{
+    if (d->m_finished) {
+        return;
+    }
+    d->m_finished = true;
+    if (!d->m_aborted) {
+        d->m_socket->writeResponseChunk(d->m_writer->finish());
+        d->m_socket->endStreamedResponse();
+    }
+    deleteLater();
+}
+
+#include "moc_KDSoapResponseStream.cpp"
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPRESPONSESTREAM_H
+#define KDSOAPRESPONSESTREAM_H
+
+#include "KDSoapServerGlobal.h"
+#include <QtCore/QObject>
+
+class KDSoapServerSocket;
+class KDSoapStreamedMessageWriter;
+class KDSoapValue;
+
+/**
+ * Sends the response to a SOAP call piece by piece, while it's being produced,
+ * rather than building the whole response message in memory first.
+ *
+ * Call KDSoapServerObjectInterface::startStreamedResponse() from processRequest() to get a stream,
+ * then write the child elements of the response element with writeValue(), and call finish() at the end.
+ * The response is sent with "Transfer-Encoding: chunked", each writeValue() being sent right away.
+ *
+ * This can be done within processRequest(), or later on from the event loop, like a delayed response.
+ * In order not to buffer the whole response in memory when the client reads it slower than it's produced,
+ * stop writing when canWriteMore() returns false, and resume when readyForMoreData() is emitted:
+ *
+ * \code
+ *   void MyServerObject::produceMore()
+ *   {
+ *       while (m_stream && m_stream->canWriteMore() && hasMoreRows()) {
+ *           m_stream->writeValue(nextRow());
+ *       }
+ *       if (m_stream && !hasMoreRows()) {
+ *           m_stream->finish();
+ *       }
+ *   }
+ * \endcode
+ *
+ * The stream is deleted after finish(), or when the client disconnects, so store it in a QPointer.
+ *
+ * Note that the HTTP status is sent when the stream is created, so it's not possible to send a fault anymore afterwards.
+ * \since 2.3
+ */
+class KDSOAPSERVER_EXPORT KDSoapResponseStream : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * Destructor. Deleting a stream which wasn't finished leaves the client waiting for the rest of the response.
+     */
+    ~KDSoapResponseStream();
+
+    /**
+     * Writes one child element of the response element, and sends it to the client.
+     * \return false if the client disconnected, or if finish() was called already.
+     */
+    bool writeValue(const KDSoapValue &value);
+
+    /**
+     * Returns true while the amount of data waiting to be sent to the client is below the high watermark.
+     * When this returns false, wait for readyForMoreData() before writing more.
+     */
+    bool canWriteMore() const;
+
+    /**
+     * Returns true if the client disconnected before the end of the response.
+     */
+    bool isAborted() const;
+
+    /**
+     * Ends the response, and gets the connection ready for the next request.
+     * The stream deletes itself afterwards.
+     */
+    void finish();
+
+Q_SIGNALS:
+    /**
+     * Emitted when data was sent to the client, and the amount of data still waiting
+     * to be sent dropped below the low watermark.
+     */
+    void readyForMoreData();
+
+    /**
+     * Emitted when the client disconnects before the end of the response.
+     */
+    void aborted();
+
+private:
+    friend class KDSoapServerSocket;
+    KDSoapResponseStream(KDSoapServerSocket *socket, KDSoapStreamedMessageWriter *writer);
+    class Private;
+    Private *const d;
+};
+
+#endif // KDSOAPRESPONSESTREAM_H
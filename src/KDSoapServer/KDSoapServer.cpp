@@ -8,10 +8,17 @@
 **
 ****************************************************************************/
 #include "KDSoapServer.h"
+#include "KDSoapServerAcceptor_p.h"
+#include "KDSoapServerRoutes_p.h"
 #include "KDSoapSocketList_p.h"
 #include "KDSoapThreadPool.h"
+#include "KDSoapWsdlCache_p.h"
+#include <QAtomicPointer>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QMutex>
+#include <QSet>
+#include <QVector>
 #ifdef Q_OS_UNIX
 #include <errno.h>
 #include <limits.h>
@@ -19,16 +26,50 @@
 #include <sys/time.h>
 #endif
 
+// The settings read by the sockets while handling requests.
+// They are never modified: setters publish a modified copy, so that readers, in any thread, don't need the server's mutexes.
+struct KDSoapServerConfig
+{
+    KDSoapServerConfig()
+    {
+        routes.setSoapPath(path);
+    }
+
+    KDSoapMessage::Use use = KDSoapMessage::LiteralUse;
+    KDSoapServer::Features features;
+    KDSoapServer::LogLevel logLevel = KDSoapServer::LogNothing;
+    QString path = QString::fromLatin1("/");
+    KDSoapServerRoutes routes; // path, and the WSDL file's path
+    int maxConnections = -1;
+    int keepAliveTimeout = 0;
+    int maxRequestsPerConnection = 0;
+    int serverObjectPoolSize = 0;
+    int maxInFlightRequests = 0;
+    int maxQueuedRequests = 0;
+    KDSoapServer::OverloadResponse overloadResponse = KDSoapServer::ServiceUnavailable;
+    int retryAfter = 1;
+    QStringList priorityPaths;
+    QSet<QByteArray> priorityPathSet; // as sent by the clients, i.e. UTF-8
+    QList<QByteArray> prioritySoapActions;
+    QSet<QByteArray> prioritySoapActionSet;
+    int drainTimeout = 0;
+    qint64 writeLowWatermark = 64 * 1024;
+    qint64 writeHighWatermark = 256 * 1024;
+    QThreadPool *processingThreadPool = nullptr;
+#ifndef QT_NO_SSL
+    QSslConfiguration sslConfiguration;
+#endif
+};
+
 class KDSoapServer::Private
 {
 public:
     Private()
         : m_threadPool(nullptr)
         , m_mainThreadSocketList(nullptr)
-        , m_use(KDSoapMessage::LiteralUse)
-        , m_logLevel(KDSoapServer::LogNothing)
-        , m_path(QString::fromLatin1("/"))
-        , m_maxConnections(-1)
+        , m_config(new KDSoapServerConfig)
+        , m_wsdlCache(nullptr)
+        , m_listenInThreads(false)
         , m_portBeforeSuspend(0)
     {
     }
@@ -36,30 +77,73 @@ public:
     ~Private()
     {
         delete m_mainThreadSocketList;
+        delete m_config.loadAcquire();
+        for (const RetiredConfig &retired : std::as_const(m_retiredConfigs)) {
+            delete retired.config;
+        }
+    }
+
+    // A single acquire load, the snapshot is never modified. Readers only use it during the current call:
+    // they don't keep the pointer, which stays valid for at least s_configGracePeriod after being replaced.
+    const KDSoapServerConfig *config() const
+    {
+        return m_config.loadAcquire();
+    }
+
+    // Publishes a copy of the configuration, modified by \p update.
+    // Other threads may still be reading the previous version, so it's only deleted after a grace period.
+    template<typename Update>
+    void updateConfig(Update update)
+    {
+        QMutexLocker lock(&m_configMutex);
+        const KDSoapServerConfig *current = m_config.loadAcquire();
+        KDSoapServerConfig *updated = new KDSoapServerConfig(*current);
+        update(*updated);
+        m_config.storeRelease(updated);
+        deleteRetiredConfigs();
+        m_retiredConfigs.append(RetiredConfig{current, QElapsedTimer()});
+        m_retiredConfigs.last().retiredSince.start();
+    }
+
+    // Deletes the snapshots replaced more than s_configGracePeriod ago (oldest first in m_retiredConfigs)
+    void deleteRetiredConfigs()
+    {
+        while (!m_retiredConfigs.isEmpty() && m_retiredConfigs.first().retiredSince.hasExpired(s_configGracePeriod)) {
+            delete m_retiredConfigs.takeFirst().config;
+        }
     }
 
     KDSoapThreadPool *m_threadPool;
     KDSoapSocketList *m_mainThreadSocketList;
-    KDSoapMessage::Use m_use;
-    KDSoapServer::Features m_features;
+
+    static const int s_configGracePeriod = 10000; // msecs, much longer than any read of a snapshot
+    struct RetiredConfig
+    {
+        const KDSoapServerConfig *config;
+        QElapsedTimer retiredSince;
+    };
+    QMutex m_configMutex; // serializes the setters, protects m_retiredConfigs
+    QAtomicPointer<const KDSoapServerConfig> m_config;
+    QVector<RetiredConfig> m_retiredConfigs;
 
     QMutex m_logMutex;
-    KDSoapServer::LogLevel m_logLevel;
     QString m_logFileName;
     QFile m_logFile;
 
-    QMutex m_serverDataMutex;
-    QString m_wsdlFile;
-    QString m_wsdlPathInUrl;
-    QString m_path;
-    int m_maxConnections;
+    KDSoapWsdlCache *m_wsdlCache; // has its own mutex
+
+    // Connections accepted and not closed yet, in all threads, for maxConnections
+    QAtomicInt m_connectionCount;
+    // Set by suspend() until drained() is emitted, by the thread which closes the last connection
+    QAtomicInt m_drainPending;
+    // Requests admitted and not answered yet, for maxInFlightRequests
+    QAtomicInt m_requestsInFlight;
+    // Calls waiting for a thread of the processing pool, for maxQueuedRequests
+    QAtomicInt m_queuedRequests;
+    bool m_listenInThreads; // see listenInThreads
 
     QHostAddress m_addressBeforeSuspend;
     quint16 m_portBeforeSuspend;
-
-#ifndef QT_NO_SSL
-    QSslConfiguration m_sslConfiguration;
-#endif
 };
 
 KDSoapServer::KDSoapServer(QObject *parent)
@@ -68,20 +152,89 @@ KDSoapServer::KDSoapServer(QObject *parent)
 {
     // Probably not very useful since we handle them immediately, but cannot hurt.
     setMaxPendingConnections(1000);
+    d->m_wsdlCache = new KDSoapWsdlCache(this);
 }
 
 KDSoapServer::~KDSoapServer()
 {
+    // The sockets, and the calls they started in the processing thread pool, refer to the server:
+    // delete them now, the thread pool can outlive the server. No drained() signal while doing so.
+    d->m_drainPending.storeRelaxed(0);
+    if (d->m_threadPool) {
+        d->m_threadPool->removeServer(this);
+    } else if (d->m_mainThreadSocketList) {
+        d->m_mainThreadSocketList->deleteAll();
+    }
     delete d;
 }
 
-void KDSoapServer::incomingConnection(qintptr socketDescriptor)
+// Called by the thread which accepted the connection: the server's, or a thread pool's with listenInThreads
+bool KDSoapServer::admitConnection()
 {
     const int max = maxConnections();
-    const int numSockets = numConnectedSockets();
+    const int numSockets = d->m_connectionCount.fetchAndAddOrdered(1);
     if (max > -1 && numSockets >= max) {
+        d->m_connectionCount.deref();
         emit connectionRejected();
         log(QByteArray("ERROR Too many connections (") + QByteArray::number(numSockets) + "), incoming connection rejected\n");
+        return false;
+    }
+    return true;
+}
+
+// Called by KDSoapSocketList when an admitted connection's socket is deleted
+void KDSoapServer::connectionClosed()
+{
+    if (!d->m_connectionCount.deref() && d->m_drainPending.testAndSetOrdered(1, 0)) {
+        emit drained();
+    }
+}
+
+// Called by KDSoapServerSocket once the headers of a request are received. If this returns true, requestDone() must be called later.
+bool KDSoapServer::admitRequest(const QByteArray &path, const QByteArray &soapAction)
+{
+    const KDSoapServerConfig *config = d->config();
+    const int inFlight = d->m_requestsInFlight.fetchAndAddOrdered(1);
+    if (config->priorityPathSet.contains(path) || (!soapAction.isEmpty() && config->prioritySoapActionSet.contains(soapAction))) {
+        return true;
+    }
+    QByteArray error;
+    if (config->maxInFlightRequests > 0 && inFlight >= config->maxInFlightRequests) {
+        error = "ERROR Too many requests in flight (" + QByteArray::number(inFlight) + "), request rejected\n";
+    } else if (config->maxQueuedRequests > 0 && config->processingThreadPool) {
+        const int queued = d->m_queuedRequests.loadAcquire();
+        if (queued >= config->maxQueuedRequests) {
+            error = "ERROR Too many queued requests (" + QByteArray::number(queued) + "), request rejected\n";
+        }
+    }
+    if (error.isEmpty()) {
+        return true;
+    }
+    d->m_requestsInFlight.deref();
+    emit requestRejected();
+    log(error);
+    return false;
+}
+
+void KDSoapServer::requestDone()
+{
+    d->m_requestsInFlight.deref();
+}
+
+void KDSoapServer::requestQueued()
+{
+    d->m_queuedRequests.ref();
+}
+
+void KDSoapServer::requestDequeued()
+{
+    d->m_queuedRequests.deref();
+}
+
+void KDSoapServer::incomingConnection(qintptr socketDescriptor)
+{
+    if (!admitConnection()) {
+        return;
     } else if (d->m_threadPool) {
         // qDebug() << "incomingConnection: using thread pool";
         d->m_threadPool->handleIncomingConnection(socketDescriptor, this);
@@ -135,40 +288,54 @@ KDSoapThreadPool *KDSoapServer::threadPool() const
     return d->m_threadPool;
 }
 
+void KDSoapServer::setProcessingThreadPool(QThreadPool *pool)
+{
+    d->updateConfig([pool](KDSoapServerConfig &config) {
+        config.processingThreadPool = pool;
+    });
+}
+
+QThreadPool *KDSoapServer::processingThreadPool() const
+{
+    return d->config()->processingThreadPool;
+}
+
 QString KDSoapServer::endPoint() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
+    const KDSoapServerConfig *config = d->config();
     const QHostAddress address = serverAddress();
     if (address == QHostAddress::Null) {
         return QString();
     }
     const QString addressStr = address == QHostAddress::Any ? QString::fromLatin1("127.0.0.1") : address.toString();
     return QString::fromLatin1("%1://%2:%3%4")
-        .arg(QString::fromLatin1((d->m_features & Ssl) ? "https" : "http"), addressStr)
+        .arg(QString::fromLatin1((config->features & Ssl) ? "https" : "http"), addressStr)
         .arg(serverPort())
-        .arg(d->m_path);
+        .arg(config->path);
 }
 
 void KDSoapServer::setUse(KDSoapMessage::Use use)
 {
-    d->m_use = use;
+    d->updateConfig([use](KDSoapServerConfig &config) {
+        config.use = use;
+    });
 }
 
 KDSoapMessage::Use KDSoapServer::use() const
 {
-    return d->m_use;
+    return d->config()->use;
 }
 
 void KDSoapServer::setLogLevel(KDSoapServer::LogLevel level)
 {
-    QMutexLocker lock(&d->m_logMutex);
-    d->m_logLevel = level;
+    d->updateConfig([level](KDSoapServerConfig &config) {
+        config.logLevel = level;
+    });
 }
 
 KDSoapServer::LogLevel KDSoapServer::logLevel() const
 {
-    QMutexLocker lock(&d->m_logMutex);
-    return d->m_logLevel;
+    return d->config()->logLevel;
 }
 
 void KDSoapServer::setLogFileName(const QString &fileName)
@@ -185,7 +352,7 @@ QString KDSoapServer::logFileName() const
 
 void KDSoapServer::log(const QByteArray &text)
 {
-    if (d->m_logLevel == KDSoapServer::LogNothing) {
+    if (d->config()->logLevel == KDSoapServer::LogNothing) {
         return;
     }
 
@@ -268,26 +435,56 @@ bool KDSoapServer::setExpectedSocketCount(int sockets)
     return true;
 }
 
+bool KDSoapServer::listenInThreads(const QHostAddress &address, quint16 port)
+{
+    if (!d->m_threadPool) {
+        qWarning("KDSoapServer: listenInThreads() requires a thread pool, see setThreadPool()");
+        return false;
+    }
+    if (!KDSoapServerAcceptor::listenReusePort(this, address, port)) {
+        return false;
+    }
+    // With port 0, the threads listen on the port picked for the server
+    if (!d->m_threadPool->startAcceptors(this, address, serverPort())) {
+        d->m_threadPool->stopAcceptors(this);
+        close();
+        return false;
+    }
+    d->m_listenInThreads = true;
+    return true;
+}
+
 void KDSoapServer::suspend()
 {
     d->m_portBeforeSuspend = serverPort();
     d->m_addressBeforeSuspend = serverAddress();
     close();
+    if (d->m_listenInThreads && d->m_threadPool) {
+        d->m_threadPool->stopAcceptors(this);
+    }
 
     // Disconnect connected sockets, otherwise they could still make calls
+    d->m_drainPending.storeRelease(1);
+    const int drainTimeout = this->drainTimeout();
     if (d->m_threadPool) {
-        d->m_threadPool->disconnectSockets(this);
+        d->m_threadPool->drainSockets(this, drainTimeout);
     } else if (d->m_mainThreadSocketList) {
-        d->m_mainThreadSocketList->disconnectAll();
+        d->m_mainThreadSocketList->disconnectAll(drainTimeout);
+    }
+    if (d->m_connectionCount.loadAcquire() == 0 && d->m_drainPending.testAndSetOrdered(1, 0)) {
+        QMetaObject::invokeMethod(this, "drained", Qt::QueuedConnection);
     }
 }
 
 void KDSoapServer::resume()
 {
+    d->m_drainPending.storeRelease(0);
     if (d->m_portBeforeSuspend == 0) {
         qWarning("KDSoapServer: resume() called without calling suspend() first");
     } else {
-        if (!listen(d->m_addressBeforeSuspend, d->m_portBeforeSuspend)) {
+        const bool listening = d->m_listenInThreads ? listenInThreads(d->m_addressBeforeSuspend, d->m_portBeforeSuspend)
+                                                    : listen(d->m_addressBeforeSuspend, d->m_portBeforeSuspend);
+        if (!listening) {
             qWarning("KDSoapServer: failed to listen on %s port %d", qPrintable(d->m_addressBeforeSuspend.toString()), d->m_portBeforeSuspend);
         }
         d->m_portBeforeSuspend = 0;
@@ -296,68 +493,229 @@ void KDSoapServer::resume()
 
 void KDSoapServer::setWsdlFile(const QString &file, const QString &pathInUrl)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_wsdlFile = file;
-    d->m_wsdlPathInUrl = pathInUrl;
+    d->m_wsdlCache->setFile(file, pathInUrl);
+    d->updateConfig([&pathInUrl](KDSoapServerConfig &config) {
+        config.routes.setWsdlPath(pathInUrl);
+    });
 }
 
 QString KDSoapServer::wsdlFile() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_wsdlFile;
+    return d->m_wsdlCache->file();
 }
 
 QString KDSoapServer::wsdlPathInUrl() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_wsdlPathInUrl;
+    return d->m_wsdlCache->pathInUrl();
+}
+
+KDSoapWsdlCache *KDSoapServer::wsdlCache() const
+{
+    return d->m_wsdlCache;
+}
+
+KDSoapServerRoutes KDSoapServer::routes() const
+{
+    // A copy, since the snapshot can be replaced meanwhile. The hash it contains is implicitly shared.
+    return d->config()->routes;
 }
 
 void KDSoapServer::setPath(const QString &path)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_path = path;
+    d->updateConfig([&path](KDSoapServerConfig &config) {
+        config.path = path;
+        config.routes.setSoapPath(path);
+    });
 }
 
 QString KDSoapServer::path() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_path;
+    return d->config()->path;
 }
 
 void KDSoapServer::setMaxConnections(int sockets)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_maxConnections = sockets;
+    d->updateConfig([sockets](KDSoapServerConfig &config) {
+        config.maxConnections = sockets;
+    });
 }
 
 int KDSoapServer::maxConnections() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_maxConnections;
+    return d->config()->maxConnections;
+}
+
+void KDSoapServer::setKeepAliveTimeout(int msecs)
+{
+    d->updateConfig([msecs](KDSoapServerConfig &config) {
+        config.keepAliveTimeout = msecs;
+    });
+}
+
+int KDSoapServer::keepAliveTimeout() const
+{
+    return d->config()->keepAliveTimeout;
+}
+
+void KDSoapServer::setMaxRequestsPerConnection(int requests)
+{
+    d->updateConfig([requests](KDSoapServerConfig &config) {
+        config.maxRequestsPerConnection = requests;
+    });
+}
+
+int KDSoapServer::maxRequestsPerConnection() const
+{
+    return d->config()->maxRequestsPerConnection;
+}
+
+void KDSoapServer::setServerObjectPoolSize(int size)
+{
+    d->updateConfig([size](KDSoapServerConfig &config) {
+        config.serverObjectPoolSize = qMax(0, size);
+    });
+}
+
+int KDSoapServer::serverObjectPoolSize() const
+{
+    return d->config()->serverObjectPoolSize;
+}
+
+void KDSoapServer::setMaxInFlightRequests(int requests)
+{
+    d->updateConfig([requests](KDSoapServerConfig &config) {
+        config.maxInFlightRequests = qMax(0, requests);
+    });
+}
+
+int KDSoapServer::maxInFlightRequests() const
+{
+    return d->config()->maxInFlightRequests;
+}
+
+void KDSoapServer::setMaxQueuedRequests(int requests)
+{
+    d->updateConfig([requests](KDSoapServerConfig &config) {
+        config.maxQueuedRequests = qMax(0, requests);
+    });
+}
+
+int KDSoapServer::maxQueuedRequests() const
+{
+    return d->config()->maxQueuedRequests;
+}
+
+int KDSoapServer::numInFlightRequests() const
+{
+    return d->m_requestsInFlight.loadAcquire();
+}
+
+void KDSoapServer::setOverloadResponse(OverloadResponse response)
+{
+    d->updateConfig([response](KDSoapServerConfig &config) {
+        config.overloadResponse = response;
+    });
+}
+
+KDSoapServer::OverloadResponse KDSoapServer::overloadResponse() const
+{
+    return d->config()->overloadResponse;
+}
+
+void KDSoapServer::setRetryAfter(int seconds)
+{
+    d->updateConfig([seconds](KDSoapServerConfig &config) {
+        config.retryAfter = qMax(0, seconds);
+    });
+}
+
+int KDSoapServer::retryAfter() const
+{
+    return d->config()->retryAfter;
+}
+
+void KDSoapServer::setPriorityPaths(const QStringList &paths)
+{
+    d->updateConfig([&paths](KDSoapServerConfig &config) {
+        config.priorityPaths = paths;
+        config.priorityPathSet.clear();
+        for (const QString &path : paths) {
+            config.priorityPathSet.insert(path.toUtf8());
+        }
+    });
+}
+
+QStringList KDSoapServer::priorityPaths() const
+{
+    return d->config()->priorityPaths;
+}
+
+void KDSoapServer::setPrioritySoapActions(const QList<QByteArray> &soapActions)
+{
+    d->updateConfig([&soapActions](KDSoapServerConfig &config) {
+        config.prioritySoapActions = soapActions;
+        config.prioritySoapActionSet = QSet<QByteArray>(soapActions.constBegin(), soapActions.constEnd());
+    });
+}
+
+QList<QByteArray> KDSoapServer::prioritySoapActions() const
+{
+    return d->config()->prioritySoapActions;
+}
+
+void KDSoapServer::setDrainTimeout(int msecs)
+{
+    d->updateConfig([msecs](KDSoapServerConfig &config) {
+        config.drainTimeout = qMax(0, msecs);
+    });
+}
+
+int KDSoapServer::drainTimeout() const
+{
+    return d->config()->drainTimeout;
+}
+
+void KDSoapServer::setWriteWatermarks(qint64 lowWatermark, qint64 highWatermark)
+{
+    d->updateConfig([lowWatermark, highWatermark](KDSoapServerConfig &config) {
+        config.writeHighWatermark = qMax<qint64>(1, highWatermark);
+        config.writeLowWatermark = qBound<qint64>(0, lowWatermark, config.writeHighWatermark - 1);
+    });
+}
+
+qint64 KDSoapServer::writeLowWatermark() const
+{
+    return d->config()->writeLowWatermark;
+}
+
+qint64 KDSoapServer::writeHighWatermark() const
+{
+    return d->config()->writeHighWatermark;
 }
 
 void KDSoapServer::setFeatures(Features features)
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    d->m_features = features;
+    d->updateConfig([features](KDSoapServerConfig &config) {
+        config.features = features;
+    });
 }
 
 KDSoapServer::Features KDSoapServer::features() const
 {
-    QMutexLocker lock(&d->m_serverDataMutex);
-    return d->m_features;
+    return d->config()->features;
 }
 
 #ifndef QT_NO_SSL
 QSslConfiguration KDSoapServer::sslConfiguration() const
 {
-    return d->m_sslConfiguration;
+    return d->config()->sslConfiguration;
 }
 
 void KDSoapServer::setSslConfiguration(const QSslConfiguration &config)
 {
-    d->m_sslConfiguration = config;
+    d->updateConfig([&config](KDSoapServerConfig &newConfig) {
+        newConfig.sslConfiguration = config;
+    });
 }
 #endif
 
@@ -12,10 +12,16 @@
 
 #include "KDSoapServerGlobal.h"
 #include <KDSoapClient/KDSoapMessage.h>
+#include <QtCore/QStringList>
 #include <QtNetwork/QSslConfiguration>
 #include <QtNetwork/QTcpServer>
 
+QT_BEGIN_NAMESPACE
+class QThreadPool;
+QT_END_NAMESPACE
 class KDSoapThreadPool;
+class KDSoapServerRoutes;
+class KDSoapWsdlCache;
 
 /**
  * HTTP soap server.
@@ -77,6 +83,53 @@ public:
      */
     KDSoapThreadPool *threadPool() const;
 
+    /**
+     * Sets a pool of threads for processing SOAP calls, separate from the threads which handle the connections.
+     *
+     * By default, the thread which handles a connection (see setThreadPool) also calls
+     * KDSoapServerObjectInterface::processRequest(), so a slow call delays every other
+     * connection handled by that thread, even when other threads are idle.
+     * With a processing pool, the connection's thread only reads and parses the request:
+     * processRequest() (or processRequestWithPath()) is called by the first available thread of \p pool,
+     * and the reply is sent back by the connection's thread.
+     *
+     * The server object is still created, used and deleted by the connection's thread, and only
+     * one call per connection is processed at a time, but processRequest() runs in a different thread:
+     * it must not use timers, or create children of the server object, and
+     * KDSoapServerObjectInterface::startStreamedResponse() isn't available.
+     * A delayed response (KDSoapServerObjectInterface::prepareDelayedResponse()) must be sent from
+     * the connection's thread, e.g. by queuing a call to it.
+     * Raw XML requests (KDSoapServerRawXMLInterface), WSDL and file downloads are still handled by the connection's thread.
+     *
+     * KDSoapServer does not take ownership of the pool. Pass nullptr to process the calls in the connection's thread again.
+     * \since 2.3
+     */
+    void setProcessingThreadPool(QThreadPool *pool);
+
+    /**
+     * Returns the pool set by setProcessingThreadPool, or nullptr.
+     * \since 2.3
+     */
+    QThreadPool *processingThreadPool() const;
+
+    /**
+     * Listens for connections on \p address and \p port, like listen(), and also in each thread of the
+     * thread pool (see setThreadPool), so that the threads accept their connections themselves.
+     *
+     * By default, the server's thread accepts all the connections and forwards each of them to a thread
+     * of the pool, which can become the bottleneck when clients open many short connections (e.g. without keep-alive).
+     * Here, the server and every thread of the pool (which starts all of its maxThreadCount() threads)
+     * have their own listening socket, on the same port thanks to SO_REUSEPORT, and the operating system
+     * spreads the incoming connections between them. The connections accepted by the server's thread
+     * are still forwarded to the pool as usual. maxConnections() applies to all of them together.
+     *
+     * This requires a thread pool, and SO_REUSEPORT (Linux 3.9, the BSDs and macOS).
+     * Returns false if a socket couldn't listen, or if SO_REUSEPORT isn't supported: then use listen() instead.
+     * suspend() and resume() work as usual, close() only closes the server's own socket.
+     * \since 2.3
+     */
+    bool listenInThreads(const QHostAddress &address = QHostAddress::Any, quint16 port = 0);
+
     /**
      * Sets the path that the server expects in client requests.
      * By default the path is '/', but this can be changed here.
@@ -184,6 +237,214 @@ public:
      */
     int maxConnections() const;
 
+    /**
+     * Sets how long a client connection may stay idle, i.e. without sending (the rest of) a request,
+     * before the server closes it. This also applies between two requests on a persistent (keep-alive) connection.
+     *
+     * The default value, 0, means that idle connections are only closed by the client.
+     * \since 2.3
+     */
+    void setKeepAliveTimeout(int msecs);
+
+    /**
+     * Returns the idle timeout set by setKeepAliveTimeout, in milliseconds.
+     * \since 2.3
+     */
+    int keepAliveTimeout() const;
+
+    /**
+     * Sets the maximum number of requests handled on a single connection.
+     * The response to the last request says "Connection: close", and the server closes the connection after sending it.
+     *
+     * The default value, 0, means unlimited.
+     * \since 2.3
+     */
+    void setMaxRequestsPerConnection(int requests);
+
+    /**
+     * Returns the maximum number of requests per connection, as set by setMaxRequestsPerConnection.
+     * \since 2.3
+     */
+    int maxRequestsPerConnection() const;
+
+    /**
+     * Makes the server reuse server objects from one request to the next, instead of calling
+     * createServerObject() for each connection and deleting the object with the connection.
+     * This helps when creating a server object is expensive (loading configuration, opening
+     * database connections...) and clients don't keep their connections open.
+     *
+     * Each thread of the server keeps up to \p size idle server objects. A connection takes one
+     * when a request arrives and gives it back once the response has been sent, so an object
+     * only ever handles one request at a time, but not all the requests of a given connection.
+     * Before being given back, the state of KDSoapServerObjectInterface (request and response headers,
+     * fault, response namespace, SOAP action, server socket) is reset. Server objects which also derive
+     * from KDSoapServerReuseInterface get a call to KDSoapServerReuseInterface::prepareForReuse(), to reset their own state.
+     * An object which is still busy with a delayed response when its connection is closed is deleted.
+     *
+     * The default value, 0, means that server objects are not reused.
+     * \since 2.3
+     */
+    void setServerObjectPoolSize(int size);
+
+    /**
+     * Returns the number of idle server objects kept per thread, as set by setServerObjectPoolSize.
+     * \since 2.3
+     */
+    int serverObjectPoolSize() const;
+
+    /**
+     * Sets the maximum number of requests handled at the same time, by all the threads of the server.
+     * A request counts from the moment its headers are received until its response has been sent,
+     * including the time spent waiting for a delayed response or for a thread of processingThreadPool().
+     *
+     * Beyond this number, new requests are rejected as soon as their headers are received, without reading
+     * their body or creating a server object, see setOverloadResponse(). The connection is then closed.
+     * This sheds load when the server can't keep up, instead of letting the response times of all requests grow.
+     * Requests for the paths or SOAP actions set with setPriorityPaths() and setPrioritySoapActions() are never rejected.
+     *
+     * The default value, 0, means unlimited. Compare with setMaxConnections(), which limits the connections
+     * rather than the requests.
+     * \since 2.3
+     */
+    void setMaxInFlightRequests(int requests);
+
+    /**
+     * Returns the maximum number of requests in flight, as set by setMaxInFlightRequests.
+     * \since 2.3
+     */
+    int maxInFlightRequests() const;
+
+    /**
+     * Sets the maximum number of SOAP calls waiting for a thread of processingThreadPool().
+     * Beyond this number, new requests are rejected like with setMaxInFlightRequests().
+     *
+     * The default value, 0, means unlimited. This has no effect without a processing thread pool.
+     * \since 2.3
+     */
+    void setMaxQueuedRequests(int requests);
+
+    /**
+     * Returns the maximum number of queued requests, as set by setMaxQueuedRequests.
+     * \since 2.3
+     */
+    int maxQueuedRequests() const;
+
+    /**
+     * Returns the number of requests being handled at this precise moment, see setMaxInFlightRequests.
+     * Like numConnectedSockets(), this is only useful for statistical purposes.
+     * \since 2.3
+     */
+    int numInFlightRequests() const;
+
+    /**
+     * The response sent to requests rejected because of setMaxInFlightRequests or setMaxQueuedRequests.
+     * \since 2.3
+     */
+    enum OverloadResponse
+    {
+        ServiceUnavailable, ///< An empty "503 Service Unavailable" HTTP response (default)
+        BusyFault ///< A SOAP fault with the code "Server.Busy"
+    };
+
+    /**
+     * Sets the response sent to rejected requests.
+     * Both come with a "Retry-After" header, see setRetryAfter.
+     * \since 2.3
+     */
+    void setOverloadResponse(OverloadResponse response);
+
+    /**
+     * Returns the response sent to rejected requests, as set by setOverloadResponse.
+     * \since 2.3
+     */
+    OverloadResponse overloadResponse() const;
+
+    /**
+     * Sets the number of seconds after which clients are invited to send a rejected request again,
+     * in the "Retry-After" header of the response. 0 means no such header.
+     *
+     * The default value is 1.
+     * \since 2.3
+     */
+    void setRetryAfter(int seconds);
+
+    /**
+     * Returns the delay set by setRetryAfter, in seconds.
+     * \since 2.3
+     */
+    int retryAfter() const;
+
+    /**
+     * Sets the request paths (e.g. a health check) which are always handled, even when the server is overloaded.
+     * They still count as requests in flight. The query part of the request's URL is ignored.
+     * \since 2.3
+     */
+    void setPriorityPaths(const QStringList &paths);
+
+    /**
+     * Returns the paths set by setPriorityPaths.
+     * \since 2.3
+     */
+    QStringList priorityPaths() const;
+
+    /**
+     * Sets the SOAP actions (as sent by the clients, e.g. "http://www.kdab.com/xml/MyWsdl/getEmployeeCountry")
+     * which are always handled, even when the server is overloaded.
+     * \since 2.3
+     */
+    void setPrioritySoapActions(const QList<QByteArray> &soapActions);
+
+    /**
+     * Returns the SOAP actions set by setPrioritySoapActions.
+     * \since 2.3
+     */
+    QList<QByteArray> prioritySoapActions() const;
+
+    /**
+     * Sets how long suspend() lets the connected clients finish their requests.
+     *
+     * With a drain timeout, suspend() stops accepting connections and closes the idle connections
+     * at once, but the requests being handled (including delayed responses, see
+     * KDSoapServerObjectInterface::prepareDelayedResponse()) are answered normally, with "Connection: close".
+     * Their connections are closed once the response is sent, or after \p msecs at the latest.
+     * The signal drained() is emitted once all the connections are closed, e.g. to delete the server then.
+     *
+     * The default value, 0, means that suspend() closes all the connections immediately.
+     * \since 2.3
+     */
+    void setDrainTimeout(int msecs);
+
+    /**
+     * Returns the drain timeout set by setDrainTimeout, in milliseconds.
+     * \since 2.3
+     */
+    int drainTimeout() const;
+
+    /**
+     * Sets how much response data may wait in a connection's write buffer.
+     *
+     * Large responses (file downloads, the WSDL file, big SOAP responses, streamed responses) are not
+     * pushed into the socket all at once: the server writes until \p highWatermark bytes are waiting
+     * to be sent to the client, and writes more when that amount drops to \p lowWatermark.
+     * This bounds the memory used by each slow client.
+     *
+     * The defaults are 64 KB and 256 KB.
+     * \since 2.3
+     */
+    void setWriteWatermarks(qint64 lowWatermark, qint64 highWatermark);
+
+    /**
+     * Returns the low watermark set by setWriteWatermarks, in bytes.
+     * \since 2.3
+     */
+    qint64 writeLowWatermark() const;
+
+    /**
+     * Returns the high watermark set by setWriteWatermarks, in bytes.
+     * \since 2.3
+     */
+    qint64 writeHighWatermark() const;
+
     /**
      * Sets the number of expected sockets (connections) in this process.
      * This is necessary in order to increase system limits when a large number of clients
@@ -221,6 +482,11 @@ public:
      * \param file relative or absolute path to the .wsdl file (including the filename), on disk
      * \param pathInUrl that clients can use in order to download the file:
      *                  for instance "/files/myservice.wsdl" for "https://myserver.example.com/files/myservice.wsdl" as final URL.
+     *
+     * Since KDSoap 2.3, the file is loaded into memory, and reloaded when it changes on disk.
+     * If a gzipped copy of the file exists next to it, with a ".gz" suffix (e.g. "myservice.wsdl.gz"), and isn't older,
+     * it's sent to clients which accept the gzip encoding.
+     * Clients which already have the current version get a "304 Not Modified" response (If-None-Match, If-Modified-Since).
      */
     void setWsdlFile(const QString &file, const QString &pathInUrl);
 
@@ -250,7 +516,8 @@ public:
 public Q_SLOTS:
     /**
      * Temporarily suspend (do not listen to incoming connections, and close all
-     * connected sockets after servicing current requests).
+     * connected sockets after servicing current requests, see setDrainTimeout).
+     * The signal drained() is emitted once all connections are closed.
      */
     void suspend();
 
@@ -266,12 +533,36 @@ Q_SIGNALS:
      */
     void connectionRejected();
 
+    /**
+     * Emitted when a request was rejected, because of setMaxInFlightRequests or setMaxQueuedRequests.
+     * This signal can be emitted by any thread of the server.
+     * \since 2.3
+     */
+    void requestRejected();
+
+    /**
+     * Emitted after suspend(), once all the connections to the server are closed.
+     * \since 2.3
+     */
+    void drained();
+
 protected:
     /*! \reimp \internal */ void incomingConnection(qintptr socketDescriptor) override;
 
 private:
     friend class KDSoapServerSocket;
+    friend class KDSoapSocketList;
+    friend class KDSoapServerAcceptor;
+    friend class KDSoapServerThread;
+    bool admitConnection();
+    void connectionClosed();
+    bool admitRequest(const QByteArray &path, const QByteArray &soapAction);
+    void requestDone();
+    void requestQueued();
+    void requestDequeued();
     void log(const QByteArray &text);
+    KDSoapWsdlCache *wsdlCache() const;
+    KDSoapServerRoutes routes() const;
     class Private;
     Private *const d;
 };
@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapServerAcceptor_p.h"
+#include "KDSoapServer.h"
+#include "KDSoapServerThread_p.h"
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+KDSoapServerAcceptor::KDSoapServerAcceptor(KDSoapServer *server, KDSoapServerThreadImpl *thread)
+    : QTcpServer(nullptr)
+    , m_server(server)
+    , m_thread(thread)
+{
+    setMaxPendingConnections(server->maxPendingConnections());
+}
+
+void KDSoapServerAcceptor::incomingConnection(qintptr socketDescriptor)
+{
+    if (m_server->admitConnection()) {
+        m_thread->acceptConnection(int(socketDescriptor), m_server);
+    }
+}
+
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+// Fills \p storage with \p address and \p port, and returns its length.
+// \p dualStack is for QHostAddress::Any: the IPv6 wildcard address, which also accepts IPv4 connections unless IPV6_V6ONLY is set.
+static socklen_t fillSocketAddress(sockaddr_storage &storage, const QHostAddress &address, quint16 port, bool dualStack)
+{
+    memset(&storage, 0, sizeof(storage));
+    if (dualStack || address.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6 *sa = reinterpret_cast<sockaddr_in6 *>(&storage);
+        sa->sin6_family = AF_INET6;
+        sa->sin6_port = htons(port);
+        if (dualStack) {
+            sa->sin6_addr = in6addr_any;
+        } else {
+            const Q_IPV6ADDR ip = address.toIPv6Address();
+            memcpy(&sa->sin6_addr, &ip, sizeof(ip));
+        }
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in *sa = reinterpret_cast<sockaddr_in *>(&storage);
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(port);
+    sa->sin_addr.s_addr = address == QHostAddress::Any ? htonl(INADDR_ANY) : htonl(address.toIPv4Address());
+    return sizeof(sockaddr_in);
+}
+#endif
+
+bool KDSoapServerAcceptor::listenReusePort(QTcpServer *tcpServer, const QHostAddress &address, quint16 port)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    // Same as QTcpServer::listen, which has no way to set SO_REUSEPORT before binding
+    bool dualStack = address == QHostAddress::Any;
+    sockaddr_storage storage;
+    socklen_t length = fillSocketAddress(storage, address, port, dualStack);
+    int fd = ::socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 && errno == EAFNOSUPPORT && dualStack) {
+        // IPv6 is disabled on this host: like QTcpServer::listen, fall back to IPv4 only
+        dualStack = false;
+        length = fillSocketAddress(storage, address, port, dualStack);
+        fd = ::socket(storage.ss_family, SOCK_STREAM, 0);
+    }
+    if (fd < 0) {
+        qWarning("KDSoapServer: cannot create a socket: %s", strerror(errno));
+        return false;
+    }
+    const int on = 1;
+    const int off = 0;
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 || ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0
+        || (dualStack && ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0)
+        || ::bind(fd, reinterpret_cast<sockaddr *>(&storage), length) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        qWarning("KDSoapServer: cannot listen on %s port %d: %s", qPrintable(address.toString()), port, strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (!tcpServer->setSocketDescriptor(fd)) {
+        qWarning("KDSoapServer: %s", qPrintable(tcpServer->errorString()));
+        ::close(fd);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(tcpServer);
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    qWarning("KDSoapServer: SO_REUSEPORT is not supported on this platform");
+    return false;
+#endif
+}
+
+#include "moc_KDSoapServerAcceptor_p.cpp"
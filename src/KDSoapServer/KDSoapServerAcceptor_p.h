@@ -0,0 +1,43 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPSERVERACCEPTOR_P_H
+#define KDSOAPSERVERACCEPTOR_P_H
+
+#include <QHostAddress>
+#include <QTcpServer>
+class KDSoapServer;
+class KDSoapServerThreadImpl;
+
+/**
+ * A listening socket for a KDSoapServer, in one of the threads of its KDSoapThreadPool,
+ * see KDSoapServer::listenInThreads().
+ *
+ * All the acceptors of a server (and the server itself) listen on the same port, with SO_REUSEPORT,
+ * and the kernel spreads the incoming connections between them. Each acceptor hands its connections
+ * to the thread it lives in directly, without going through the server's thread.
+ */
+class KDSoapServerAcceptor : public QTcpServer
+{
+    Q_OBJECT
+public:
+    KDSoapServerAcceptor(KDSoapServer *server, KDSoapServerThreadImpl *thread);
+
+    // Makes \p tcpServer listen on a socket created with SO_REUSEPORT. Returns false if that's not supported.
+    static bool listenReusePort(QTcpServer *tcpServer, const QHostAddress &address, quint16 port);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    KDSoapServer *m_server;
+    KDSoapServerThreadImpl *m_thread;
+};
+
+#endif // KDSOAPSERVERACCEPTOR_P_H
@@ -33,7 +33,6 @@ public:
     KDSoap::SoapVersion m_requestVersion = KDSoap::SoapVersion::SOAP1_1;
     // QPointer in case the client disconnects during a delayed response
     QPointer<KDSoapServerSocket> m_serverSocket;
-    QMap<QByteArray, QByteArray> m_httpHeaders;
 };
 
 KDSoapServerObjectInterface::HttpResponseHeaderItem::HttpResponseHeaderItem(const QByteArray &name, const QByteArray &value)
@@ -87,6 +86,11 @@ KDSoapServerObjectInterface::HttpResponseHeaderItems KDSoapServerObjectInterface
     return HttpResponseHeaderItems();
 }
 
+void KDSoapServerObjectInterface::resetState()
+{
+    *d = Private();
+}
+
 void KDSoapServerObjectInterface::doneProcessingRequestWithPath(const KDSoapServerObjectInterface &otherInterface)
 {
     d->m_faultCode = otherInterface.d->m_faultCode;
@@ -184,7 +188,6 @@ KDSoapDelayedResponseHandle KDSoapServerObjectInterface::prepareDelayedResponse(
 void KDSoapServerObjectInterface::setServerSocket(KDSoapServerSocket *serverSocket)
 {
     d->m_serverSocket = serverSocket;
-    d->m_httpHeaders = d->m_serverSocket->m_httpHeaders;
 }
 
 void KDSoapServerObjectInterface::sendDelayedResponse(const KDSoapDelayedResponseHandle &responseHandle, const KDSoapMessage &response)
@@ -195,6 +198,11 @@ void KDSoapServerObjectInterface::sendDelayedResponse(const KDSoapDelayedRespons
     }
 }
 
+KDSoapResponseStream *KDSoapServerObjectInterface::startStreamedResponse(const QString &responseName)
+{
+    return d->m_serverSocket->startStreamedResponse(this, responseName);
+}
+
 void KDSoapServerObjectInterface::writeHTTP(const QByteArray &httpReply)
 {
     const qint64 written = d->m_serverSocket->write(httpReply);
@@ -212,7 +220,6 @@ void KDSoapServerObjectInterface::copyFrom(KDSoapServerObjectInterface *other)
     d->m_requestHeaders = other->d->m_requestHeaders;
     d->m_soapAction = other->d->m_soapAction;
     d->m_serverSocket = other->d->m_serverSocket;
-    d->m_httpHeaders = other->d->m_httpHeaders;
     d->m_requestVersion = other->d->m_requestVersion;
 }
 
@@ -21,6 +21,7 @@
 #include <QtCore/QVector>
 
 class KDSoapServerSocket;
+class KDSoapResponseStream;
 
 QT_BEGIN_NAMESPACE
 class QAbstractSocket;
@@ -235,6 +236,19 @@ public:
      */
     void sendDelayedResponse(const KDSoapDelayedResponseHandle &responseHandle, const KDSoapMessage &response);
 
+    /**
+     * Starts sending the response to the current call, for a response which is too big to be
+     * built in memory, or which is produced progressively. The \p response argument of processRequest()
+     * is then ignored; write the child elements of the response element into the returned stream instead,
+     * from processRequest() or later on, and call KDSoapResponseStream::finish() at the end.
+     *
+     * \param responseName the name of the response element, e.g. "getEmployeeListResponse".
+     * If empty, the name of the request element is used, like for normal responses.
+     * \return the stream, or nullptr if a response was already started for this call.
+     * \since 2.3
+     */
+    KDSoapResponseStream *startStreamedResponse(const QString &responseName = QString()); // only valid during processRequest()
+
     /**
      * Low-level method, not needed for normal operations.
      * Call this method to write an HTTP reply back, e.g. in case of an error.
@@ -268,6 +282,8 @@ public:
 
 private:
     friend class KDSoapServerSocket;
+    friend class KDSoapSocketList;
+    void resetState();
     void setServerSocket(KDSoapServerSocket *serverSocket); // only valid during processRequest()
     void setRequestHeaders(const KDSoapHeaders &headers, const QByteArray &soapAction);
     void setRequestVersion(KDSoap::SoapVersion requestVersion);
@@ -0,0 +1,20 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+
+#include "KDSoapServerReuseInterface.h"
+
+KDSoapServerReuseInterface::KDSoapServerReuseInterface()
+    : d(nullptr)
+{
+}
+
+KDSoapServerReuseInterface::~KDSoapServerReuseInterface()
+{
+}
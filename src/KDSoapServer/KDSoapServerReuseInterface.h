@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPSERVERREUSEINTERFACE_H
+#define KDSOAPSERVERREUSEINTERFACE_H
+
+#include "KDSoapServerGlobal.h"
+#include <QtCore/QObject>
+
+/**
+ * Additional interface for server objects which are reused across requests.
+ *
+ * When KDSoapServer::setServerObjectPoolSize() is set, server objects are kept in a pool
+ * and used for several requests, possibly from different connections. The state kept by
+ * KDSoapServerObjectInterface is reset in between; in addition to deriving from KDSoapServerObjectInterface,
+ * you can derive from KDSoapServerReuseInterface in order to reset the per-request state of your own class.
+ *
+ * Use Q_INTERFACES(KDSoapServerReuseInterface) in your derived class (under Q_OBJECT)
+ * so that Qt can discover the additional inheritance.
+ *
+ * \since 2.3
+ */
+class KDSOAPSERVER_EXPORT KDSoapServerReuseInterface
+{
+public:
+    /**
+     * Constructor
+     */
+    KDSoapServerReuseInterface();
+
+    KDSoapServerReuseInterface(const KDSoapServerReuseInterface &other) = delete;
+    KDSoapServerReuseInterface &operator=(const KDSoapServerReuseInterface &other) = delete;
+
+    /**
+     * Destructor
+     */
+    virtual ~KDSoapServerReuseInterface();
+
+    /**
+     * Called when the server puts this object back into its pool, before it's used for another request.
+     * The state kept by KDSoapServerObjectInterface has been reset already.
+     */
+    virtual void prepareForReuse() = 0;
+
+private:
+    class Private;
+    Private *const d;
+};
+
+QT_BEGIN_NAMESPACE
+Q_DECLARE_INTERFACE(KDSoapServerReuseInterface, "com.kdab.KDSoap.ServerReuseInterface/1.0")
+QT_END_NAMESPACE
+
+#endif /* KDSOAPSERVERREUSEINTERFACE_H */
@@ -0,0 +1,72 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPSERVERROUTES_P_H
+#define KDSOAPSERVERROUTES_P_H
+
+#include <QByteArray>
+#include <QFlags>
+#include <QHash>
+#include <QString>
+
+/**
+ * Maps the path (and query) of requests to the server's own handlers: the SOAP endpoint (KDSoapServer::path())
+ * and the WSDL file (KDSoapServer::wsdlPathInUrl()).
+ *
+ * It's rebuilt whenever one of these changes, and stored in the server's configuration snapshot,
+ * so routing a request is a single hash lookup on the bytes of the request line.
+ * Requests for any other path go to KDSoapServerObjectInterface::processRequestWithPath() (POST)
+ * or processFileRequest() (GET), and requests with other methods to KDSoapServerCustomVerbRequestInterface.
+ */
+class KDSoapServerRoutes
+{
+public:
+    enum Route
+    {
+        NoRoute = 0,
+        SoapEndpoint = 1, // processRequest()
+        Wsdl = 2 // the WSDL file, for GET and HEAD
+    };
+    Q_DECLARE_FLAGS(Routes, Route)
+
+    void setSoapPath(const QString &path)
+    {
+        m_soapPath = path.toUtf8();
+        rebuild();
+    }
+    void setWsdlPath(const QString &pathInUrl)
+    {
+        m_wsdlPath = pathInUrl.toUtf8();
+        rebuild();
+    }
+
+    // Both routes can share the same path, the request method decides
+    Routes routes(const QByteArray &pathAndQuery) const
+    {
+        return m_routes.value(pathAndQuery);
+    }
+
+private:
+    void rebuild()
+    {
+        m_routes.clear();
+        m_routes[m_soapPath] |= SoapEndpoint;
+        if (!m_wsdlPath.isEmpty()) {
+            m_routes[m_wsdlPath] |= Wsdl;
+        }
+    }
+
+    QByteArray m_soapPath;
+    QByteArray m_wsdlPath;
+    QHash<QByteArray, Routes> m_routes;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KDSoapServerRoutes::Routes)
+
+#endif // KDSOAPSERVERROUTES_P_H
@@ -7,27 +7,84 @@
 ** SPDX-License-Identifier: MIT
 **
 ****************************************************************************/
+#include "KDSoapResponseStream.h"
 #include "KDSoapServer.h"
 #include "KDSoapServerAuthInterface.h"
 #include "KDSoapServerCustomVerbRequestInterface.h"
 #include "KDSoapServerObjectInterface.h"
 #include "KDSoapServerRawXMLInterface.h"
+#include "KDSoapServerRoutes_p.h"
 #include "KDSoapServerSocket_p.h"
+#include "KDSoapServerThread_p.h"
 #include "KDSoapSocketList_p.h"
+#include "KDSoapWsdlCache_p.h"
+#include <KDSoapClient/KDSoapDebug_p.h>
 #include <KDSoapClient/KDSoapMessage.h>
 #include <KDSoapClient/KDSoapMessageReader_p.h>
 #include <KDSoapClient/KDSoapMessageWriter_p.h>
 #include <KDSoapClient/KDSoapNamespaceManager.h>
-#include <QBuffer>
-#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QMetaMethod>
+#include <QSocketNotifier>
+#include <QRunnable>
 #include <QThread>
+#include <QThreadPool>
 #include <QUuid>
 #include <QVarLengthArray>
 
-static const char s_forbidden[] = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n";
+#include <cerrno>
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#endif
+
+static const char s_forbidden[] = "HTTP/1.1 403 Forbidden\r\n";
+static const int s_outputBlockSize = 64 * 1024; // when copying from the device to the socket
+static const char s_badRequest[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char s_headersTooLarge[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const qint64 s_maxDiscardedBodySize = 256 * 1024; // read before closing the connection after rejecting a request
+static const int s_rejectedRequestTimeout = 10000; // to close the connection after rejecting a request, even if the client keeps sending
+
+// Runs makeCall in a thread of the processing pool, then hands the reply back to the socket's thread
+class KDSoapServerSocket::PooledCallRunnable : public QRunnable
+{
+public:
+    explicit PooledCallRunnable(const QSharedPointer<PooledCall> &call)
+        : m_call(call)
+    {
+    }
+
+    // Also called when the pool is cleared before running us, the socket must not wait forever
+    ~PooledCallRunnable() override
+    {
+        if (!m_call->dequeued) {
+            m_call->server->requestDequeued();
+        }
+        {
+            QMutexLocker locker(&m_call->mutex);
+            if (m_call->socket) {
+                QMetaObject::invokeMethod(m_call->socket, "slotPooledCallDone", Qt::QueuedConnection);
+            }
+        }
+        m_call->finished.release();
+    }
+
+    void run() override
+    {
+        PooledCall &call = *m_call;
+        call.server->requestDequeued();
+        call.dequeued = true;
+        makeCall(call.serverObjectInterface, call.requestMsg, call.replyMsg, call.requestHeaders, call.soapAction, call.path, call.soapEndpoint,
+                 call.soapVersion);
+        call.processed = true;
+    }
+
+private:
+    const QSharedPointer<PooledCall> m_call;
+};
 
 KDSoapServerSocket::KDSoapServerSocket(KDSoapSocketList *owner, QObject *serverObject)
 #ifndef QT_NO_SSL
@@ -39,86 +96,62 @@ KDSoapServerSocket::KDSoapServerSocket(KDSoapSocketList *owner, QObject *serverO
 #endif
     m_owner(owner)
     , m_serverObject(serverObject)
-    , m_delayedResponse(false)
+    , m_leaseServerObject(!serverObject)
+    , m_delayedResponse(0)
+    , m_doDebug(false)
     , m_socketEnabled(true)
     , m_receivedData(false)
+    , m_requestAdmitted(false)
+    , m_requestRejected(false)
+    , m_inputToDiscard(0)
+    , m_shutdownPending(false)
+    , m_requestCount(0)
+    , m_threadLoad(owner->threadLoad())
     , m_useRawXML(false)
-    , m_bytesReceived(0)
-    , m_chunkStart(0)
+    , m_keepAlive(true)
+    , m_draining(false)
+    , m_headRequest(false)
+    , m_outputDevice(nullptr)
+    , m_outputFileHandle(-1)
+    , m_sendfileNotifier(nullptr)
+    , m_responseStreamed(false)
+    , m_streamChunked(true)
 {
     connect(this, &QIODevice::readyRead, this, &KDSoapServerSocket::slotReadyRead);
-    m_doDebug = qEnvironmentVariableIsSet("KDSOAP_DEBUG");
+    connect(this, &QIODevice::bytesWritten, this, &KDSoapServerSocket::slotBytesWritten);
+    connect(this, &QAbstractSocket::disconnected, this, &KDSoapServerSocket::slotDisconnected);
+    m_idleTimer.setSingleShot(true);
+    connect(&m_idleTimer, &QTimer::timeout, this, &KDSoapServerSocket::slotIdleTimeout);
+    restartIdleTimer();
 }
 
-// The socket is deleted when it emits disconnected() (see KDSoapSocketList::handleIncomingConnection).
+// The socket is deleted once it's disconnected, see slotDisconnected
 KDSoapServerSocket::~KDSoapServerSocket()
 {
     // same as m_owner->socketDeleted, but safe in case m_owner is deleted first
     emit socketDeleted(this);
 
-    delete m_serverObject;
-}
+    if (m_pooledCall) {
+        // The thread is going away (e.g. the server is deleted) during a call: wait for it, it uses m_serverObject
+        {
+            QMutexLocker locker(&m_pooledCall->mutex);
+            m_pooledCall->socket = nullptr;
+        }
+        m_pooledCall->finished.acquire();
+    }
 
-typedef QMap<QByteArray, QByteArray> HeadersMap;
-static HeadersMap parseHeaders(const QByteArray &headerData)
-{
-    HeadersMap headersMap;
-    QBuffer sourceBuffer;
-    sourceBuffer.setData(headerData);
-    sourceBuffer.open(QIODevice::ReadOnly);
-    // The first line is special, it's the GET or POST line
-    const QList<QByteArray> firstLine = sourceBuffer.readLine().split(' ');
-    if (firstLine.count() < 3) {
-        qDebug() << "Malformed HTTP request:" << firstLine;
-        return headersMap;
-    }
-    const QByteArray &requestType = firstLine.at(0);
-    headersMap.insert("_requestType", requestType);
-
-    // Grammar from https://datatracker.ietf.org/doc/html/rfc7230#section-5.3.1
-    //  origin-form    = absolute-path [ "?" query ]
-    // and https://datatracker.ietf.org/doc/html/rfc3986#section-3.3
-    // says the path ends at the first '?' or '#' character
-    const QByteArray arg1 = firstLine.at(1);
-    const int queryPos = arg1.indexOf('?');
-    const QByteArray path = queryPos >= 0 ? arg1.left(queryPos) : arg1;
-    const QByteArray query = queryPos >= 0 ? arg1.mid(queryPos) : QByteArray();
-    // Unfortunately QDir::cleanPath works with QString
-    QByteArray cleanedPath = QDir::cleanPath(QString::fromUtf8(path)).toUtf8();
-    // And unfortunately it keeps "//<host>/" unchanged on Windows
-    while (cleanedPath.startsWith("//")) // while() so we also clean up "///"
-        cleanedPath = cleanedPath.mid(1);
-    headersMap.insert("_path", cleanedPath);
-    headersMap.insert("_query", query);
-
-    const QByteArray &httpVersion = firstLine.at(2);
-    headersMap.insert("_httpVersion", httpVersion);
-
-    while (!sourceBuffer.atEnd()) {
-        const QByteArray line = sourceBuffer.readLine();
-        const int pos = line.indexOf(':');
-        if (pos == -1) {
-            qDebug() << "Malformed HTTP header:" << line;
-        }
-        const QByteArray header = line.left(pos).toLower(); // RFC2616 section 4.2 "Field names are case-insensitive"
-        const QByteArray value = line.mid(pos + 1).trimmed(); // remove space before and \r\n after
-        // qDebug() << "HEADER" << header << "VALUE" << value;
-        headersMap.insert(header, value);
-    }
-    return headersMap;
-}
-
-// We could parse headers as we go along looking for \r\n, and stop at empty header line, to avoid all this memory copying
-// But in practice XML parsing (and writing) is far, far slower anyway.
-static bool splitHeadersAndData(const QByteArray &request, QByteArray &header, QByteArray &data)
-{
-    const int sep = request.indexOf("\r\n\r\n");
-    if (sep <= 0) {
-        return false;
+    if (m_threadLoad) {
+        requestFinished();
+        m_threadLoad->connectionRemoved(); // see KDSoapServerThread::handleIncomingConnection
     }
-    header = request.left(sep);
-    data = request.mid(sep + 4);
-    return true;
+    admittedRequestDone();
+
+    delete m_outputDevice;
+    // Unless it's still busy with the call: then it can't handle another one
+    if (!m_delayedResponse.loadAcquire() && !m_responseStream) {
+        releaseServerObject();
+    }
+    delete m_serverObject;
 }
 
 static QByteArray stripQuotes(const QByteArray &bar)
@@ -130,6 +163,32 @@ static QByteArray stripQuotes(const QByteArray &bar)
     return bar;
 }
 
+// Checks the soap version and extracts the soapAction header
+static QByteArray requestSoapAction(const KDSoapHttpHeaders &httpHeaders, KDSoap::SoapVersion *soapVersion)
+{
+    *soapVersion = KDSoap::SoapVersion::SOAP1_1;
+    QByteArray soapAction;
+    const QByteArray contentType = httpHeaders.value(KDSoapHttpHeaders::ContentType);
+    if (contentType.startsWith("text/xml")) { // krazy:exclude=strings
+        // SOAP 1.1
+        soapAction = httpHeaders.value(KDSoapHttpHeaders::SoapAction);
+        // The SOAP standard allows quotation marks around the SoapAction, so we have to get rid of these.
+        soapAction = stripQuotes(soapAction);
+
+    } else if (contentType.startsWith("application/soap+xml")) { // krazy:exclude=strings
+        // SOAP 1.2
+        *soapVersion = KDSoap::SoapVersion::SOAP1_2;
+        // Example: application/soap+xml;charset=utf-8;action=ActionHex
+        const QList<QByteArray> parts = contentType.split(';');
+        for (const QByteArray &part : std::as_const(parts)) {
+            if (part.trimmed().startsWith("action=")) { // krazy:exclude=strings
+                soapAction = stripQuotes(part.mid(part.indexOf('=') + 1));
+            }
+        }
+    }
+    return soapAction;
+}
+
 static QByteArray additionalHttpHeaders(KDSoapServerObjectInterface *serverObjectInterface)
 {
     QByteArray httpResponse;
@@ -147,7 +206,24 @@ static QByteArray additionalHttpHeaders(KDSoapServerObjectInterface *serverObjec
     return httpResponse;
 }
 
-static QByteArray httpResponseHeaders(bool fault, const QByteArray &contentType, int responseDataSize, KDSoapServerObjectInterface *serverObjectInterface)
+// RFC 7230 section 6.3: HTTP/1.1 connections persist unless the client says "Connection: close",
+// HTTP/1.0 connections only persist if the client says "Connection: keep-alive"
+static bool isKeepAliveRequested(const KDSoapHttpHeaders &httpHeaders)
+{
+    const QByteArray connection = httpHeaders.value(KDSoapHttpHeaders::Connection).toLower();
+    if (httpHeaders.httpVersion() == "HTTP/1.0") {
+        return connection.contains("keep-alive");
+    }
+    return !connection.contains("close");
+}
+
+static QByteArray soapContentType(KDSoap::SoapVersion version)
+{
+    return version == KDSoap::SoapVersion::SOAP1_1 ? "text/xml" : "application/soap+xml;charset=utf-8";
+}
+
+static QByteArray httpResponseHeaders(bool fault, const QByteArray &contentType, qint64 responseDataSize, const QByteArray &extraHeaders,
+                                      KDSoapServerObjectInterface *serverObjectInterface)
 {
     QByteArray httpResponse;
     httpResponse.reserve(50);
@@ -165,6 +241,7 @@ static QByteArray httpResponseHeaders(bool fault, const QByteArray &contentType,
     httpResponse += "\r\nContent-Length: ";
     httpResponse += QByteArray::number(responseDataSize);
     httpResponse += "\r\n";
+    httpResponse += extraHeaders;
 
     httpResponse += additionalHttpHeaders(serverObjectInterface);
 
@@ -177,170 +254,566 @@ void KDSoapServerSocket::slotReadyRead()
     if (!m_socketEnabled) {
         return;
     }
-
-    // QNAM in Qt 5.x tends to connect additional sockets in advance and not use them
-    // So only count the sockets which actually sent us data (for the servertest unittest).
-    if (!m_receivedData) {
-        m_receivedData = true;
-        m_owner->increaseConnectionCount();
+    if (m_requestRejected) {
+        discardInput();
+        return;
     }
 
     // qDebug() << this << QThread::currentThread() << "slotReadyRead!";
 
-    QByteArray buf(2048, ' ');
-    qint64 nread = -1;
-    while (nread != 0) {
-        nread = read(buf.data(), buf.size());
+    // Read straight into the parser's buffer
+    qint64 available;
+    while ((available = bytesAvailable()) > 0) {
+        const int size = int(qMin<qint64>(available, 1024 * 1024));
+        const qint64 nread = read(m_parser.prepareWrite(size), size);
         if (nread < 0) {
+            m_parser.commitWrite(0);
             qDebug() << "Error reading from server socket:" << errorString();
             return;
         }
-        m_requestBuffer += buf.left(nread);
-        m_bytesReceived += nread;
+        m_parser.commitWrite(int(nread));
+        restartIdleTimer();
     }
 
-    KDSoapServerRawXMLInterface *rawXmlInterface = qobject_cast<KDSoapServerRawXMLInterface *>(m_serverObject);
+    // The client can send several requests without waiting for the responses (pipelining): handle them in order
+    while (state() == QAbstractSocket::ConnectedState) {
+        // QNAM in Qt 5.x tends to connect additional sockets in advance and not use them
+        // So only count the sockets which actually sent us data (for the servertest unittest).
+        if (!m_receivedData && m_parser.hasData()) {
+            m_receivedData = true;
+            m_owner->increaseConnectionCount();
+        }
 
-    if (m_httpHeaders.isEmpty()) {
-        // New request: see if we can parse headers
-        QByteArray receivedHttpHeaders, receivedData;
-        const bool splitOK = splitHeadersAndData(m_requestBuffer, receivedHttpHeaders, receivedData);
-        if (!splitOK) {
+        const bool newRequest = m_parser.state() == KDSoapHttpRequestParser::RequestLine || m_parser.state() == KDSoapHttpRequestParser::Headers;
+        const KDSoapHttpRequestParser::State requestState = m_parser.parse();
+        if (requestState == KDSoapHttpRequestParser::Error) {
+            // We can't find where the next request would start, give up on this connection
+            write(m_parser.headersTooLarge() ? s_headersTooLarge : s_badRequest);
+            m_parser.reset();
+            disconnectFromHost();
+            return;
+        }
+        if (requestState == KDSoapHttpRequestParser::RequestLine || requestState == KDSoapHttpRequestParser::Headers) {
             // qDebug() << "Incomplete SOAP request, wait for more data";
             // incomplete request, wait for more data
             return;
         }
-        m_httpHeaders = parseHeaders(receivedHttpHeaders);
-        // Leave only the actual data in the buffer
-        m_requestBuffer = receivedData;
-        m_bytesReceived = receivedData.size();
-        m_useRawXML = false;
-        if (rawXmlInterface) {
-            KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(m_serverObject);
-            serverObjectInterface->setServerSocket(this);
-            m_useRawXML = rawXmlInterface->newRequest(m_httpHeaders.value("_requestType"), m_httpHeaders);
-        }
-    }
 
-    if (m_doDebug) {
-        qDebug() << "headers:" << m_httpHeaders;
-        qDebug() << "data received:" << m_requestBuffer;
-    }
+        const KDSoapHttpHeaders &httpHeaders = m_parser.headers();
+        if (newRequest && !admitRequest(httpHeaders)) {
+            return; // the connection is being closed
+        }
+        if (newRequest && m_leaseServerObject && !m_serverObject) {
+            m_serverObject = m_owner->leaseServerObject(); // given back in prepareForNextRequest
+        }
+        KDSoapServerRawXMLInterface *rawXmlInterface = qobject_cast<KDSoapServerRawXMLInterface *>(m_serverObject);
+        if (newRequest) {
+            m_doDebug = kdsoapShouldDebugCall(KDSoapDebug::Server);
+            if (m_doDebug) {
+                qCDebug(kdsoapServerDebug) << "headers:" << httpHeaders.toMap();
+            }
+            ++m_requestCount;
+            const int maxRequests = m_owner->server()->maxRequestsPerConnection();
+            m_keepAlive = !m_draining && isKeepAliveRequested(httpHeaders) && (maxRequests <= 0 || m_requestCount < maxRequests);
+            if (!m_keepAlive) {
+                m_connectionHeader = "Connection: close\r\n";
+            } else if (httpHeaders.httpVersion() == "HTTP/1.0") {
+                m_connectionHeader = "Connection: keep-alive\r\n";
+            } else {
+                m_connectionHeader.clear(); // the default
+            }
+            m_useRawXML = false;
+            if (rawXmlInterface) {
+                KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(m_serverObject);
+                serverObjectInterface->setServerSocket(this);
+                m_useRawXML = rawXmlInterface->newRequest(KDSoapHttpHeaders::detached(httpHeaders.requestType()), httpHeaders.toMap());
+            }
+        }
 
-    if (m_httpHeaders.value("transfer-encoding") != "chunked") {
         if (m_useRawXML) {
-            rawXmlInterface->processXML(m_requestBuffer);
-            m_requestBuffer.clear();
+            // Hand over the data as it arrives, rather than keeping it around
+            const QByteArray data = m_parser.body();
+            if (!data.isEmpty()) {
+                if (m_doDebug) {
+                    qCDebug(kdsoapServerDebug) << "data received:" << data;
+                }
+                rawXmlInterface->processXML(data);
+                m_parser.consumeBody();
+            }
         }
 
-        const QByteArray contentLength = m_httpHeaders.value("content-length");
-        if (m_bytesReceived < contentLength.toInt()) {
+        if (requestState != KDSoapHttpRequestParser::Complete) {
             return; // incomplete request, wait for more data
         }
 
+        requestStarted();
         if (m_useRawXML) {
             rawXmlInterface->endRequest();
         } else {
-            handleRequest(m_httpHeaders, m_requestBuffer);
+            if (m_doDebug) {
+                qCDebug(kdsoapServerDebug) << "data received:" << m_parser.body();
+            }
+            handleRequest(httpHeaders, m_parser.body());
+        }
+        m_parser.reset(); // keeps what was already received of the next request
+        m_receivedData = false;
+
+        if (!m_socketEnabled) {
+            // Delayed response: the next request will be handled once it's sent, so that responses are sent in order
+            return;
         }
+        if (!m_output.isEmpty()) {
+            // The rest of the response is written as the client reads it, the next request will be handled after that
+            setSocketEnabled(false);
+            return;
+        }
+        if (!prepareForNextRequest()) {
+            return;
+        }
+    }
+}
+
+// Called once the headers of a request are received, before reading its body.
+// Returns false if the server is overloaded: the request is then rejected, and the connection closed.
+bool KDSoapServerSocket::admitRequest(const KDSoapHttpHeaders &httpHeaders)
+{
+    KDSoapServer *server = m_owner->server();
+    KDSoap::SoapVersion soapVersion;
+    const QByteArray soapAction = requestSoapAction(httpHeaders, &soapVersion);
+    if (server->admitRequest(httpHeaders.path(), soapAction)) {
+        m_requestAdmitted = true;
+        return true;
+    }
+
+    // We don't parse the body, so we can't find where the next request would start: the connection is closed
+    QByteArray extraHeaders = "Connection: close\r\n";
+    const int retryAfter = server->retryAfter();
+    if (retryAfter > 0) {
+        extraHeaders += "Retry-After: " + QByteArray::number(retryAfter) + "\r\n";
+    }
+    if (server->overloadResponse() == KDSoapServer::BusyFault) {
+        KDSoapMessage faultMsg;
+        faultMsg.createFaultMessage(QString::fromLatin1("Server.Busy"), QString::fromLatin1("The server is overloaded, try again later"), soapVersion);
+        KDSoapMessageWriter msgWriter;
+        msgWriter.setVersion(soapVersion);
+        const QByteArray xmlResponse = msgWriter.messageToXml(faultMsg, QString::fromLatin1("Fault"), KDSoapHeaders(), QMap<QString, KDSoapMessage>());
+        write(httpResponseHeaders(true, soapContentType(soapVersion), xmlResponse.size(), extraHeaders, nullptr) + xmlResponse);
     } else {
-        // qDebug() << "requestBuffer has " << m_requestBuffer.size() << "bytes, starting at" << m_chunkStart;
-        while (m_chunkStart >= 0) {
-            const int nextEOL = m_requestBuffer.indexOf("\r\n", m_chunkStart);
-            if (nextEOL == -1) {
+        write("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n" + extraHeaders + "\r\n");
+    }
+
+    // Closing the connection while the client is still sending the body would reset it,
+    // and the client could lose the response: read the rest of the body first, and drop it.
+    m_requestRejected = true;
+    m_inputToDiscard = m_parser.remainingBodySize();
+    m_parser.reset();
+    if (m_inputToDiscard == 0) {
+        disconnectFromHost();
+        return false;
+    }
+    if (m_inputToDiscard < 0 || m_inputToDiscard > s_maxDiscardedBodySize) {
+        // Too much to wait for: tell the client that the response is complete, and drop what it sends until it closes the connection
+        m_inputToDiscard = -1;
+        shutdownOutput();
+    }
+    QTimer::singleShot(s_rejectedRequestTimeout, this, [this]() {
+        if (state() != QAbstractSocket::UnconnectedState) {
+            abort();
+        }
+    });
+    discardInput(); // what was received after the headers, if the parser didn't get it
+    return false;
+}
+
+// Reads and drops the body of a rejected request, see admitRequest
+void KDSoapServerSocket::discardInput()
+{
+    qint64 available;
+    while ((available = bytesAvailable()) > 0) {
+        const qint64 skipped = skip(m_inputToDiscard < 0 ? available : qMin(available, m_inputToDiscard));
+        if (skipped <= 0) {
+            return;
+        }
+        if (m_inputToDiscard > 0) {
+            m_inputToDiscard -= skipped;
+            if (m_inputToDiscard == 0) {
+                disconnectFromHost();
                 return;
             }
-            const QByteArray chunkSizeStr = m_requestBuffer.mid(m_chunkStart, nextEOL - m_chunkStart);
-            // qDebug() << m_chunkStart << nextEOL << "chunkSizeStr=" << chunkSizeStr;
-            bool ok;
-            int chunkSize = chunkSizeStr.toInt(&ok, 16);
-            if (!ok) {
-                const QByteArray badRequest = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-                write(badRequest);
+        }
+    }
+}
+
+// Closes the sending side of the connection once the pending output is written: the client then reads the end of the connection,
+// while we can still read what it sends
+void KDSoapServerSocket::shutdownOutput()
+{
+    flush();
+    m_shutdownPending = bytesToWrite() > 0;
+    if (m_shutdownPending) {
+        return; // see slotBytesWritten
+    }
+#ifdef Q_OS_UNIX
+    ::shutdown(int(socketDescriptor()), SHUT_WR);
+#endif
+}
+
+// Called once the response to an admitted request was sent, or when the connection is closed before that
+void KDSoapServerSocket::admittedRequestDone()
+{
+    if (m_requestAdmitted && m_owner) {
+        m_owner->server()->requestDone();
+    }
+    m_requestAdmitted = false;
+}
+
+void KDSoapServerSocket::requestStarted()
+{
+    if (m_threadLoad) {
+        m_threadLoad->requestStarted();
+        m_requestTimer.start();
+    }
+}
+
+void KDSoapServerSocket::requestFinished()
+{
+    if (m_requestTimer.isValid()) {
+        m_threadLoad->requestFinished(m_requestTimer.nsecsElapsed() / 1000);
+        m_requestTimer.invalidate();
+    }
+}
+
+// Called once the response to a request was written
+bool KDSoapServerSocket::prepareForNextRequest()
+{
+    requestFinished();
+    admittedRequestDone();
+    releaseServerObject();
+    if (!m_keepAlive) {
+        disconnectFromHost(); // after writing out what's pending
+        return false;
+    }
+    restartIdleTimer();
+    return true;
+}
+
+void KDSoapServerSocket::releaseServerObject()
+{
+    if (m_leaseServerObject && m_serverObject && m_owner) {
+        m_owner->releaseServerObject(m_serverObject);
+        m_serverObject = nullptr;
+    }
+}
+
+void KDSoapServerSocket::restartIdleTimer()
+{
+    const int timeout = m_owner->server()->keepAliveTimeout();
+    if (timeout > 0) {
+        m_idleTimer.start(timeout);
+    } else {
+        m_idleTimer.stop();
+    }
+}
+
+// Called by KDSoapServer::suspend: closes the connection once the current request is answered, or after \p msecs
+void KDSoapServerSocket::drain(int msecs)
+{
+    const bool responseStarted = m_responseStream || !m_output.isEmpty();
+    if (!m_pooledCall && !m_delayedResponse.loadAcquire() && !responseStarted && !m_parser.hasData()) {
+        disconnectFromHost(); // idle
+        return;
+    }
+    m_draining = true;
+    m_keepAlive = false;
+    if (!responseStarted) {
+        m_connectionHeader = "Connection: close\r\n";
+    }
+    QTimer::singleShot(msecs, this, [this]() {
+        if (state() != QAbstractSocket::UnconnectedState) {
+            qWarning("KDSoapServer: closing a connection which didn't finish its request in time");
+            abort();
+        }
+    });
+}
+
+void KDSoapServerSocket::slotIdleTimeout()
+{
+    if (m_requestRejected) {
+        return; // closed once the body is discarded, or after s_rejectedRequestTimeout
+    }
+    if (m_pooledCall || m_delayedResponse.loadAcquire() || m_responseStream || !m_output.isEmpty()) {
+        return; // not idle, we owe the client a response. The timer is restarted once it's sent.
+    }
+    if (m_doDebug) {
+        qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: closing idle connection";
+    }
+    disconnectFromHost();
+}
+
+// Called when an asynchronous response (delayed, streamed, or written as the client reads it) may be complete
+void KDSoapServerSocket::responseDone()
+{
+    if (m_pooledCall || m_delayedResponse.loadAcquire() || m_responseStream || !m_output.isEmpty()) {
+        return; // not yet, this is called again later
+    }
+    if (prepareForNextRequest()) {
+        setSocketEnabled(true); // handles the next request, if it was received already
+    }
+}
+
+// Queues data to be written once the socket's write buffer is below the high watermark
+void KDSoapServerSocket::writeOutput(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+    m_output.append(OutputPart{data, false, 0, data.size()});
+    fillOutput();
+}
+
+// Same for \p length bytes of m_outputDevice, read (at most a block at a time) only when there's room for them
+void KDSoapServerSocket::writeDeviceOutput(qint64 offset, qint64 length)
+{
+    if (length <= 0) {
+        return;
+    }
+    m_output.append(OutputPart{QByteArray(), true, offset, length});
+    fillOutput();
+}
+
+void KDSoapServerSocket::fillOutput()
+{
+    const qint64 highWatermark = m_owner->server()->writeHighWatermark();
+    while (!m_output.isEmpty()) {
+        OutputPart &part = m_output.first();
+        if (part.fromDevice && m_outputFileHandle >= 0) {
+            if (!sendFileData(part)) {
+                qWarning() << "Error sending file data:" << qt_error_string(errno);
+                clearOutput();
+                disconnectFromHost();
                 return;
             }
-            if (chunkSize == 0) { // done!
-                m_requestBuffer = m_requestBuffer.mid(nextEOL);
-                m_chunkStart = -1;
-                break;
+            if (part.length > 0) {
+                return; // continued in slotBytesWritten or slotSendfileReady
             }
-            if (nextEOL + 2 + chunkSize + 2 >= m_requestBuffer.size()) {
-                return; // not enough data, chunk is incomplete
+            m_output.removeFirst();
+            continue;
+        }
+
+        const qint64 room = highWatermark - bytesToWrite();
+        if (room <= 0) {
+            return; // continued in slotBytesWritten
+        }
+        qint64 written;
+        if (part.fromDevice) {
+            if (!m_outputDevice->isSequential() && m_outputDevice->pos() != part.offset) {
+                m_outputDevice->seek(part.offset);
             }
-            const QByteArray chunk = m_requestBuffer.mid(nextEOL + 2, chunkSize);
-            if (m_useRawXML) {
-                rawXmlInterface->processXML(chunk);
-            } else {
-                m_decodedRequestBuffer += chunk;
+            if (m_outputBlock.isEmpty()) {
+                m_outputBlock.resize(s_outputBlockSize);
+            }
+            const qint64 in = m_outputDevice->read(m_outputBlock.data(), qMin<qint64>(qMin(room, part.length), m_outputBlock.size()));
+            if (in <= 0) {
+                // We promised more data than we have, the client can only find out if we close the connection
+                qWarning() << "Error reading response data:" << m_outputDevice->errorString();
+                clearOutput();
+                disconnectFromHost();
+                return;
             }
-            m_chunkStart = nextEOL + 2 + chunkSize + 2;
+            written = write(m_outputBlock.constData(), in);
+        } else {
+            written = write(part.data.constData() + part.offset, qMin(room, part.length));
         }
-        // We have the full data, now ensure we read trailers
-        if (!m_requestBuffer.contains("\r\n\r\n")) {
+        if (written <= 0) {
+            qWarning() << "Error writing response data:" << errorString();
+            clearOutput();
             return;
         }
-        if (m_useRawXML) {
-            rawXmlInterface->endRequest();
-        } else {
-            handleRequest(m_httpHeaders, m_decodedRequestBuffer);
+        part.offset += written;
+        part.length -= written;
+        if (part.length == 0) {
+            m_output.removeFirst();
         }
-        m_decodedRequestBuffer.clear();
-        m_chunkStart = 0;
     }
-    m_requestBuffer.clear();
-    m_httpHeaders.clear();
-    m_receivedData = false;
+}
+
+// Returns the file descriptor of m_outputDevice if its contents can be sent with sendfile(), -1 otherwise
+int KDSoapServerSocket::sendfileHandle() const
+{
+#ifdef Q_OS_LINUX
+#ifndef QT_NO_SSL
+    if (mode() != QSslSocket::UnencryptedMode) {
+        return -1; // the data has to go through the encryption
+    }
+#endif
+    const QFile *file = qobject_cast<QFile *>(m_outputDevice);
+    return file ? file->handle() : -1; // -1 for Qt resources, too
+#else
+    return -1;
+#endif
+}
+
+// Sends as much of \p part as the kernel accepts without blocking, straight from the file to the socket.
+// Returns false on error.
+bool KDSoapServerSocket::sendFileData(OutputPart &part)
+{
+#ifdef Q_OS_LINUX
+    if (bytesToWrite() > 0) {
+        return true; // first let QAbstractSocket send the headers, we continue in slotBytesWritten
+    }
+    while (part.length > 0) {
+        off_t offset = part.offset;
+        const ssize_t sent = ::sendfile(int(socketDescriptor()), m_outputFileHandle, &offset, size_t(qMin<qint64>(part.length, 0x40000000)));
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!m_sendfileNotifier) {
+                    m_sendfileNotifier = new QSocketNotifier(socketDescriptor(), QSocketNotifier::Write, this);
+                    connect(m_sendfileNotifier, &QSocketNotifier::activated, this, &KDSoapServerSocket::slotSendfileReady);
+                }
+                m_sendfileNotifier->setEnabled(true);
+                return true;
+            }
+            return false;
+        }
+        if (sent == 0) {
+            errno = ENODATA; // the file is shorter than announced
+            return false;
+        }
+        part.offset += sent;
+        part.length -= sent;
+    }
+    return true;
+#else
+    Q_UNUSED(part);
+    return false;
+#endif
+}
+
+void KDSoapServerSocket::clearOutput()
+{
+    m_output.clear();
+    delete m_outputDevice;
+    m_outputDevice = nullptr;
+    m_outputFileHandle = -1;
+    if (m_sendfileNotifier) {
+        m_sendfileNotifier->setEnabled(false);
+    }
+}
+
+void KDSoapServerSocket::slotSendfileReady()
+{
+    m_sendfileNotifier->setEnabled(false);
+    continueOutput();
+}
+
+void KDSoapServerSocket::slotBytesWritten()
+{
+    if (m_shutdownPending && bytesToWrite() == 0) {
+        shutdownOutput();
+        return;
+    }
+    if (m_output.isEmpty() || bytesToWrite() > m_owner->server()->writeLowWatermark()) {
+        return;
+    }
+    continueOutput();
+}
+
+void KDSoapServerSocket::continueOutput()
+{
+    fillOutput();
+    if (m_output.isEmpty()) {
+        clearOutput(); // done with m_outputDevice
+        if (!m_socketEnabled) {
+            responseDone();
+        }
+    }
+}
+
+bool KDSoapServerSocket::canWriteMore() const
+{
+    return m_output.isEmpty() && bytesToWrite() < m_owner->server()->writeHighWatermark();
+}
+
+bool KDSoapServerSocket::isOutputDrained() const
+{
+    return m_output.isEmpty() && bytesToWrite() <= m_owner->server()->writeLowWatermark();
+}
+
+void KDSoapServerSocket::writeEmptyResponse(const QByteArray &statusLineAndHeaders)
+{
+    QByteArray response = statusLineAndHeaders;
+    response += "Content-Length: 0\r\n";
+    response += m_connectionHeader;
+    response += "\r\n";
+    write(response);
 }
 
 // We're working in a virtual filesystem here, we have no physical root dir nor a concept of symlinks
 // So all we can check is that the path doesn't contain so many "../" that we're going out of the virtual root
-static bool isPathSecure(const QString &path)
+static bool isPathSecure(const QByteArray &path)
 {
     // The input path has already gone through cleanPath, so we just need to check it doesn't start with ..
-    if (!path.startsWith(QLatin1Char('/')))
+    if (!path.startsWith('/'))
         return false;
-    if (path.startsWith(QLatin1String("/..")))
+    if (path.startsWith("/.."))
         return false;
     return true;
 }
 
-void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpHeaders, const QByteArray &receivedData)
+void KDSoapServerSocket::handleRequest(const KDSoapHttpHeaders &httpHeaders, const QByteArray &receivedData)
 {
-    const QString path = QString::fromUtf8(httpHeaders.value("_path").constData());
+    const QByteArray path = httpHeaders.path();
     if (!isPathSecure(path)) {
         // denied for security reasons
-        write(s_forbidden);
+        writeEmptyResponse(s_forbidden);
         return;
     }
 
-    const QByteArray requestType = httpHeaders.value("_requestType");
-    const QString query = QString::fromUtf8(httpHeaders.value("_query").constData());
-    const QString pathAndQuery = path + query;
+    const QByteArray requestType = httpHeaders.requestType();
+    const QByteArray query = httpHeaders.query();
+    const QByteArray pathAndQuery = query.isEmpty() ? path : path + query;
+    // Only converted to QString for the virtual methods which need it
+    const KDSoapServerRoutes::Routes routes = m_owner->server()->routes().routes(pathAndQuery);
 
     KDSoapServerAuthInterface *serverAuthInterface = qobject_cast<KDSoapServerAuthInterface *>(m_serverObject);
     if (serverAuthInterface) {
-        const QByteArray authValue = httpHeaders.value("authorization");
-        if (!serverAuthInterface->handleHttpAuth(authValue, pathAndQuery)) {
+        const QByteArray authValue = httpHeaders.value(KDSoapHttpHeaders::Authorization);
+        if (!serverAuthInterface->handleHttpAuth(authValue, QString::fromUtf8(pathAndQuery))) {
             // send auth request (Qt supports basic, ntlm and digest)
-            const QByteArray unauthorized =
-                "HTTP/1.1 401 Authorization Required\r\nWWW-Authenticate: Basic realm=\"example\"\r\nContent-Length: 0\r\n\r\n";
-            write(unauthorized);
+            writeEmptyResponse("HTTP/1.1 401 Authorization Required\r\nWWW-Authenticate: Basic realm=\"example\"\r\n");
             return;
         }
     }
 
+    // HEAD is supported for downloads. Other HEAD requests are handled like custom verbs, as in previous versions.
+    m_headRequest = requestType == "HEAD";
+    if (m_headRequest) {
+        KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(m_serverObject);
+        if (serverObjectInterface) {
+            serverObjectInterface->setServerSocket(this);
+            if (((routes & KDSoapServerRoutes::Wsdl) && handleWsdlDownload(serverObjectInterface))
+                || handleFileDownload(serverObjectInterface, pathAndQuery)) {
+                return;
+            }
+        }
+    }
+
     if (requestType != "GET" && requestType != "POST") {
         KDSoapServerCustomVerbRequestInterface *serverCustomRequest = qobject_cast<KDSoapServerCustomVerbRequestInterface *>(m_serverObject);
         QByteArray customVerbRequestAnswer;
-        if (serverCustomRequest && serverCustomRequest->processCustomVerbRequest(requestType, receivedData, httpHeaders, customVerbRequestAnswer)) {
+        if (serverCustomRequest
+            && serverCustomRequest->processCustomVerbRequest(KDSoapHttpHeaders::detached(requestType), receivedData, httpHeaders.toMap(),
+                                                             customVerbRequestAnswer)) {
             write(customVerbRequestAnswer);
             return;
         } else {
             qWarning() << "Unknown HTTP request:" << requestType;
             // handleError(replyMsg, "Client.Data", QString::fromLatin1("Invalid request type '%1', should be GET or
             // POST").arg(QString::fromLatin1(requestType.constData()))); sendReply(0, replyMsg);
-            const QByteArray methodNotAllowed = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET POST\r\nContent-Length: 0\r\n\r\n";
-            write(methodNotAllowed);
+            writeEmptyResponse("HTTP/1.1 405 Method Not Allowed\r\nAllow: GET POST\r\n");
             return;
         }
     }
@@ -361,7 +834,7 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     }
 
     if (requestType == "GET") {
-        if (pathAndQuery == server->wsdlPathInUrl() && handleWsdlDownload(serverObjectInterface)) {
+        if ((routes & KDSoapServerRoutes::Wsdl) && handleWsdlDownload(serverObjectInterface)) {
             return;
         } else if (handleFileDownload(serverObjectInterface, pathAndQuery)) {
             return;
@@ -381,41 +854,48 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     KDSoapMessageReader reader;
     KDSoapMessageReader::XmlError err = reader.xmlToMessage(receivedData, &requestMsg, &m_messageNamespace, &requestHeaders, KDSoap::SOAP1_1);
     if (err == KDSoapMessageReader::PrematureEndOfDocumentError) {
-        // qDebug() << "Incomplete SOAP message, wait for more data";
-        // This should never happen, since we check for content-size above.
+        // The whole body was received (see Content-Length or the chunked encoding), so the client sent a truncated message.
+        // Don't leave it waiting for a response, and don't trust the rest of what it sends on this connection.
+        qWarning() << "Incomplete SOAP message, bad request";
+        m_keepAlive = false;
+        m_connectionHeader = "Connection: close\r\n";
+        writeEmptyResponse("HTTP/1.1 400 Bad Request\r\n");
         return;
     } // TODO handle parse errors?
 
-    // check soap version and extract soapAction header
-    KDSoap::SoapVersion soapVersion = KDSoap::SoapVersion::SOAP1_1;
-    QByteArray soapAction;
-    const QByteArray contentType = httpHeaders.value("content-type");
-    if (contentType.startsWith("text/xml")) { // krazy:exclude=strings
-        // SOAP 1.1
-        soapVersion = KDSoap::SoapVersion::SOAP1_1;
-        soapAction = httpHeaders.value("soapaction");
-        // The SOAP standard allows quotation marks around the SoapAction, so we have to get rid of these.
-        soapAction = stripQuotes(soapAction);
-
-    } else if (contentType.startsWith("application/soap+xml")) { // krazy:exclude=strings
-        // SOAP 1.2
-        soapVersion = KDSoap::SoapVersion::SOAP1_2;
-        // Example: application/soap+xml;charset=utf-8;action=ActionHex
-        const QList<QByteArray> parts = contentType.split(';');
-        for (const QByteArray &part : std::as_const(parts)) {
-            if (part.trimmed().startsWith("action=")) { // krazy:exclude=strings
-                soapAction = stripQuotes(part.mid(part.indexOf('=') + 1));
-            }
-        }
-    }
+    KDSoap::SoapVersion soapVersion;
+    // Kept by the server object, while the headers are cleared for the next request
+    const QByteArray soapAction = KDSoapHttpHeaders::detached(requestSoapAction(httpHeaders, &soapVersion));
 
     m_method = requestMsg.name();
 
+    QThreadPool *processingPool = server->processingThreadPool();
+    if (processingPool && !replyMsg.isFault()) {
+        QSharedPointer<PooledCall> call(new PooledCall);
+        call->serverObjectInterface = serverObjectInterface;
+        call->requestMsg = requestMsg;
+        call->requestHeaders = requestHeaders;
+        call->soapAction = soapAction;
+        call->path = KDSoapHttpHeaders::detached(pathAndQuery);
+        call->soapEndpoint = routes & KDSoapServerRoutes::SoapEndpoint;
+        call->soapVersion = soapVersion;
+        call->replyMsg = replyMsg;
+        startPooledCall(processingPool, call);
+        return;
+    }
+
     if (!replyMsg.isFault()) {
-        makeCall(serverObjectInterface, requestMsg, replyMsg, requestHeaders, soapAction, pathAndQuery, soapVersion);
+        makeCall(serverObjectInterface, requestMsg, replyMsg, requestHeaders, soapAction, pathAndQuery, routes & KDSoapServerRoutes::SoapEndpoint,
+                 soapVersion);
     }
 
-    if (serverObjectInterface && m_delayedResponse) {
+    if (m_responseStreamed) {
+        m_responseStreamed = false;
+        if (m_responseStream) {
+            // Still streaming. Don't handle the next call until the response is finished.
+            setSocketEnabled(false);
+        }
+    } else if (serverObjectInterface && m_delayedResponse.loadAcquire()) {
         // Delayed response. Disable the socket to make sure we don't handle another call at the same time.
         setSocketEnabled(false);
     } else {
@@ -423,19 +903,83 @@ void KDSoapServerSocket::handleRequest(const QMap<QByteArray, QByteArray> &httpH
     }
 }
 
+// RFC 7231 section 5.3.4
+static bool acceptsGzip(const QByteArray &acceptEncoding)
+{
+    const QList<QByteArray> codings = acceptEncoding.split(',');
+    for (const QByteArray &coding : codings) {
+        const QList<QByteArray> parameters = coding.split(';');
+        if (parameters.first().trimmed().toLower() != "gzip") {
+            continue;
+        }
+        for (int i = 1; i < parameters.size(); ++i) {
+            const QByteArray parameter = parameters.at(i).trimmed();
+            if (parameter.startsWith("q=") && parameter.mid(2).toDouble() <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
 bool KDSoapServerSocket::handleWsdlDownload(KDSoapServerObjectInterface *serverObjectInterface)
 {
-    KDSoapServer *server = m_owner->server();
-    const QString wsdlFile = server->wsdlFile();
-    QFile wf(wsdlFile);
-    if (wf.open(QIODevice::ReadOnly)) {
-        // qDebug() << "Returning wsdl file contents";
-        const QByteArray responseText = wf.readAll();
-        const QByteArray response = httpResponseHeaders(false, "application/xml", responseText.size(), serverObjectInterface);
-        write(response);
-        write(responseText);
+    // Loaded once, see KDSoapWsdlCache
+    const QSharedPointer<const KDSoapWsdlCache::Document> wsdl = m_owner->server()->wsdlCache()->document();
+    if (!wsdl || !wsdl->isLoaded()) {
+        return false;
+    }
+    const bool gzip = wsdl->hasGzip() && acceptsGzip(m_parser.headers().value(KDSoapHttpHeaders::AcceptEncoding));
+    const KDSoapWsdlCache::Variant &variant = gzip ? wsdl->gzip : wsdl->plain;
+    const QByteArray headersEnd = m_connectionHeader + additionalHttpHeaders(serverObjectInterface) + "\r\n";
+    if (isNotModified(variant.etag, wsdl->lastModified)) {
+        writeOutput("HTTP/1.1 304 Not Modified\r\n" + variant.validators + headersEnd);
         return true;
     }
+    writeOutput(variant.headers + headersEnd);
+    if (!m_headRequest) {
+        writeOutput(variant.body); // shared with the cache, not copied
+    }
+    return true;
+}
+
+// ETag and Last-Modified for files, so that clients can revalidate their copy without downloading it again
+static bool fileValidators(QIODevice *device, QByteArray &etag, QDateTime &lastModified)
+{
+    const QFile *file = qobject_cast<QFile *>(device);
+    if (!file) {
+        return false;
+    }
+    const QFileInfo info(*file);
+    lastModified = info.lastModified();
+    if (!lastModified.isValid()) {
+        return false;
+    }
+    etag = '"' + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16) + '-' + QByteArray::number(info.size(), 16) + '"';
+    return true;
+}
+
+// Conditional GET, RFC 7232 sections 3.2, 3.3 and 6
+bool KDSoapServerSocket::isNotModified(const QByteArray &etag, const QDateTime &lastModified) const
+{
+    const KDSoapHttpHeaders &httpHeaders = m_parser.headers();
+    if (httpHeaders.contains(KDSoapHttpHeaders::IfNoneMatch)) {
+        // If-Modified-Since is ignored when If-None-Match is present. Weak comparison.
+        const QList<QByteArray> tags = httpHeaders.value(KDSoapHttpHeaders::IfNoneMatch).split(',');
+        for (const QByteArray &tag : tags) {
+            const QByteArray trimmedTag = tag.trimmed();
+            if (trimmedTag == "*" || trimmedTag == etag || (trimmedTag.startsWith("W/") && trimmedTag.mid(2) == etag)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (httpHeaders.contains(KDSoapHttpHeaders::IfModifiedSince)) {
+        const qint64 since = KDSoapHttpRequestParser::parseHttpDate(httpHeaders.value(KDSoapHttpHeaders::IfModifiedSince));
+        // HTTP dates have a resolution of one second
+        return since >= 0 && lastModified.toMSecsSinceEpoch() / 1000 <= since;
+    }
     return false;
 }
 
@@ -443,11 +987,11 @@ KDSoapServerSocket::FileRange KDSoapServerSocket::determineFileRanges(int fileSi
 {
     QVector<QPair<int, int>> requestedRanges;
 
-    const auto headerIt = m_httpHeaders.constFind("range");
-    if (headerIt == m_httpHeaders.constEnd())
+    const KDSoapHttpHeaders &httpHeaders = m_parser.headers();
+    if (!httpHeaders.contains(KDSoapHttpHeaders::Range))
         return {FileRange::Type::FullFile}; // No Range header present — full file response
 
-    const QByteArray rangeHeader = headerIt.value().trimmed();
+    const QByteArray rangeHeader = httpHeaders.value(KDSoapHttpHeaders::Range).trimmed();
     if (!rangeHeader.startsWith("bytes=")) {
         // Section 3.1 (RFC 7233): Ignore a range header field that contains a range unit the server does not understand
         return {FileRange::Type::FullFile};
@@ -569,24 +1113,10 @@ void KDSoapServerSocket::writeFileRanges(QIODevice *device, const QVector<QPair<
     headers.reserve(500 + additionalHttpHeaders.size()); // Maximum is ~400 bytes plus whatever additionalHttpHeaders gives us.
     headers += "HTTP/1.1 206 Partial Content\r\n";
     headers += "Accept-Ranges: bytes\r\n";
+    headers += m_connectionHeader;
 
-    auto writeRange = [this, device](const QPair<int, int> range) {
-        device->seek(range.first);
-
-        char block[4096] = {0};
-        qint64 totalRead = 0, toRead = range.second - range.first + 1;
-
-        while (!device->atEnd() && toRead > totalRead) {
-            const qint64 in = device->read(block, qMin<qint64>(toRead - totalRead, sizeof(block)));
-            if (in <= 0) {
-                break;
-            }
-            totalRead += in;
-            if (in != write(block, in)) {
-                // error = true;
-                break;
-            }
-        }
+    auto writeRange = [this](const QPair<int, int> range) {
+        writeDeviceOutput(range.first, range.second - range.first + 1);
     };
 
     if (requestedRanges.size() == 1) {
@@ -598,9 +1128,9 @@ void KDSoapServerSocket::writeFileRanges(QIODevice *device, const QVector<QPair<
         headers += "\r\n"; // end of headers
 
         if (m_doDebug) {
-            qDebug() << "KDSoapServerSocket: file download response" << headers;
+            qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: file download response" << headers;
         }
-        write(headers);
+        writeOutput(headers);
 
         writeRange(range);
     } else {
@@ -644,7 +1174,7 @@ void KDSoapServerSocket::writeFileRanges(QIODevice *device, const QVector<QPair<
         headers += "\r\n"; // end headers
 
         if (m_doDebug) {
-            qDebug() << "KDSoapServerSocket: file download response" << headers;
+            qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: file download response" << headers;
         }
 
         // Write first boundary without preceding CRLF
@@ -659,7 +1189,7 @@ void KDSoapServerSocket::writeFileRanges(QIODevice *device, const QVector<QPair<
             headers += "Content-Range: bytes " + QByteArray::number(range.first) + "-" + QByteArray::number(range.second) + "/" + QByteArray::number(device->size()) + "\r\n";
             headers += "\r\n";
 
-            write(headers);
+            writeOutput(headers);
             headers.clear();
 
             // Write the range data
@@ -671,79 +1201,85 @@ void KDSoapServerSocket::writeFileRanges(QIODevice *device, const QVector<QPair<
 
         // Final boundary line has a trailing "--" and CRLF
         headers += "--\r\n";
-        write(headers);
+        writeOutput(headers);
         headers.clear();
     }
 }
 
-bool KDSoapServerSocket::handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QString &path)
+bool KDSoapServerSocket::handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QByteArray &path)
 {
     QByteArray contentType;
-    QIODevice *device = serverObjectInterface->processFileRequest(path, contentType);
+    QIODevice *device = serverObjectInterface->processFileRequest(QString::fromUtf8(path), contentType);
     if (!device) {
-        const QByteArray notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-        write(notFound);
+        if (m_headRequest) {
+            return false; // see handleRequest
+        }
+        writeEmptyResponse("HTTP/1.1 404 Not Found\r\n");
         return true;
     }
     if (!device->open(QIODevice::ReadOnly)) {
-        write(s_forbidden);
+        writeEmptyResponse(s_forbidden);
         delete device;
         return true; // handled!
     }
 
-    if (const auto [rangeType, requestedRanges] = determineFileRanges(device->size()); rangeType == FileRange::Type::InvalidRange) {
-        const QByteArray notSatisfiable = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n";
-        write(notSatisfiable);
-    } else if (rangeType == FileRange::Type::ValidRanges) {
-        writeFileRanges(device, requestedRanges, contentType, additionalHttpHeaders(serverObjectInterface));
+    writeDevice(serverObjectInterface, device, contentType);
+    // TODO log the file request, if logging is enabled?
+    return true;
+}
+
+// Sends the contents of \p device (already opened), which is then deleted
+void KDSoapServerSocket::writeDevice(KDSoapServerObjectInterface *serverObjectInterface, QIODevice *device, const QByteArray &contentType)
+{
+    QByteArray validators;
+    QByteArray etag;
+    QDateTime lastModified;
+    if (fileValidators(device, etag, lastModified)) {
+        validators = "ETag: " + etag + "\r\nLast-Modified: " + KDSoapHttpRequestParser::toHttpDate(lastModified) + "\r\n";
+        if (isNotModified(etag, lastModified)) {
+            delete device;
+            // No Content-Length here, it would have to be the one of the full response (RFC 7230 section 3.3.2)
+            writeOutput("HTTP/1.1 304 Not Modified\r\n" + validators + m_connectionHeader + additionalHttpHeaders(serverObjectInterface) + "\r\n");
+            return;
+        }
+    }
+
+    // Written as the client reads it, see fillOutput
+    Q_ASSERT(!m_outputDevice);
+    m_outputDevice = device;
+    m_outputFileHandle = sendfileHandle();
+
+    // Range requests only apply to GET
+    const FileRange fileRange = m_headRequest ? FileRange{FileRange::Type::FullFile} : determineFileRanges(device->size());
+    if (fileRange.type == FileRange::Type::InvalidRange) {
+        writeEmptyResponse("HTTP/1.1 416 Range Not Satisfiable\r\n");
+    } else if (fileRange.type == FileRange::Type::ValidRanges) {
+        writeFileRanges(device, fileRange.ranges, contentType, validators + additionalHttpHeaders(serverObjectInterface));
     } else {
-        const QByteArray response = httpResponseHeaders(false, contentType, device->size(), serverObjectInterface);
+        const QByteArray response = httpResponseHeaders(false, contentType, device->size(), m_connectionHeader + validators, serverObjectInterface);
         if (m_doDebug) {
-            qDebug() << "KDSoapServerSocket: file download response" << response;
+            qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: file download response" << response;
         }
-        qint64 written = write(response);
-        Q_ASSERT(written == response.size()); // Please report a bug if you hit this.
-        Q_UNUSED(written);
-
-        char block[4096] = {0};
-        // qint64 totalRead = 0;
-        while (!device->atEnd()) {
-            const qint64 in = device->read(block, sizeof(block));
-            if (in <= 0) {
-                break;
-            }
-            // totalRead += in;
-            if (in != write(block, in)) {
-                // error = true;
-                break;
-            }
+        writeOutput(response);
+        if (!m_headRequest) {
+            writeDeviceOutput(0, device->size());
         }
-        // if (totalRead != device->size()) {
-        //    // Unable to read from the source.
-        //    error = true;
-        //}
     }
 
-    delete device;
-    // TODO log the file request, if logging is enabled?
-    return true;
+    if (m_output.isEmpty()) {
+        clearOutput(); // all written already
+    }
 }
 
 void KDSoapServerSocket::writeXML(KDSoapServerObjectInterface *serverObjectInterface, const QByteArray &xmlResponse, bool isFault)
 {
-    const QByteArray httpHeaders = httpResponseHeaders(isFault, serverObjectInterface->requestVersion() == KDSoap::SoapVersion::SOAP1_1 ? "text/xml" : "application/soap+xml;charset=utf-8",
-                                                       xmlResponse.size(), serverObjectInterface);
+    const QByteArray httpHeaders =
+        httpResponseHeaders(isFault, soapContentType(serverObjectInterface->requestVersion()), xmlResponse.size(), m_connectionHeader, serverObjectInterface);
     if (m_doDebug) {
-        qDebug() << "KDSoapServerSocket: writing" << httpHeaders << xmlResponse;
-    }
-    qint64 written = write(httpHeaders);
-    if (written != httpHeaders.size()) {
-        qWarning() << "Only wrote" << written << "out of" << httpHeaders.size() << "bytes of HTTP headers. Error:" << errorString();
-    }
-    written = write(xmlResponse);
-    if (written != xmlResponse.size()) {
-        qWarning() << "Only wrote" << written << "out of" << xmlResponse.size() << "bytes of response. Error:" << errorString();
+        qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: writing" << httpHeaders << xmlResponse;
     }
+    writeOutput(httpHeaders);
+    writeOutput(xmlResponse);
 }
 
 void KDSoapServerSocket::sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
@@ -772,9 +1308,14 @@ void KDSoapServerSocket::sendReply(KDSoapServerObjectInterface *serverObjectInte
     writeXML(serverObjectInterface, xmlResponse, isFault);
 
     // All done, check if we should log this
+    logCall(replyMsg);
+}
+
+void KDSoapServerSocket::logCall(const KDSoapMessage &replyMsg)
+{
+    const bool isFault = replyMsg.isFault();
     KDSoapServer *server = m_owner->server();
-    const KDSoapServer::LogLevel logLevel =
-        server->logLevel(); // we do this here in order to support dynamic settings changes (at the price of a mutex)
+    const KDSoapServer::LogLevel logLevel = server->logLevel(); // we do this here in order to support dynamic settings changes (no lock needed)
     if (logLevel != KDSoapServer::LogNothing) {
         if (logLevel == KDSoapServer::LogEveryCall || (logLevel == KDSoapServer::LogFaults && isFault)) {
 
@@ -787,16 +1328,125 @@ void KDSoapServerSocket::sendReply(KDSoapServerObjectInterface *serverObjectInte
     }
 }
 
+KDSoapResponseStream *KDSoapServerSocket::startStreamedResponse(KDSoapServerObjectInterface *serverObjectInterface, const QString &responseName)
+{
+    if (m_responseStreamed || m_responseStream) {
+        qWarning("startStreamedResponse: a response was already started for this call");
+        return nullptr;
+    }
+    if (QThread::currentThread() != thread()) {
+        qWarning("startStreamedResponse: not available when the call is processed by KDSoapServer::processingThreadPool()");
+        return nullptr;
+    }
+
+    // HTTP/1.0 clients don't know about chunked encoding, the response ends when the connection is closed instead
+    m_streamChunked = m_parser.headers().httpVersion() != "HTTP/1.0";
+    if (!m_streamChunked) {
+        m_keepAlive = false;
+        m_connectionHeader = "Connection: close\r\n";
+    }
+
+    QByteArray httpHeaders = "HTTP/1.1 200 OK\r\nContent-Type: ";
+    httpHeaders += soapContentType(serverObjectInterface->requestVersion());
+    httpHeaders += "\r\n";
+    if (m_streamChunked) {
+        httpHeaders += "Transfer-Encoding: chunked\r\n";
+    }
+    httpHeaders += m_connectionHeader;
+    httpHeaders += additionalHttpHeaders(serverObjectInterface);
+    httpHeaders += "\r\n"; // end of headers
+    if (m_doDebug) {
+        qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: streaming response" << httpHeaders;
+    }
+    writeOutput(httpHeaders);
+
+    const QString responseNamespace =
+        serverObjectInterface->responseNamespace().isEmpty() ? m_messageNamespace : serverObjectInterface->responseNamespace();
+    auto *writer = new KDSoapStreamedMessageWriter(serverObjectInterface->requestVersion(), responseNamespace, m_owner->server()->use());
+    m_responseStreamed = true;
+    m_responseStream = new KDSoapResponseStream(this, writer);
+    writeResponseChunk(writer->start(responseName.isEmpty() ? m_method : responseName, serverObjectInterface->responseHeaders()));
+    return m_responseStream;
+}
+
+void KDSoapServerSocket::writeResponseChunk(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return; // an empty chunk would mark the end of the response
+    }
+    if (m_doDebug) {
+        qCDebug(kdsoapServerDebug) << "KDSoapServerSocket: writing" << data;
+    }
+    if (m_streamChunked) {
+        writeOutput(QByteArray::number(data.size(), 16) + "\r\n");
+        writeOutput(data);
+        writeOutput(QByteArrayLiteral("\r\n"));
+    } else {
+        writeOutput(data);
+    }
+}
+
+void KDSoapServerSocket::endStreamedResponse()
+{
+    if (m_streamChunked) {
+        writeOutput(QByteArrayLiteral("0\r\n\r\n")); // last chunk, no trailers
+    }
+    logCall(KDSoapMessage());
+    m_responseStream = nullptr;
+    if (!m_socketEnabled) { // otherwise we're still in handleRequest, which takes care of the next request
+        responseDone();
+    }
+}
+
+// Like a delayed response: the socket is disabled until the reply is sent, see slotPooledCallDone
+void KDSoapServerSocket::startPooledCall(QThreadPool *pool, const QSharedPointer<PooledCall> &call)
+{
+    call->socket = this;
+    call->server = m_owner->server();
+    call->server->requestQueued();
+    m_pooledCall = call;
+    setSocketEnabled(false);
+    pool->start(new PooledCallRunnable(call));
+}
+
+void KDSoapServerSocket::slotPooledCallDone()
+{
+    const QSharedPointer<PooledCall> call = m_pooledCall;
+    m_pooledCall.reset();
+    if (!call) {
+        return;
+    }
+    if (state() == QAbstractSocket::UnconnectedState) {
+        deleteLater(); // the client went away during the call, see slotDisconnected
+        return;
+    }
+    if (!call->processed) {
+        handleError(call->replyMsg, "Server.Unavailable", QString::fromLatin1("The call was cancelled by the server"), call->soapVersion);
+    }
+    if (!m_delayedResponse.loadAcquire()) { // otherwise the server object calls sendDelayedResponse later
+        sendReply(call->serverObjectInterface, call->replyMsg);
+    }
+    responseDone();
+}
+
+void KDSoapServerSocket::slotDisconnected()
+{
+    if (m_pooledCall) {
+        return; // m_serverObject is in use, deleted in slotPooledCallDone
+    }
+    deleteLater();
+}
+
 void KDSoapServerSocket::sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg)
 {
     sendReply(serverObjectInterface, replyMsg);
-    m_delayedResponse = false;
-    setSocketEnabled(true);
+    m_delayedResponse.storeRelease(0);
+    responseDone();
 }
 
 void KDSoapServerSocket::setResponseDelayed()
 {
-    m_delayedResponse = true;
+    m_delayedResponse.storeRelease(1);
 }
 
 void KDSoapServerSocket::handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error, KDSoap::SoapVersion soapVersion)
@@ -806,7 +1456,8 @@ void KDSoapServerSocket::handleError(KDSoapMessage &replyMsg, const char *errorC
 }
 
 void KDSoapServerSocket::makeCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg,
-                                  const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QString &path, KDSoap::SoapVersion soapVersion)
+                                  const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QByteArray &path, bool soapEndpoint,
+                                  KDSoap::SoapVersion soapVersion)
 {
     Q_ASSERT(serverObjectInterface);
 
@@ -822,9 +1473,8 @@ void KDSoapServerSocket::makeCall(KDSoapServerObjectInterface *serverObjectInter
         serverObjectInterface->setRequestHeaders(requestHeaders, soapAction);
         serverObjectInterface->setRequestVersion(soapVersion);
 
-        KDSoapServer *server = m_owner->server();
-        if (path != server->path()) {
-            serverObjectInterface->processRequestWithPath(requestMsg, replyMsg, soapAction, path);
+        if (!soapEndpoint) {
+            serverObjectInterface->processRequestWithPath(requestMsg, replyMsg, soapAction, QString::fromUtf8(path));
         } else {
             serverObjectInterface->processRequest(requestMsg, replyMsg, soapAction);
         }
@@ -17,15 +17,28 @@
 #include <QSslSocket>
 #endif
 
+#include "KDSoapHttpRequestParser_p.h"
 #include <KDSoapClient/KDSoapClientInterface.h>
+#include <KDSoapClient/KDSoapMessage.h>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QMap>
+#include <QMutex>
+#include <QPointer>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QTimer>
 QT_BEGIN_NAMESPACE
+class QDateTime;
 class QObject;
+class QSocketNotifier;
+class QThreadPool;
 QT_END_NAMESPACE
+class KDSoapServer;
 class KDSoapSocketList;
 class KDSoapServerObjectInterface;
-class KDSoapMessage;
-class KDSoapHeaders;
+class KDSoapResponseStream;
+struct KDSoapServerThreadLoad;
 
 class KDSoapServerSocket
 #ifndef QT_NO_SSL
@@ -42,14 +55,21 @@ public:
     void setResponseDelayed();
     void sendDelayedReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
     void sendReply(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &replyMsg);
+    void drain(int msecs);
+    KDSoapResponseStream *startStreamedResponse(KDSoapServerObjectInterface *serverObjectInterface, const QString &responseName);
 Q_SIGNALS:
     void socketDeleted(KDSoapServerSocket *);
 
 private Q_SLOTS:
     void slotReadyRead();
+    void slotIdleTimeout();
+    void slotBytesWritten();
+    void slotSendfileReady();
+    void slotDisconnected();
+    void slotPooledCallDone();
 
 private:
-    void handleRequest(const QMap<QByteArray, QByteArray> &headers, const QByteArray &receivedData);
+    void handleRequest(const KDSoapHttpHeaders &httpHeaders, const QByteArray &receivedData);
     bool handleWsdlDownload(KDSoapServerObjectInterface *serverObjectInterface);
 
     struct FileRange
@@ -65,32 +85,115 @@ private:
     FileRange determineFileRanges(int fileSize) const;
 
     void writeFileRanges(QIODevice *device, const QVector<QPair<int, int>> &requestedRanges, const QByteArray &contentType, const QByteArray &additionalHttpHeaders);
-    bool handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QString &path);
-    void makeCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg,
-                  const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QString &path, KDSoap::SoapVersion soapVersion);
-    void handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error, KDSoap::SoapVersion soapVersion = KDSoap::SoapVersion::SOAP1_1);
+    void writeOutput(const QByteArray &data);
+    void writeDeviceOutput(qint64 offset, qint64 length);
+    void fillOutput();
+    void continueOutput();
+    void clearOutput();
+    void responseDone();
+    bool canWriteMore() const;
+    bool isOutputDrained() const;
+    bool handleFileDownload(KDSoapServerObjectInterface *serverObjectInterface, const QByteArray &path);
+    void writeDevice(KDSoapServerObjectInterface *serverObjectInterface, QIODevice *device, const QByteArray &contentType);
+    bool isNotModified(const QByteArray &etag, const QDateTime &lastModified) const;
+    static void makeCall(KDSoapServerObjectInterface *serverObjectInterface, const KDSoapMessage &requestMsg, KDSoapMessage &replyMsg,
+                  const KDSoapHeaders &requestHeaders, const QByteArray &soapAction, const QByteArray &path, bool soapEndpoint,
+                  KDSoap::SoapVersion soapVersion);
+    static void handleError(KDSoapMessage &replyMsg, const char *errorCode, const QString &error, KDSoap::SoapVersion soapVersion = KDSoap::SoapVersion::SOAP1_1);
     void setSocketEnabled(bool enabled);
+    bool admitRequest(const KDSoapHttpHeaders &httpHeaders);
+    void discardInput();
+    void shutdownOutput();
+    void admittedRequestDone();
+    void requestStarted();
+    void requestFinished();
+    bool prepareForNextRequest();
+    void releaseServerObject();
+    void restartIdleTimer();
+    void writeEmptyResponse(const QByteArray &statusLineAndHeaders);
     void writeXML(KDSoapServerObjectInterface *serverObjectInterface, const QByteArray &xmlResponse, bool isFault);
+    void writeResponseChunk(const QByteArray &data);
+    void endStreamedResponse();
+    void logCall(const KDSoapMessage &replyMsg);
     friend class KDSoapServerObjectInterface;
+    friend class KDSoapResponseStream;
 
-    KDSoapSocketList *m_owner;
+    QPointer<KDSoapSocketList> m_owner; // the sockets can outlive it, when the server is deleted
     QObject *m_serverObject;
-    bool m_delayedResponse;
+    bool m_leaseServerObject; // from m_owner, for each request, see KDSoapServer::setServerObjectPoolSize
+    // Set by KDSoapDelayedResponseHandle, in the processing pool's thread for pooled calls, see startPooledCall
+    QAtomicInt m_delayedResponse;
     bool m_doDebug;
     bool m_socketEnabled;
     bool m_receivedData;
+    bool m_requestAdmitted; // see KDSoapServer::setMaxInFlightRequests
+    bool m_requestRejected; // the connection is closed once the body is discarded, see admitRequest
+    qint64 m_inputToDiscard; // -1 until the client closes the connection
+    bool m_shutdownPending; // see shutdownOutput
+
+    // Persistent connection
+    QTimer m_idleTimer;
+    int m_requestCount;
+
+    // For balancing the connections between the threads of a KDSoapThreadPool
+    KDSoapServerThreadLoad *m_threadLoad; // nullptr without thread pool
+    QElapsedTimer m_requestTimer; // valid while a request is in flight
 
     // Current request being assembled
     bool m_useRawXML;
-    int m_bytesReceived;
-    int m_chunkStart;
-    QMap<QByteArray, QByteArray> m_httpHeaders;
-    QByteArray m_requestBuffer;
-    QByteArray m_decodedRequestBuffer; // used for chunked transfer encoding only
+    KDSoapHttpRequestParser m_parser;
+    bool m_keepAlive;
+    bool m_draining; // no new request after the current one, see drain()
+    bool m_headRequest;
+    QByteArray m_connectionHeader; // for the response
 
     // Data for the current call (stored here for delayed replies)
     QString m_messageNamespace;
     QString m_method;
+
+    // Response data waiting to be written, once the client has read what's in the socket's write buffer
+    struct OutputPart
+    {
+        QByteArray data; // unless fromDevice
+        bool fromDevice;
+        qint64 offset;
+        qint64 length; // still to be written
+    };
+    int sendfileHandle() const;
+    bool sendFileData(OutputPart &part);
+    QVector<OutputPart> m_output;
+    QIODevice *m_outputDevice; // for the parts with fromDevice, deleted once they are written
+    int m_outputFileHandle; // to send m_outputDevice with sendfile(), see sendfileHandle()
+    QSocketNotifier *m_sendfileNotifier;
+    QByteArray m_outputBlock; // to copy from m_outputDevice otherwise
+
+    // Streamed response
+    QPointer<KDSoapResponseStream> m_responseStream; // until it's finished
+    bool m_responseStreamed; // during handleRequest
+    bool m_streamChunked; // false for HTTP/1.0 clients, the end of the response is then the end of the connection
+
+    // SOAP call processed by the server's processing thread pool, see KDSoapServer::setProcessingThreadPool
+    struct PooledCall
+    {
+        KDSoapServerObjectInterface *serverObjectInterface = nullptr;
+        KDSoapMessage requestMsg;
+        KDSoapHeaders requestHeaders;
+        QByteArray soapAction;
+        QByteArray path;
+        bool soapEndpoint = true;
+        KDSoap::SoapVersion soapVersion = KDSoap::SoapVersion::SOAP1_1;
+        KDSoapMessage replyMsg;
+        bool processed = false; // false if the pool dropped the call without running it
+        bool dequeued = false; // see KDSoapServer::setMaxQueuedRequests
+        KDSoapServer *server = nullptr;
+
+        QMutex mutex; // protects socket
+        KDSoapServerSocket *socket = nullptr; // reset when the socket is deleted first
+        QSemaphore finished; // released once the pool's thread is done with the call
+    };
+    class PooledCallRunnable;
+    void startPooledCall(QThreadPool *pool, const QSharedPointer<PooledCall> &call);
+    QSharedPointer<PooledCall> m_pooledCall; // until the reply is back in this thread
 };
 
 #endif // KDSOAPSERVERSOCKET_P_H
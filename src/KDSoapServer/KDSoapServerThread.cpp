@@ -8,18 +8,74 @@
 **
 ****************************************************************************/
 #include "KDSoapServer.h"
+#include "KDSoapServerAcceptor_p.h"
 #include "KDSoapServerSocket_p.h"
 #include "KDSoapServerThread_p.h"
 #include "KDSoapSocketList_p.h"
 
+#include <QCoreApplication>
+#include <QDeadlineTimer>
 #include <QMetaType>
+#include <QTcpSocket>
+
+#include <climits>
+#ifdef Q_OS_LINUX
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Does nothing with an empty list
+static void setCurrentThreadCpuSet(const QList<int> &cpus)
+{
+#ifdef Q_OS_LINUX
+    if (cpus.isEmpty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        qWarning("KDSoapThreadPool: failed to set the CPU affinity of a thread: %s", strerror(error));
+    }
+#else
+    Q_UNUSED(cpus);
+#endif
+}
+
+QList<int> KDSoapServerThread::currentThreadCpuSet()
+{
+    QList<int> cpus;
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) { // 0: the calling thread
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.append(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
 
 KDSoapServerThread::KDSoapServerThread(QObject *parent)
     : QThread(parent)
     , d(nullptr)
+    , m_draining(false)
+    , m_cpuSetIndex(-1)
 {
+    m_load.lastActivity.storeRelease(QDeadlineTimer::current().deadline());
     qRegisterMetaType<KDSoapServer *>("KDSoapServer*");
     qRegisterMetaType<QSemaphore *>("QSemaphore*");
+    qRegisterMetaType<QHostAddress>("QHostAddress");
+    qRegisterMetaType<QList<int>>("QList<int>");
 }
 
 KDSoapServerThread::~KDSoapServerThread()
@@ -28,19 +84,31 @@ KDSoapServerThread::~KDSoapServerThread()
 
 void KDSoapServerThread::run()
 {
-    KDSoapServerThreadImpl impl;
+    // Before allocating anything, so that the memory of the thread is local to its CPUs
+    if (!m_cpuSet.isEmpty()) {
+        setCurrentThreadCpuSet(m_cpuSet);
+    }
+    KDSoapServerThreadImpl impl(&m_load, &m_pendingConnections);
     d = &impl;
     m_semaphore.release();
     exec();
     d = nullptr;
-}
 
-int KDSoapServerThread::socketCount() const
-{
-    if (d) {
-        return d->socketCount();
+    // Like queued calls, connections handed over while the thread was quitting are dropped.
+    // Close them, and undo what handleIncomingConnection and KDSoapServer::admitConnection counted for them,
+    // as the socket's destructor would have done.
+    KDSoapPendingConnection *connection = m_pendingConnections.takeAll();
+    while (connection) {
+        QTcpSocket socket;
+        if (socket.setSocketDescriptor(connection->socketDescriptor)) {
+            socket.abort();
+        }
+        m_load.connectionRemoved();
+        connection->server->connectionClosed(); // for maxConnections and drained()
+        KDSoapPendingConnection *next = connection->next;
+        delete connection;
+        connection = next;
     }
-    return 0;
 }
 
 int KDSoapServerThread::socketCountForServer(const KDSoapServer *server) const
@@ -66,15 +134,54 @@ void KDSoapServerThread::resetTotalConnectionCountForServer(const KDSoapServer *
     }
 }
 
-void KDSoapServerThread::disconnectSocketsForServer(KDSoapServer *server, QSemaphore &semaphore)
+QHash<const KDSoapServer *, int> KDSoapServerThread::totalConnectionCounts() const
+{
+    if (d) {
+        return d->totalConnectionCounts();
+    }
+    return QHash<const KDSoapServer *, int>();
+}
+
+void KDSoapServerThread::disconnectSocketsForServer(KDSoapServer *server, QSemaphore &semaphore, int drainTimeout)
 {
     if (d) {
         // clang-format off
-        QMetaObject::invokeMethod(d, "disconnectSocketsForServer", Q_ARG(KDSoapServer*, server), Q_ARG(QSemaphore*, &semaphore));
+        QMetaObject::invokeMethod(d, "disconnectSocketsForServer", Q_ARG(KDSoapServer*, server), Q_ARG(QSemaphore*, &semaphore),
+                                  Q_ARG(int, drainTimeout));
         // clang-format on
     }
 }
 
+void KDSoapServerThread::removeServer(KDSoapServer *server, QSemaphore &semaphore)
+{
+    if (d) {
+        // clang-format off
+        QMetaObject::invokeMethod(d, "removeServer", Q_ARG(KDSoapServer*, server), Q_ARG(QSemaphore*, &semaphore));
+        // clang-format on
+    } else {
+        semaphore.release();
+    }
+}
+
+// Blocks until the thread listens (or failed to)
+bool KDSoapServerThread::startAcceptor(KDSoapServer *server, const QHostAddress &address, quint16 port)
+{
+    bool ok = false;
+    // clang-format off
+    QMetaObject::invokeMethod(d, "startAcceptor", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, ok), Q_ARG(KDSoapServer*, server),
+                              Q_ARG(QHostAddress, address), Q_ARG(int, port));
+    // clang-format on
+    return ok;
+}
+
+// Blocks until the thread stopped listening, so that no new connection is accepted for the server
+void KDSoapServerThread::stopAcceptor(KDSoapServer *server)
+{
+    // clang-format off
+    QMetaObject::invokeMethod(d, "stopAcceptor", Qt::BlockingQueuedConnection, Q_ARG(KDSoapServer*, server));
+    // clang-format on
+}
+
 void KDSoapServerThread::startThread()
 {
     QThread::start();
@@ -86,37 +193,70 @@ void KDSoapServerThread::quitThread()
     QMetaObject::invokeMethod(d, "quit");
 }
 
+void KDSoapServerThread::setCpuSet(int index, const QList<int> &cpus)
+{
+    m_cpuSetIndex = index;
+    if (d) {
+        // clang-format off
+        QMetaObject::invokeMethod(d, "setCpuSet", Q_ARG(QList<int>, cpus));
+        // clang-format on
+    } else {
+        m_cpuSet = cpus; // not started yet
+    }
+}
+
+// Called by KDSoapThreadPool, in the server's thread.
+// Only the first of a burst of connections posts an event, the thread then handles them all at once.
 void KDSoapServerThread::handleIncomingConnection(int socketDescriptor, KDSoapServer *server)
 {
-    d->addIncomingConnection();
-    // clang-format off
-    QMetaObject::invokeMethod(d, "handleIncomingConnection", Q_ARG(int, socketDescriptor), Q_ARG(KDSoapServer*, server));
-    // clang-format on
+    m_load.connectionAdded(); // removed when the socket is deleted
+    if (m_pendingConnections.push(new KDSoapPendingConnection{socketDescriptor, server, nullptr})) {
+        QCoreApplication::postEvent(d, new QEvent(KDSoapServerThreadImpl::PendingConnectionsEvent));
+    }
 }
 
 ////
 
-KDSoapServerThreadImpl::KDSoapServerThreadImpl()
-    : QObject(nullptr)
-    , m_incomingConnectionCount(0)
+void KDSoapServerThreadLoad::connectionAdded()
 {
+    lastActivity.storeRelease(QDeadlineTimer::current().deadline());
+    connections.ref();
 }
 
-KDSoapServerThreadImpl::~KDSoapServerThreadImpl()
+void KDSoapServerThreadLoad::connectionRemoved()
 {
-    qDeleteAll(m_socketLists);
+    lastActivity.storeRelease(QDeadlineTimer::current().deadline());
+    connections.deref();
 }
 
-// Called from main thread!
-int KDSoapServerThreadImpl::socketCount()
+void KDSoapServerThreadLoad::requestStarted()
 {
-    QMutexLocker lock(&m_socketListMutex);
-    int sc = 0;
-    for (KDSoapSocketList *socketList : std::as_const(m_socketLists)) {
-        sc += socketList->socketCount();
-    }
-    sc += m_incomingConnectionCount.loadAcquire();
-    return sc;
+    requestsInFlight.ref();
+}
+
+void KDSoapServerThreadLoad::requestFinished(qint64 usecs)
+{
+    requestsInFlight.deref();
+    // Exponential moving average, weighing the last request 1/8. Only this thread writes it.
+    const qint64 latency = recentLatency.loadAcquire();
+    recentLatency.storeRelease(int(qBound<qint64>(0, latency + (usecs - latency) / 8, INT_MAX)));
+}
+
+////
+
+const QEvent::Type KDSoapServerThreadImpl::PendingConnectionsEvent = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+KDSoapServerThreadImpl::KDSoapServerThreadImpl(KDSoapServerThreadLoad *load, KDSoapPendingConnectionQueue *pendingConnections)
+    : QObject(nullptr)
+    , m_load(load)
+    , m_pendingConnections(pendingConnections)
+{
+}
+
+KDSoapServerThreadImpl::~KDSoapServerThreadImpl()
+{
+    qDeleteAll(m_acceptors);
+    qDeleteAll(m_socketLists);
 }
 
 KDSoapSocketList *KDSoapServerThreadImpl::socketListForServer(KDSoapServer *server)
@@ -126,16 +266,11 @@ KDSoapSocketList *KDSoapServerThreadImpl::socketListForServer(KDSoapServer *serv
         return sockets;
     }
 
-    sockets = new KDSoapSocketList(server); // creates the server object
+    sockets = new KDSoapSocketList(server, m_load); // creates the server object
     m_socketLists.insert(server, sockets);
     return sockets;
 }
 
-void KDSoapServerThreadImpl::addIncomingConnection()
-{
-    m_incomingConnectionCount.fetchAndAddAcquire(1);
-}
-
 // Called in the thread itself so that the socket list and server object
 // are created in the thread.
 void KDSoapServerThreadImpl::handleIncomingConnection(int socketDescriptor, KDSoapServer *server)
@@ -144,7 +279,62 @@ void KDSoapServerThreadImpl::handleIncomingConnection(int socketDescriptor, KDSo
     KDSoapSocketList *sockets = socketListForServer(server);
     KDSoapServerSocket *socket = sockets->handleIncomingConnection(socketDescriptor);
     Q_UNUSED(socket);
-    m_incomingConnectionCount.fetchAndAddAcquire(-1);
+}
+
+void KDSoapServerThreadImpl::customEvent(QEvent *event)
+{
+    if (event->type() == PendingConnectionsEvent) {
+        handlePendingConnections();
+    } else {
+        QObject::customEvent(event);
+    }
+}
+
+void KDSoapServerThreadImpl::handlePendingConnections()
+{
+    KDSoapPendingConnection *connection = m_pendingConnections->takeAll();
+    QMutexLocker lock(&m_socketListMutex);
+    KDSoapServer *server = nullptr;
+    KDSoapSocketList *sockets = nullptr;
+    while (connection) {
+        if (connection->server != server) { // usually all the connections are for the same server
+            server = connection->server;
+            sockets = socketListForServer(server);
+        }
+        sockets->handleIncomingConnection(connection->socketDescriptor);
+        KDSoapPendingConnection *next = connection->next;
+        delete connection;
+        connection = next;
+    }
+}
+
+// A connection accepted by this thread's KDSoapServerAcceptor, already counted by KDSoapServer::admitConnection
+void KDSoapServerThreadImpl::acceptConnection(int socketDescriptor, KDSoapServer *server)
+{
+    m_load->connectionAdded(); // removed when the socket is deleted
+    handleIncomingConnection(socketDescriptor, server);
+}
+
+bool KDSoapServerThreadImpl::startAcceptor(KDSoapServer *server, const QHostAddress &address, int port)
+{
+    delete m_acceptors.take(server);
+    KDSoapServerAcceptor *acceptor = new KDSoapServerAcceptor(server, this);
+    if (!KDSoapServerAcceptor::listenReusePort(acceptor, address, quint16(port))) {
+        delete acceptor;
+        return false;
+    }
+    m_acceptors.insert(server, acceptor);
+    return true;
+}
+
+void KDSoapServerThreadImpl::stopAcceptor(KDSoapServer *server)
+{
+    delete m_acceptors.take(server);
+}
+
+void KDSoapServerThreadImpl::setCpuSet(const QList<int> &cpus)
+{
+    setCurrentThreadCpuSet(cpus);
 }
 
 void KDSoapServerThreadImpl::quit()
@@ -159,12 +349,27 @@ int KDSoapServerThreadImpl::socketCountForServer(const KDSoapServer *server)
     return sockets ? sockets->socketCount() : 0;
 }
 
-void KDSoapServerThreadImpl::disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore)
+void KDSoapServerThreadImpl::disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore, int drainTimeout)
 {
     QMutexLocker lock(&m_socketListMutex);
     KDSoapSocketList *sockets = m_socketLists.value(server);
     if (sockets) {
-        sockets->disconnectAll();
+        sockets->disconnectAll(drainTimeout);
+    }
+    semaphore->release();
+}
+
+// Called when the server is deleted, while the thread keeps running for other servers:
+// its acceptor, its sockets (and server objects) and the connections handed over for it go away with it.
+void KDSoapServerThreadImpl::removeServer(KDSoapServer *server, QSemaphore *semaphore)
+{
+    delete m_acceptors.take(server);
+    handlePendingConnections(); // the ones for other servers are handled as usual
+    QMutexLocker lock(&m_socketListMutex);
+    KDSoapSocketList *sockets = m_socketLists.take(server);
+    if (sockets) {
+        sockets->deleteAll(); // waits for their calls in the processing thread pool, if any
+        delete sockets;
     }
     semaphore->release();
 }
@@ -184,3 +389,13 @@ void KDSoapServerThreadImpl::resetTotalConnectionCountForServer(const KDSoapServ
         sockets->resetTotalConnectionCount();
     }
 }
+
+QHash<const KDSoapServer *, int> KDSoapServerThreadImpl::totalConnectionCounts()
+{
+    QMutexLocker lock(&m_socketListMutex);
+    QHash<const KDSoapServer *, int> counts;
+    for (auto it = m_socketLists.constBegin(); it != m_socketLists.constEnd(); ++it) {
+        counts.insert(it.key(), it.value()->totalConnectionCount());
+    }
+    return counts;
+}
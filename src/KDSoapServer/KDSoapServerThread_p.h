@@ -10,41 +10,115 @@
 #ifndef KDSOAPSERVERTHREAD_P_H
 #define KDSOAPSERVERTHREAD_P_H
 
+#include <QAtomicPointer>
+#include <QEvent>
 #include <QHash>
+#include <QHostAddress>
+#include <QList>
 #include <QMutex>
 #include <QSemaphore>
 #include <QThread>
 class KDSoapServer;
+class KDSoapServerAcceptor;
 class KDSoapSocketList;
 
+// How busy a thread is, read by KDSoapThreadPool without locking when choosing the thread for a new connection.
+// Only the thread itself updates the request counters.
+struct KDSoapServerThreadLoad
+{
+    QAtomicInt connections; // including the ones not yet handled by the thread
+    QAtomicInt requestsInFlight; // received but not answered yet
+    QAtomicInt recentLatency; // moving average of the time to answer a request, in microseconds
+    QAtomicInteger<qint64> lastActivity; // when a connection was last added or removed, see QDeadlineTimer::current()
+
+    void connectionAdded();
+    void connectionRemoved();
+    void requestStarted();
+    void requestFinished(qint64 usecs);
+};
+
+// A connection handed over to a thread, see KDSoapServerThread::handleIncomingConnection
+struct KDSoapPendingConnection
+{
+    int socketDescriptor;
+    KDSoapServer *server;
+    KDSoapPendingConnection *next;
+};
+
+// Connections pushed by any thread, without locking, and taken all at once by the thread which handles them.
+// It's a stack, only emptied as a whole, so there's no ABA problem; takeAll() restores the order.
+class KDSoapPendingConnectionQueue
+{
+public:
+    // Returns true if the queue was empty, i.e. the consumer has to be woken up
+    bool push(KDSoapPendingConnection *connection)
+    {
+        KDSoapPendingConnection *head = m_head.loadRelaxed();
+        do {
+            connection->next = head;
+        } while (!m_head.testAndSetRelease(head, connection, head));
+        return head == nullptr;
+    }
+
+    // Returns the connections in the order they were pushed, as a linked list
+    KDSoapPendingConnection *takeAll()
+    {
+        KDSoapPendingConnection *connection = m_head.fetchAndStoreAcquire(nullptr);
+        KDSoapPendingConnection *reversed = nullptr;
+        while (connection) {
+            KDSoapPendingConnection *next = connection->next;
+            connection->next = reversed;
+            reversed = connection;
+            connection = next;
+        }
+        return reversed;
+    }
+
+private:
+    QAtomicPointer<KDSoapPendingConnection> m_head;
+};
+
 // clazy:excludeall=ctor-missing-parent-argument
 class KDSoapServerThreadImpl : public QObject
 {
     Q_OBJECT
 public:
-    KDSoapServerThreadImpl(); // created on stack, clazy:exclude=ctor-missing-parent-argument
+    // created on stack, clazy:exclude=ctor-missing-parent-argument
+    KDSoapServerThreadImpl(KDSoapServerThreadLoad *load, KDSoapPendingConnectionQueue *pendingConnections);
     ~KDSoapServerThreadImpl();
 
+    // Posted when connections are pushed into an empty queue, see KDSoapServerThread::handleIncomingConnection
+    static const QEvent::Type PendingConnectionsEvent;
+
 public Q_SLOTS:
-    void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
-    void disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore);
+    void disconnectSocketsForServer(KDSoapServer *server, QSemaphore *semaphore, int drainTimeout);
+    void removeServer(KDSoapServer *server, QSemaphore *semaphore);
+    bool startAcceptor(KDSoapServer *server, const QHostAddress &address, int port);
+    void stopAcceptor(KDSoapServer *server);
+    void setCpuSet(const QList<int> &cpus);
     void quit();
 
 public:
-    int socketCount();
+    void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
+    void acceptConnection(int socketDescriptor, KDSoapServer *server);
     int socketCountForServer(const KDSoapServer *server);
     int totalConnectionCountForServer(const KDSoapServer *server);
     void resetTotalConnectionCountForServer(const KDSoapServer *server);
+    QHash<const KDSoapServer *, int> totalConnectionCounts();
 
-    void addIncomingConnection();
+protected:
+    void customEvent(QEvent *event) override;
 
 private:
+    void handlePendingConnections();
     QMutex m_socketListMutex;
     KDSoapSocketList *socketListForServer(KDSoapServer *server);
     typedef QHash<KDSoapServer *, KDSoapSocketList *> SocketLists;
     SocketLists m_socketLists;
+    QHash<KDSoapServer *, KDSoapServerAcceptor *> m_acceptors; // see KDSoapServer::listenInThreads
 
-    QAtomicInt m_incomingConnectionCount;
+    KDSoapServerThreadLoad *m_load;
+    KDSoapPendingConnectionQueue *m_pendingConnections;
 };
 
 class KDSoapServerThread : public QThread
@@ -57,13 +131,40 @@ public:
     void startThread();
     void quitThread();
 
-    int socketCount() const;
+    const KDSoapServerThreadLoad &load() const
+    {
+        return m_load;
+    }
     int socketCountForServer(const KDSoapServer *server) const;
     int totalConnectionCountForServer(const KDSoapServer *server) const;
     void resetTotalConnectionCountForServer(const KDSoapServer *server);
+    QHash<const KDSoapServer *, int> totalConnectionCounts() const;
+
+    // A draining thread gets no new connections (and has no acceptors), and is stopped once it has none left,
+    // unless the maximum is raised again meanwhile. Only used by KDSoapThreadPool, under its mutex.
+    void setDraining(bool draining)
+    {
+        m_draining = draining;
+    }
+    bool isDraining() const
+    {
+        return m_draining;
+    }
+
+    // The CPUs this thread runs on, see KDSoapThreadPool::setCpuAffinity. Only used by KDSoapThreadPool, under its mutex.
+    void setCpuSet(int index, const QList<int> &cpus);
+    // The CPUs the calling thread may run on. Empty if unknown, i.e. on other platforms than Linux.
+    static QList<int> currentThreadCpuSet();
+    int cpuSetIndex() const
+    {
+        return m_cpuSetIndex;
+    }
 
-    void disconnectSocketsForServer(KDSoapServer *server, QSemaphore &semaphore);
+    void disconnectSocketsForServer(KDSoapServer *server, QSemaphore &semaphore, int drainTimeout);
+    void removeServer(KDSoapServer *server, QSemaphore &semaphore);
     void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
+    bool startAcceptor(KDSoapServer *server, const QHostAddress &address, quint16 port);
+    void stopAcceptor(KDSoapServer *server);
 
 protected:
     virtual void run() override;
@@ -73,6 +174,11 @@ private:
     void quit(); // use quitThread instead
     KDSoapServerThreadImpl *d;
     QSemaphore m_semaphore;
+    KDSoapServerThreadLoad m_load;
+    KDSoapPendingConnectionQueue m_pendingConnections;
+    bool m_draining;
+    int m_cpuSetIndex; // -1 if the thread can run on any CPU
+    QList<int> m_cpuSet; // for run()
 };
 
 #endif // KDSOAPSERVERTHREAD_P_H
@@ -8,12 +8,15 @@
 **
 ****************************************************************************/
 #include "KDSoapServer.h"
+#include "KDSoapServerObjectInterface.h"
+#include "KDSoapServerReuseInterface.h"
 #include "KDSoapServerSocket_p.h"
 #include "KDSoapSocketList_p.h"
 #include <QDebug>
 
-KDSoapSocketList::KDSoapSocketList(KDSoapServer *server)
+KDSoapSocketList::KDSoapSocketList(KDSoapServer *server, KDSoapServerThreadLoad *threadLoad)
     : m_server(server)
+    , m_threadLoad(threadLoad)
     , m_totalConnectionCount(0)
 {
     Q_ASSERT(m_server);
@@ -21,11 +24,14 @@ KDSoapSocketList::KDSoapSocketList(KDSoapServer *server)
 
 KDSoapSocketList::~KDSoapSocketList()
 {
+    qDeleteAll(m_idleServerObjects);
 }
 
 KDSoapServerSocket *KDSoapSocketList::handleIncomingConnection(int socketDescriptor)
 {
-    KDSoapServerSocket *socket = new KDSoapServerSocket(this, m_server->createServerObject());
+    // Without a server object, the socket leases one for each request
+    QObject *serverObject = m_server->serverObjectPoolSize() > 0 ? nullptr : m_server->createServerObject();
+    KDSoapServerSocket *socket = new KDSoapServerSocket(this, serverObject);
     socket->setSocketDescriptor(socketDescriptor);
 
 #ifndef QT_NO_SSL
@@ -39,16 +45,41 @@ KDSoapServerSocket *KDSoapSocketList::handleIncomingConnection(int socketDescrip
     }
 #endif
 
-    QObject::connect(socket, &KDSoapServerSocket::disconnected, socket, &KDSoapServerSocket::deleteLater);
     m_sockets.insert(socket);
     connect(socket, &KDSoapServerSocket::socketDeleted, this, &KDSoapSocketList::socketDeleted);
     return socket;
 }
 
+QObject *KDSoapSocketList::leaseServerObject()
+{
+    if (!m_idleServerObjects.isEmpty()) {
+        return m_idleServerObjects.takeLast(); // the most recently used one, the most likely to be in the CPU cache
+    }
+    return m_server->createServerObject();
+}
+
+void KDSoapSocketList::releaseServerObject(QObject *serverObject)
+{
+    if (m_idleServerObjects.size() >= m_server->serverObjectPoolSize()) {
+        delete serverObject;
+        return;
+    }
+    KDSoapServerObjectInterface *serverObjectInterface = qobject_cast<KDSoapServerObjectInterface *>(serverObject);
+    if (serverObjectInterface) {
+        serverObjectInterface->resetState();
+    }
+    KDSoapServerReuseInterface *reuseInterface = qobject_cast<KDSoapServerReuseInterface *>(serverObject);
+    if (reuseInterface) {
+        reuseInterface->prepareForReuse();
+    }
+    m_idleServerObjects.append(serverObject);
+}
+
 void KDSoapSocketList::socketDeleted(KDSoapServerSocket *socket)
 {
     // qDebug() << Q_FUNC_INFO;
     m_sockets.remove(socket);
+    m_server->connectionClosed();
 }
 
 int KDSoapSocketList::socketCount() const
@@ -56,10 +87,20 @@ int KDSoapSocketList::socketCount() const
     return m_sockets.count();
 }
 
-void KDSoapSocketList::disconnectAll()
+void KDSoapSocketList::deleteAll()
+{
+    const QSet<KDSoapServerSocket *> sockets = m_sockets; // modified by socketDeleted
+    qDeleteAll(sockets);
+}
+
+void KDSoapSocketList::disconnectAll(int drainTimeout)
 {
     for (KDSoapServerSocket *socket : std::as_const(m_sockets)) {
-        socket->close(); // will disconnect
+        if (drainTimeout > 0) {
+            socket->drain(drainTimeout);
+        } else {
+            socket->close(); // will disconnect
+        }
     }
 }
 
@@ -12,24 +12,33 @@
 
 #include <QObject>
 #include <QSet>
+#include <QVector>
 QT_BEGIN_NAMESPACE
 class QTcpSocket;
 class QObject;
 QT_END_NAMESPACE
 class KDSoapServer;
 class KDSoapServerSocket;
+struct KDSoapServerThreadLoad;
 
 class KDSoapSocketList : public QObject // clazy:exclude=ctor-missing-parent-argument
 {
     Q_OBJECT
 public:
-    explicit KDSoapSocketList(KDSoapServer *server);
+    explicit KDSoapSocketList(KDSoapServer *server, KDSoapServerThreadLoad *threadLoad = nullptr);
     ~KDSoapSocketList();
 
     KDSoapServerSocket *handleIncomingConnection(int socketDescriptor);
 
+    // With KDSoapServer::setServerObjectPoolSize: the server objects which aren't handling a request.
+    QObject *leaseServerObject();
+    void releaseServerObject(QObject *serverObject);
+
     int socketCount() const;
-    void disconnectAll();
+    // With a timeout, the sockets first answer the request they are handling, see KDSoapServer::setDrainTimeout
+    void disconnectAll(int drainTimeout = 0);
+    // Deletes the sockets at once, when the server is deleted
+    void deleteAll();
 
     int totalConnectionCount() const;
     void increaseConnectionCount();
@@ -40,12 +49,20 @@ public:
         return m_server;
     }
 
+    // The load of the KDSoapThreadPool thread owning this list, nullptr for the main thread
+    KDSoapServerThreadLoad *threadLoad() const
+    {
+        return m_threadLoad;
+    }
+
 public Q_SLOTS:
     void socketDeleted(KDSoapServerSocket *socket);
 
 private:
     KDSoapServer *m_server;
+    KDSoapServerThreadLoad *m_threadLoad;
     QSet<KDSoapServerSocket *> m_sockets;
+    QVector<QObject *> m_idleServerObjects;
     QAtomicInt m_totalConnectionCount;
 };
 
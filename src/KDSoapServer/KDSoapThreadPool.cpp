@@ -9,27 +9,73 @@
 ****************************************************************************/
 #include "KDSoapThreadPool.h"
 #include "KDSoapServerThread_p.h"
+#include <QDeadlineTimer>
 #include <QDebug>
+#include <QHash>
+#include <QPair>
+#include <QTimer>
+#include <QVector>
+
+#include <algorithm>
 
 class KDSoapThreadPool::Private
 {
 public:
     Private()
         : m_maxThreadCount(QThread::idealThreadCount())
+        , m_minThreadCount(0)
+        , m_idleThreadTimeout(0)
+        , m_balancingStrategy(KDSoapThreadPool::LeastConnections)
+        , m_nextThread(0)
+        , m_availableCpus(KDSoapServerThread::currentThreadCpuSet())
+        , m_drainingCount(0)
     {
     }
 
     KDSoapServerThread *chooseNextThread();
+    KDSoapServerThread *addThread();
+    int leastUsedCpuSet() const;
+    QList<int> cpuSet(int index) const;
+    int activeThreadCount() const
+    {
+        return m_threads.count() - m_drainingCount;
+    }
+    void drainExtraThreads();
+    void resumeDrainingThreads();
+    void stopIdleThreads();
+    void updateIdleTimer();
 
     int m_maxThreadCount;
+    int m_minThreadCount;
+    int m_idleThreadTimeout;
+    KDSoapThreadPool::BalancingStrategy m_balancingStrategy;
+    int m_nextThread; // for RoundRobin
+    QList<QList<int>> m_cpuSets; // see setCpuAffinity
+    const QList<int> m_availableCpus; // the CPUs of the thread which created the pool, for the threads which aren't pinned
+
+    // Locked by the thread accepting connections (usually the server's) and by the idle timer (the pool's thread)
+    mutable QMutex m_threadsMutex;
     typedef QList<KDSoapServerThread *> ThreadCollection;
     ThreadCollection m_threads;
+    int m_drainingCount;
+    struct AcceptorAddress
+    {
+        QHostAddress address;
+        quint16 port;
+    };
+    QHash<KDSoapServer *, AcceptorAddress> m_acceptingServers; // see startAcceptors
+    QHash<const KDSoapServer *, int> m_stoppedThreadsConnectionCounts; // for totalConnectionCount
+
+    QTimer m_idleTimer; // checks for threads to stop
 };
 
 KDSoapThreadPool::KDSoapThreadPool(QObject *parent)
     : QObject(parent)
     , d(new Private)
 {
+    connect(&d->m_idleTimer, &QTimer::timeout, this, [this]() {
+        d->stopIdleThreads();
+    });
 }
 
 KDSoapThreadPool::~KDSoapThreadPool()
@@ -48,7 +94,10 @@ KDSoapThreadPool::~KDSoapThreadPool()
 
 void KDSoapThreadPool::setMaxThreadCount(int maxThreadCount)
 {
+    QMutexLocker lock(&d->m_threadsMutex);
     d->m_maxThreadCount = maxThreadCount;
+    d->resumeDrainingThreads();
+    d->drainExtraThreads();
 }
 
 int KDSoapThreadPool::maxThreadCount() const
@@ -56,48 +105,264 @@ int KDSoapThreadPool::maxThreadCount() const
     return d->m_maxThreadCount;
 }
 
+void KDSoapThreadPool::setMinThreadCount(int minThreadCount)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_minThreadCount = minThreadCount;
+    while (d->activeThreadCount() < qMin(minThreadCount, qMax(1, d->m_maxThreadCount))) {
+        d->addThread();
+    }
+}
+
+int KDSoapThreadPool::minThreadCount() const
+{
+    return d->m_minThreadCount;
+}
+
+void KDSoapThreadPool::setIdleThreadTimeout(int msecs)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_idleThreadTimeout = msecs;
+    d->updateIdleTimer();
+}
+
+int KDSoapThreadPool::idleThreadTimeout() const
+{
+    return d->m_idleThreadTimeout;
+}
+
+void KDSoapThreadPool::setCpuAffinity(const QList<QList<int>> &cpuSets)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_cpuSets = cpuSets;
+    for (int i = 0; i < d->m_threads.count(); ++i) {
+        const int index = cpuSets.isEmpty() ? -1 : i % cpuSets.count();
+        d->m_threads.at(i)->setCpuSet(index, d->cpuSet(index));
+    }
+}
+
+QList<QList<int>> KDSoapThreadPool::cpuAffinity() const
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    return d->m_cpuSets;
+}
+
+int KDSoapThreadPool::threadCount() const
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    return d->m_threads.count();
+}
+
+// Migration-free: the connections stay in their thread until they're closed, see stopIdleThreads
+void KDSoapThreadPool::Private::drainExtraThreads()
+{
+    while (activeThreadCount() > qMax(1, m_maxThreadCount)) {
+        KDSoapServerThread *leastBusy = nullptr;
+        for (KDSoapServerThread *thread : std::as_const(m_threads)) {
+            if (!thread->isDraining() && (!leastBusy || thread->load().connections.loadAcquire() < leastBusy->load().connections.loadAcquire())) {
+                leastBusy = thread;
+            }
+        }
+        leastBusy->setDraining(true);
+        ++m_drainingCount;
+        // With listenInThreads, the kernel would keep giving it connections
+        for (auto it = m_acceptingServers.constBegin(); it != m_acceptingServers.constEnd(); ++it) {
+            leastBusy->stopAcceptor(it.key());
+        }
+    }
+    updateIdleTimer();
+}
+
+// When the maximum is raised again, the threads still draining are used before starting new ones
+void KDSoapThreadPool::Private::resumeDrainingThreads()
+{
+    for (KDSoapServerThread *thread : std::as_const(m_threads)) {
+        if (m_drainingCount == 0 || activeThreadCount() >= qMax(1, m_maxThreadCount)) {
+            break;
+        }
+        if (!thread->isDraining()) {
+            continue;
+        }
+        thread->setDraining(false);
+        --m_drainingCount;
+        for (auto it = m_acceptingServers.constBegin(); it != m_acceptingServers.constEnd(); ++it) {
+            if (!thread->startAcceptor(it.key(), it->address, it->port)) {
+                qWarning() << "KDSoapThreadPool: failed to listen again on port" << it->port;
+            }
+        }
+    }
+}
+
+// Stops the draining threads which have no connections left,
+// and the threads which had no connections for idleThreadTimeout, down to minThreadCount
+void KDSoapThreadPool::Private::stopIdleThreads()
+{
+    ThreadCollection stoppedThreads;
+    {
+        QMutexLocker lock(&m_threadsMutex);
+        // With listenInThreads, the threads which aren't draining have to accept connections
+        const bool accepting = !m_acceptingServers.isEmpty();
+        const qint64 now = QDeadlineTimer::current().deadline();
+        int activeCount = activeThreadCount();
+        for (KDSoapServerThread *thread : std::as_const(m_threads)) {
+            const KDSoapServerThreadLoad &load = thread->load();
+            if (load.connections.loadAcquire() > 0) {
+                continue;
+            }
+            if (thread->isDraining()) {
+                --m_drainingCount;
+                stoppedThreads.append(thread);
+            } else if (!accepting && m_idleThreadTimeout > 0 && activeCount > m_minThreadCount && now - load.lastActivity.loadAcquire() >= m_idleThreadTimeout) {
+                --activeCount;
+                stoppedThreads.append(thread);
+            }
+        }
+        for (KDSoapServerThread *thread : std::as_const(stoppedThreads)) {
+            m_threads.removeOne(thread);
+            const QHash<const KDSoapServer *, int> counts = thread->totalConnectionCounts();
+            for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+                m_stoppedThreadsConnectionCounts[it.key()] += it.value();
+            }
+        }
+        updateIdleTimer();
+    }
+    // The thread has no connections, and can't get new ones
+    for (KDSoapServerThread *thread : std::as_const(stoppedThreads)) {
+        thread->quitThread();
+        thread->wait();
+        delete thread;
+    }
+}
+
+// Can be called from any thread, the timer lives in the pool's thread
+void KDSoapThreadPool::Private::updateIdleTimer()
+{
+    int interval = 0;
+    if (m_idleThreadTimeout > 0) {
+        interval = qBound(10, m_idleThreadTimeout / 2, 1000);
+    }
+    if (m_drainingCount > 0) {
+        interval = interval > 0 ? qMin(interval, 100) : 100;
+    }
+    if (interval > 0) {
+        QMetaObject::invokeMethod(&m_idleTimer, "start", Q_ARG(int, interval));
+    } else {
+        QMetaObject::invokeMethod(&m_idleTimer, "stop");
+    }
+}
+
+void KDSoapThreadPool::setBalancingStrategy(BalancingStrategy strategy)
+{
+    d->m_balancingStrategy = strategy;
+}
+
+KDSoapThreadPool::BalancingStrategy KDSoapThreadPool::balancingStrategy() const
+{
+    return d->m_balancingStrategy;
+}
+
+// The thread with the lowest cost gets the new connection, ties are broken by the number of connections
+static QPair<qint64, int> threadCost(const KDSoapServerThreadLoad &load, KDSoapThreadPool::BalancingStrategy strategy)
+{
+    const int connections = load.connections.loadAcquire();
+    switch (strategy) {
+    case KDSoapThreadPool::LeastInFlightRequests:
+        return qMakePair(qint64(load.requestsInFlight.loadAcquire()), connections);
+    case KDSoapThreadPool::LeastRecentLatency:
+        return qMakePair(qint64(load.recentLatency.loadAcquire()) * (load.requestsInFlight.loadAcquire() + 1), connections);
+    case KDSoapThreadPool::LeastConnections:
+    case KDSoapThreadPool::RoundRobin:
+        break;
+    }
+    return qMakePair(qint64(connections), 0);
+}
+
+// Only reads the atomic counters of each thread (see KDSoapServerThreadLoad), the threads aren't locked.
+// Draining threads are skipped.
 KDSoapServerThread *KDSoapThreadPool::Private::chooseNextThread()
 {
-    KDSoapServerThread *chosenThread = nullptr;
-    // Try to pick an existing thread
-    int minSocketCount = 0;
+    // Try to pick an existing thread, an idling one whatever the strategy
+    QPair<qint64, int> minCost;
     KDSoapServerThread *bestThread = nullptr;
     for (KDSoapServerThread *thr : std::as_const(m_threads)) {
-        // We look at the amount of sockets connected to each thread, and pick the less busy one.
-        // Note that this isn't fully accurate, due to Keep-Alive: it's possible for long-term
-        // idling clients to be all on one thread, and active clients on another one, and this
-        // wouldn't use CPU fully. But this is probably still better than no keep-alive (much more
-        // connection overhead). Maybe we have to look at sockets who made a request in the last
-        // N seconds... but the past is no indication of the future.
-        const int sc = thr->socketCount();
-        if (sc == 0) { // Perfect, an idling thread
+        if (thr->isDraining()) {
+            continue;
+        }
+        const KDSoapServerThreadLoad &load = thr->load();
+        if (load.connections.loadAcquire() == 0) { // Perfect, an idling thread
             // qDebug() << "Picked" << thr << "since it was idling";
-            chosenThread = thr;
-            break;
+            return thr;
         }
-        if (!bestThread || sc < minSocketCount) {
-            minSocketCount = sc;
+        const QPair<qint64, int> cost = threadCost(load, m_balancingStrategy);
+        if (!bestThread || cost < minCost) {
+            minCost = cost;
             bestThread = thr;
         }
     }
 
-    // Use an existing non-idling thread, if we reached maxThreads
-    if (!chosenThread && bestThread && m_threads.count() == m_maxThreadCount) {
-        chosenThread = bestThread;
+    // Create a new thread, until we reach maxThreads
+    if (!bestThread || activeThreadCount() < qMax(1, m_maxThreadCount)) {
+        return addThread();
+    }
+
+    // Use an existing non-idling thread
+    if (m_balancingStrategy == KDSoapThreadPool::RoundRobin) {
+        do {
+            m_nextThread = (m_nextThread + 1) % m_threads.count();
+        } while (m_threads.at(m_nextThread)->isDraining());
+        return m_threads.at(m_nextThread);
+    }
+    return bestThread;
+}
+
+int KDSoapThreadPool::Private::leastUsedCpuSet() const
+{
+    QVector<int> threadsPerSet(m_cpuSets.count());
+    for (KDSoapServerThread *thread : std::as_const(m_threads)) {
+        if (thread->cpuSetIndex() >= 0 && thread->cpuSetIndex() < threadsPerSet.count()) {
+            ++threadsPerSet[thread->cpuSetIndex()];
+        }
+    }
+    return int(std::min_element(threadsPerSet.constBegin(), threadsPerSet.constEnd()) - threadsPerSet.constBegin());
+}
+
+// The CPUs of the set \p index which are available to the pool, or all the available CPUs for -1
+QList<int> KDSoapThreadPool::Private::cpuSet(int index) const
+{
+    if (index < 0 || m_availableCpus.isEmpty()) { // unknown on other platforms than Linux
+        return index < 0 ? m_availableCpus : m_cpuSets.at(index);
+    }
+    QList<int> cpus;
+    for (int cpu : m_cpuSets.at(index)) {
+        if (m_availableCpus.contains(cpu)) {
+            cpus.append(cpu);
+        }
+    }
+    if (cpus.isEmpty()) {
+        qWarning("KDSoapThreadPool: none of the CPUs of set %d is available, its threads can run on any available CPU", index);
+        return m_availableCpus;
     }
+    return cpus;
+}
 
-    // Create new thread
-    if (!chosenThread) {
-        chosenThread = new KDSoapServerThread(nullptr);
-        // qDebug() << "Creating KDSoapServerThread" << chosenThread;
-        m_threads.append(chosenThread);
-        chosenThread->startThread();
+KDSoapServerThread *KDSoapThreadPool::Private::addThread()
+{
+    KDSoapServerThread *thread = new KDSoapServerThread(nullptr);
+    // qDebug() << "Creating KDSoapServerThread" << thread;
+    if (!m_cpuSets.isEmpty()) {
+        const int index = leastUsedCpuSet();
+        thread->setCpuSet(index, cpuSet(index)); // applied by the thread itself, first thing
     }
-    return chosenThread;
+    m_threads.append(thread);
+    thread->startThread();
+    return thread;
 }
 
 void KDSoapThreadPool::handleIncomingConnection(int socketDescriptor, KDSoapServer *server)
 {
+    // Locked until the thread counts the connection, so that it's not stopped meanwhile
+    QMutexLocker lock(&d->m_threadsMutex);
+
     // First, pick or create a thread.
     KDSoapServerThread *chosenThread = d->chooseNextThread();
 
@@ -105,8 +370,47 @@ void KDSoapThreadPool::handleIncomingConnection(int socketDescriptor, KDSoapServ
     chosenThread->handleIncomingConnection(socketDescriptor, server);
 }
 
+// See KDSoapServer::listenInThreads. All the threads are started, so that they all accept connections.
+bool KDSoapThreadPool::startAcceptors(KDSoapServer *server, const QHostAddress &address, quint16 port)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_acceptingServers.insert(server, Private::AcceptorAddress{address, port});
+    while (d->activeThreadCount() < qMax(1, d->m_maxThreadCount)) {
+        d->addThread();
+    }
+    for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
+        if (!thread->isDraining() && !thread->startAcceptor(server, address, port)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KDSoapThreadPool::stopAcceptors(KDSoapServer *server)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_acceptingServers.remove(server);
+    for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
+        thread->stopAcceptor(server);
+    }
+}
+
+// Called by ~KDSoapServer: once this returns, no thread refers to the server anymore
+void KDSoapThreadPool::removeServer(KDSoapServer *server)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_acceptingServers.remove(server);
+    d->m_stoppedThreadsConnectionCounts.remove(server);
+    QSemaphore readyThreads;
+    for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
+        thread->removeServer(server, readyThreads);
+    }
+    readyThreads.acquire(d->m_threads.count());
+}
+
 int KDSoapThreadPool::numConnectedSockets(const KDSoapServer *server) const
 {
+    QMutexLocker lock(&d->m_threadsMutex);
     int sc = 0;
     for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
         sc += thread->socketCountForServer(server);
@@ -116,9 +420,15 @@ int KDSoapThreadPool::numConnectedSockets(const KDSoapServer *server) const
 
 void KDSoapThreadPool::disconnectSockets(KDSoapServer *server)
 {
+    drainSockets(server, 0);
+}
+
+void KDSoapThreadPool::drainSockets(KDSoapServer *server, int msecs)
+{
+    QMutexLocker lock(&d->m_threadsMutex);
     QSemaphore readyThreads;
     for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
-        thread->disconnectSocketsForServer(server, readyThreads);
+        thread->disconnectSocketsForServer(server, readyThreads, msecs);
     }
     // Wait for all threads to have disconnected their sockets
     readyThreads.acquire(d->m_threads.count());
@@ -126,7 +436,8 @@ void KDSoapThreadPool::disconnectSockets(KDSoapServer *server)
 
 int KDSoapThreadPool::totalConnectionCount(const KDSoapServer *server) const
 {
-    int sc = 0;
+    QMutexLocker lock(&d->m_threadsMutex);
+    int sc = d->m_stoppedThreadsConnectionCounts.value(server);
     for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
         sc += thread->totalConnectionCountForServer(server);
     }
@@ -135,6 +446,8 @@ int KDSoapThreadPool::totalConnectionCount(const KDSoapServer *server) const
 
 void KDSoapThreadPool::resetTotalConnectionCount(const KDSoapServer *server)
 {
+    QMutexLocker lock(&d->m_threadsMutex);
+    d->m_stoppedThreadsConnectionCounts.remove(server);
     for (KDSoapServerThread *thread : std::as_const(d->m_threads)) {
         thread->resetTotalConnectionCountForServer(server);
     }
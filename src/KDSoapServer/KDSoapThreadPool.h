@@ -12,7 +12,11 @@
 
 #include "KDSoapServerGlobal.h"
 #include <QtCore/QHash>
+#include <QtCore/QList>
 #include <QtCore/QObject>
+QT_BEGIN_NAMESPACE
+class QHostAddress;
+QT_END_NAMESPACE
 class KDSoapServer;
 
 /**
@@ -42,6 +46,11 @@ public:
      * Note: The thread pool will always use at least 1 thread, even if \p maxThreadCount
      * limit is zero or negative.
      * The default maxThreadCount is QThread::idealThreadCount().
+     *
+     * Since KDSoap 2.3, lowering the maximum below the number of running threads drains the extra threads:
+     * they don't get new connections anymore (they stop listening, with KDSoapServer::listenInThreads),
+     * and stop once their last connection is closed. Raising the maximum again first puts the threads
+     * still draining back to work.
      */
     void setMaxThreadCount(int maxThreadCount);
 
@@ -50,6 +59,91 @@ public:
      */
     int maxThreadCount() const;
 
+    /**
+     * Sets the number of threads which keep running even when they have no connections,
+     * see setIdleThreadTimeout. Missing threads are started right away.
+     * The default is 0.
+     * \since 2.3
+     */
+    void setMinThreadCount(int minThreadCount);
+
+    /**
+     * Returns the minimum number of threads set by setMinThreadCount.
+     * \since 2.3
+     */
+    int minThreadCount() const;
+
+    /**
+     * Sets how long a thread may have no connections before it's stopped, as long as
+     * more than minThreadCount() threads are running. This frees the threads started for a traffic spike.
+     *
+     * The default, 0, means that threads run until the pool is deleted, as in previous versions.
+     * Threads are never stopped while a server listens with KDSoapServer::listenInThreads().
+     * \since 2.3
+     */
+    void setIdleThreadTimeout(int msecs);
+
+    /**
+     * Returns the timeout set by setIdleThreadTimeout, in milliseconds.
+     * \since 2.3
+     */
+    int idleThreadTimeout() const;
+
+    /**
+     * Returns the number of running threads, including the ones being drained (see setMaxThreadCount).
+     * \since 2.3
+     */
+    int threadCount() const;
+
+    /**
+     * How a thread is chosen for a new connection, once the pool has maxThreadCount() threads.
+     * A thread without any connection is always preferred, and new threads are started as long as
+     * the maximum isn't reached.
+     * \since 2.3
+     */
+    enum BalancingStrategy
+    {
+        LeastConnections, ///< the thread with the fewest connections (the default, as in previous versions)
+        RoundRobin, ///< each thread in turn
+        LeastInFlightRequests, ///< the thread with the fewest requests being processed or answered
+        LeastRecentLatency ///< the thread with the lowest recent response time, multiplied by its requests in flight plus one
+    };
+
+    /**
+     * Sets how the threads are chosen for new connections. Idle keep-alive connections
+     * count as much as busy ones with LeastConnections, but not with the other strategies.
+     * \since 2.3
+     */
+    void setBalancingStrategy(BalancingStrategy strategy);
+
+    /**
+     * Returns the strategy set by setBalancingStrategy.
+     * \since 2.3
+     */
+    BalancingStrategy balancingStrategy() const;
+
+    /**
+     * Pins the threads of the pool to CPUs: each thread is restricted to one of the given sets of CPU numbers,
+     * the sets being spread evenly between the threads. For instance, pass {{0}, {1}, {2}, {3}} to run each of four
+     * threads on its own core, or one set per NUMA node (e.g. {{0, 1, 2, 3}, {4, 5, 6, 7}}) to keep each thread on a node.
+     *
+     * A thread is pinned as soon as it starts, before creating its sockets, buffers and server objects,
+     * so that the memory it allocates comes from the node it runs on (with the default "first touch" policy of the kernel)
+     * and stays in the caches of its cores. Running threads are moved to their new set.
+     *
+     * Only the CPUs which the thread creating the pool may run on are used: the others are ignored, and a set
+     * without any of them is replaced with all of them. The default, an empty list, lets the threads run on any of these CPUs.
+     * CPU affinity is only supported on Linux, and ignored on other platforms.
+     * \since 2.3
+     */
+    void setCpuAffinity(const QList<QList<int>> &cpuSets);
+
+    /**
+     * Returns the sets of CPUs set by setCpuAffinity.
+     * \since 2.3
+     */
+    QList<QList<int>> cpuAffinity() const;
+
     /**
      * Returns the number of connected sockets for a given server
      */
@@ -73,9 +167,20 @@ public:
      */
     void disconnectSockets(KDSoapServer *server);
 
+    /**
+     * Disconnect all connected sockets for a given server, once they have answered the request
+     * they are handling, or after \p msecs at the latest. Idle sockets are disconnected at once.
+     * See KDSoapServer::setDrainTimeout.
+     * \since 2.3
+     */
+    void drainSockets(KDSoapServer *server, int msecs);
+
 private:
     friend class KDSoapServer;
     void handleIncomingConnection(int socketDescriptor, KDSoapServer *server);
+    bool startAcceptors(KDSoapServer *server, const QHostAddress &address, quint16 port);
+    void stopAcceptors(KDSoapServer *server);
+    void removeServer(KDSoapServer *server);
     class Private;
     Private *const d;
 };
@@ -0,0 +1,181 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#include "KDSoapWsdlCache_p.h"
+#include "KDSoapHttpRequestParser_p.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QStringList>
+
+static QString gzipFileName(const QString &file)
+{
+    return file + QLatin1String(".gz");
+}
+
+// \p vary goes into the validators too: RFC 7232 section 4.1 wants it in 304 responses
+static KDSoapWsdlCache::Variant makeVariant(const QByteArray &body, const QByteArray &etag, const QDateTime &lastModified, const QByteArray &vary,
+                                            const QByteArray &contentEncoding)
+{
+    KDSoapWsdlCache::Variant variant;
+    variant.etag = etag;
+    variant.validators = "ETag: " + etag + "\r\nLast-Modified: " + KDSoapHttpRequestParser::toHttpDate(lastModified) + "\r\n" + vary;
+    variant.headers = "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\n" + contentEncoding;
+    variant.headers += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    variant.headers += variant.validators;
+    variant.body = body;
+    return variant;
+}
+
+KDSoapWsdlCache::KDSoapWsdlCache(QObject *parent)
+    : QObject(parent)
+    , m_watcher(nullptr)
+{
+}
+
+void KDSoapWsdlCache::setFile(const QString &file, const QString &pathInUrl)
+{
+    const QSharedPointer<const Document> document = file.isEmpty() ? QSharedPointer<const Document>() : load(file);
+    {
+        QMutexLocker lock(&m_mutex);
+        m_file = file;
+        m_pathInUrl = pathInUrl;
+        m_document = document;
+    }
+    // setWsdlFile() can be called from any thread, the watcher belongs to ours
+    QMetaObject::invokeMethod(this, "updateWatcher");
+}
+
+QString KDSoapWsdlCache::file() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_file;
+}
+
+QString KDSoapWsdlCache::pathInUrl() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_pathInUrl;
+}
+
+QSharedPointer<const KDSoapWsdlCache::Document> KDSoapWsdlCache::document() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_document;
+}
+
+QSharedPointer<const KDSoapWsdlCache::Document> KDSoapWsdlCache::load(const QString &file)
+{
+    QSharedPointer<Document> document(new Document);
+
+    // The file attributes are recorded even when the file can't be read, so that reload() only retries when they change
+    const QFileInfo info(file);
+    const QFileInfo gzipInfo(gzipFileName(file));
+    document->lastModified = info.lastModified();
+    document->size = info.size();
+    document->gzipLastModified = gzipInfo.lastModified();
+    document->gzipSize = gzipInfo.size();
+
+    QFile wsdlFile(file);
+    if (!wsdlFile.open(QIODevice::ReadOnly)) {
+        return document;
+    }
+    const QByteArray body = wsdlFile.readAll();
+    const QByteArray etagBase = QByteArray::number(document->lastModified.toMSecsSinceEpoch(), 16) + '-' + QByteArray::number(body.size(), 16);
+
+    // A .gz file older than the .wsdl file is outdated (e.g. in the middle of a deployment), ignore it
+    QByteArray gzipBody;
+    if (gzipInfo.exists() && gzipInfo.lastModified() >= document->lastModified) {
+        QFile gzipFile(gzipInfo.filePath());
+        if (gzipFile.open(QIODevice::ReadOnly)) {
+            gzipBody = gzipFile.readAll();
+        }
+    }
+
+    const QByteArray etag = '"' + etagBase + '"';
+    if (gzipBody.isEmpty()) {
+        document->plain = makeVariant(body, etag, document->lastModified, QByteArray(), QByteArray());
+    } else {
+        // Caches must not serve one variant to clients which asked for the other one
+        const QByteArray vary = "Vary: Accept-Encoding\r\n";
+        document->plain = makeVariant(body, etag, document->lastModified, vary, QByteArray());
+        document->gzip = makeVariant(gzipBody, '"' + etagBase + "-gzip\"", document->lastModified, vary, "Content-Encoding: gzip\r\n");
+    }
+    return document;
+}
+
+void KDSoapWsdlCache::reload()
+{
+    QString file;
+    QSharedPointer<const Document> current;
+    {
+        QMutexLocker lock(&m_mutex);
+        file = m_file;
+        current = m_document;
+    }
+    if (file.isEmpty()) {
+        return;
+    }
+
+    // The directory is watched too, so most notifications are about other files
+    const QFileInfo info(file);
+    const QFileInfo gzipInfo(gzipFileName(file));
+    if (!current || info.lastModified() != current->lastModified || info.size() != current->size
+        || gzipInfo.lastModified() != current->gzipLastModified || gzipInfo.size() != current->gzipSize) {
+        const QSharedPointer<const Document> document = load(file);
+        QMutexLocker lock(&m_mutex);
+        if (m_file != file) {
+            return; // setFile() was called meanwhile
+        }
+        m_document = document;
+    }
+    updateWatcher();
+}
+
+void KDSoapWsdlCache::updateWatcher()
+{
+    const QString file = this->file();
+    if (!m_watcher) {
+        if (file.isEmpty()) {
+            return;
+        }
+        m_watcher = new QFileSystemWatcher(this);
+        connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &KDSoapWsdlCache::reload);
+        connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &KDSoapWsdlCache::reload);
+    }
+
+    // Deployment tools and editors often replace files rather than writing into them, which removes them from the watcher.
+    // Watching the directory as well catches that, as well as the files being created later on.
+    QStringList paths;
+    if (!file.isEmpty()) {
+        const QFileInfo info(file);
+        paths << info.absolutePath() << info.absoluteFilePath() << gzipFileName(info.absoluteFilePath());
+    }
+    const QStringList watched = m_watcher->files() + m_watcher->directories();
+    QStringList obsolete;
+    for (const QString &path : watched) {
+        if (!paths.contains(path)) {
+            obsolete.append(path);
+        }
+    }
+    if (!obsolete.isEmpty()) {
+        m_watcher->removePaths(obsolete);
+    }
+    QStringList added;
+    for (const QString &path : std::as_const(paths)) {
+        if (!watched.contains(path) && QFileInfo::exists(path)) {
+            added.append(path);
+        }
+    }
+    if (!added.isEmpty()) {
+        m_watcher->addPaths(added);
+    }
+}
+
+#include "moc_KDSoapWsdlCache_p.cpp"
@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2010 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+#ifndef KDSOAPWSDLCACHE_P_H
+#define KDSOAPWSDLCACHE_P_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QFileSystemWatcher;
+QT_END_NAMESPACE
+
+/**
+ * The WSDL file set with KDSoapServer::setWsdlFile(), loaded in memory once,
+ * together with the HTTP headers of the response, so that serving it doesn't require any file I/O.
+ *
+ * If a "<file>.gz" file exists next to the WSDL file, it's served to clients which accept gzip.
+ * The files are watched, and reloaded when they change.
+ *
+ * document() can be called from any thread. The cache itself lives in the server's thread.
+ */
+class KDSoapWsdlCache : public QObject
+{
+    Q_OBJECT
+public:
+    struct Variant
+    {
+        QByteArray etag;
+        QByteArray validators; // ETag, Last-Modified and Vary headers, for 304 responses
+        QByteArray headers; // status line and all headers, except for the Connection header and the application's headers
+        QByteArray body;
+    };
+    struct Document
+    {
+        QDateTime lastModified;
+        qint64 size = -1;
+        QDateTime gzipLastModified; // of the .gz file, used to detect changes
+        qint64 gzipSize = -1;
+        Variant plain;
+        Variant gzip; // empty if there's no up-to-date .gz file
+
+        bool isLoaded() const
+        {
+            return !plain.headers.isEmpty();
+        }
+        bool hasGzip() const
+        {
+            return !gzip.headers.isEmpty();
+        }
+    };
+
+    explicit KDSoapWsdlCache(QObject *parent);
+
+    void setFile(const QString &file, const QString &pathInUrl);
+    QString file() const;
+    QString pathInUrl() const;
+
+    // The current version of the WSDL, or null if no file was set
+    QSharedPointer<const Document> document() const;
+
+private Q_SLOTS:
+    void reload();
+    void updateWatcher();
+
+private:
+    static QSharedPointer<const Document> load(const QString &file);
+
+    mutable QMutex m_mutex;
+    QString m_file;
+    QString m_pathInUrl;
+    QSharedPointer<const Document> m_document;
+    QFileSystemWatcher *m_watcher; // only used in our own thread
+};
+
+#endif // KDSOAPWSDLCACHE_P_H
@@ -10,6 +10,7 @@
 
 #include "KDSoapAuthentication.h"
 #include "KDSoapClientInterface.h"
+#include "KDSoapDebug.h"
 #include "KDSoapMessage.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapPendingCallWatcher.h"
@@ -27,6 +28,15 @@
 
 using namespace KDSoapUnitTestHelpers;
 
+static QAtomicInt s_clientDebugMessages;
+static void countClientDebugMessages(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    Q_UNUSED(msg);
+    if (type == QtDebugMsg && qstrcmp(context.category, "kdsoap.client") == 0) {
+        s_clientDebugMessages.ref();
+    }
+}
+
 class BuiltinHttpTest : public QObject
 {
     Q_OBJECT
@@ -197,6 +207,26 @@ private Q_SLOTS:
             QCOMPARE(server.header("Cookie").constData(), "biscuits=are good");
         }
     }
+
+    void testCookieJarChangeBetweenSyncCalls()
+    {
+        HttpServerThread server(countryResponse(), HttpServerThread::Public);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+
+        QNetworkCookieJar firstJar;
+        firstJar.setCookiesFromUrl(QList<QNetworkCookie>() << QNetworkCookie("biscuits", "are good"), QUrl(server.endPoint()));
+        client.setCookieJar(&firstJar);
+        QVERIFY(!client.call(QLatin1String("getEmployeeCountry"), countryMessage()).isFault());
+        QCOMPARE(server.header("Cookie").constData(), "biscuits=are good");
+
+        // The thread used by call() must notice the change
+        QNetworkCookieJar secondJar;
+        secondJar.setCookiesFromUrl(QList<QNetworkCookie>() << QNetworkCookie("cake", "is a lie"), QUrl(server.endPoint()));
+        client.setCookieJar(&secondJar);
+        QVERIFY(!client.call(QLatin1String("getEmployeeCountry"), countryMessage()).isFault());
+        QCOMPARE(server.header("Cookie").constData(), "cake=is a lie");
+    }
+
     // Using direct call(), check the xml we send, the response parsing.
     // Then test callNoReply, then various ways to use asyncCall.
     void testCallNoReply()
@@ -422,6 +452,28 @@ private Q_SLOTS:
     }
 
 
+    void testDebugOutputSampling()
+    {
+        HttpServerThread server(countryResponse(), HttpServerThread::Public);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+
+        const bool wasEnabled = KDSoapDebug::isEnabled(KDSoapDebug::Client);
+        KDSoapDebug::setEnabled(KDSoapDebug::Client, true);
+        KDSoapDebug::setSamplingInterval(2);
+        s_clientDebugMessages = 0;
+        const QtMessageHandler oldHandler = qInstallMessageHandler(countClientDebugMessages);
+        for (int i = 0; i < 4; ++i) {
+            const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+            QVERIFY(!response.isFault());
+        }
+        qInstallMessageHandler(oldHandler);
+        KDSoapDebug::setSamplingInterval(1);
+        KDSoapDebug::setEnabled(KDSoapDebug::Client, wasEnabled);
+
+        // One call out of two was logged, with both its request and its response
+        QCOMPARE(s_clientDebugMessages.loadAcquire(), 4);
+    }
+
 private:
     static QByteArray countryResponse()
     {
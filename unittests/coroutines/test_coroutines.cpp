@@ -0,0 +1,286 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+
+#include "KDSoapAwaitable.h"
+#include "KDSoapClientInterface.h"
+#include "KDSoapMessage.h"
+#include "KDSoapServer.h"
+#include "KDSoapValue.h"
+#include "httpserver_p.h"
+#include "wsdl_sayhello.h"
+
+#include <QEventLoop>
+#include <QTest>
+#include <QThread>
+
+using namespace KDSoapUnitTestHelpers;
+
+#ifdef KDSOAP_HAS_COROUTINES
+// Minimal coroutine type: starts immediately, nobody awaits it
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object()
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void()
+        {
+        }
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+struct CoroutineResult
+{
+    QString country;
+    QString secondCountry;
+    bool isFault = false;
+    QThread *resumedThread = nullptr;
+    bool done = false;
+};
+
+struct HelloResult
+{
+    QString greeting;
+    QString faultCode;
+    bool isFault = false;
+    QThread *resumedThread = nullptr;
+    bool done = false;
+};
+#endif
+
+class HelloServerObject : public Hello_ServiceServerBase
+{
+public:
+    QString sayHello(const QString &firstName, const QString &lastName) override
+    {
+        if (firstName.isEmpty()) {
+            setFault(QLatin1String("Client.Data"), QLatin1String("Empty first name"), QLatin1String("HelloServerObject"), lastName);
+            return QString();
+        }
+        return QLatin1String("Hello ") + firstName + QLatin1Char(' ') + lastName;
+    }
+};
+
+class HelloServer : public KDSoapServer
+{
+    Q_OBJECT
+public:
+    HelloServer()
+    {
+        setPath(QLatin1String("/hello"));
+    }
+    QObject *createServerObject() override
+    {
+        return new HelloServerObject;
+    }
+};
+
+class CoroutinesTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAwaitPendingCall()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        HttpServerThread server(countryResponse(), HttpServerThread::Public);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+        CoroutineResult result;
+
+        awaitCountry(&client, &result);
+        QVERIFY(!result.done); // suspended, waiting for the response
+        QTRY_VERIFY(result.done);
+        QCOMPARE(result.country, QString::fromLatin1("France"));
+        QCOMPARE(result.resumedThread, QThread::currentThread());
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+    void testChainedAwaitables()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        HttpServerThread server(countryResponse(), HttpServerThread::Public);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+        CoroutineResult result;
+
+        awaitTwoCountries(&client, &result);
+        QTRY_VERIFY(result.done);
+        QCOMPARE(result.country, QString::fromLatin1("France"));
+        QCOMPARE(result.secondCountry, QString::fromLatin1("France"));
+        QCOMPARE(result.resumedThread, QThread::currentThread());
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+    void testAwaitFault()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        HttpServerThread server(QByteArray(), HttpServerThread::Public | HttpServerThread::Error404);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+        CoroutineResult result;
+        result.country = QString::fromLatin1("not set");
+
+        awaitTwoCountries(&client, &result);
+        QTRY_VERIFY(result.done);
+        QVERIFY(result.isFault);
+        QVERIFY(result.country.isEmpty()); // default-constructed result
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+    void testAwaitFinishedCall()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        HttpServerThread server(countryResponse(), HttpServerThread::Public);
+        KDSoapClientInterface client(server.endPoint(), countryMessageNamespace());
+        KDSoapPendingCall call = client.asyncCall(QLatin1String("getEmployeeCountry"), countryMessage());
+        QTRY_VERIFY(call.isFinished());
+
+        CoroutineResult result;
+        awaitCall(call, &result);
+        QVERIFY(result.done); // no suspension needed
+        QCOMPARE(result.country, QString::fromLatin1("France"));
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+    // Same as above, with the method generated by kdwsdl2cpp and a KDSoapServer
+    void testAwaitGeneratedCall()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        TestServerThread<HelloServer> serverThread;
+        HelloServer *server = serverThread.startThread();
+        Hello_Service service;
+        service.setEndPoint(server->endPoint());
+        HelloResult result;
+
+        awaitHello(&service, QString::fromLatin1("David"), &result);
+        QVERIFY(!result.done); // suspended, waiting for the response
+        QTRY_VERIFY(result.done);
+        QVERIFY(!result.isFault);
+        QCOMPARE(result.greeting, QString::fromLatin1("Hello David Faure"));
+        QCOMPARE(result.resumedThread, QThread::currentThread());
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+    void testAwaitGeneratedCallFault()
+    {
+#ifdef KDSOAP_HAS_COROUTINES
+        TestServerThread<HelloServer> serverThread;
+        HelloServer *server = serverThread.startThread();
+        Hello_Service service;
+        service.setEndPoint(server->endPoint());
+        HelloResult result;
+        result.greeting = QString::fromLatin1("not set");
+
+        awaitHello(&service, QString(), &result);
+        QTRY_VERIFY(result.done);
+        QVERIFY(result.isFault);
+        QVERIFY(result.greeting.isEmpty()); // default-constructed result
+        QCOMPARE(result.faultCode, QString::fromLatin1("Client.Data"));
+#else
+        QSKIP("This compiler doesn't support C++20 coroutines");
+#endif
+    }
+
+private:
+#ifdef KDSOAP_HAS_COROUTINES
+    static Task awaitHello(Hello_Service *service, const QString &firstName, HelloResult *result)
+    {
+        KDSoapCallAwaitable<QString> hello = service->coSayHello(firstName, QString::fromLatin1("Faure"));
+        result->greeting = co_await hello;
+        const KDSoapMessage reply = hello.returnMessage();
+        result->isFault = reply.isFault();
+        if (result->isFault) {
+            result->faultCode = reply.arguments().child(QLatin1String("faultcode")).value().toString();
+        }
+        result->resumedThread = QThread::currentThread();
+        result->done = true;
+    }
+
+    static Task awaitCountry(KDSoapClientInterface *client, CoroutineResult *result)
+    {
+        const KDSoapMessage reply = co_await client->asyncCall(QLatin1String("getEmployeeCountry"), countryMessage());
+        result->isFault = reply.isFault();
+        result->country = parseCountry(reply);
+        result->resumedThread = QThread::currentThread();
+        result->done = true;
+    }
+
+    static Task awaitCall(KDSoapPendingCall call, CoroutineResult *result)
+    {
+        const KDSoapMessage reply = co_await call;
+        result->country = parseCountry(reply);
+        result->done = true;
+    }
+
+    static Task awaitTwoCountries(KDSoapClientInterface *client, CoroutineResult *result)
+    {
+        KDSoapCallAwaitable<QString> first(client->asyncCall(QLatin1String("getEmployeeCountry"), countryMessage()), &parseCountry);
+        result->country = co_await first;
+        result->isFault = first.returnMessage().isFault();
+        if (!result->isFault) {
+            KDSoapCallAwaitable<QString> second(client->asyncCall(QLatin1String("getEmployeeCountry"), countryMessage()), &parseCountry);
+            result->secondCountry = co_await second;
+        }
+        result->resumedThread = QThread::currentThread();
+        result->done = true;
+    }
+#endif
+
+    static QString parseCountry(const KDSoapMessage &reply)
+    {
+        return reply.arguments().child(QLatin1String("employeeCountry")).value().toString();
+    }
+
+    static QByteArray countryResponse()
+    {
+        return QByteArray(xmlEnvBegin11())
+            + "><soap:Body>"
+              "<kdab:getEmployeeCountryResponse "
+              "xmlns:kdab=\"http://www.kdab.com/xml/MyWsdl/\"><kdab:employeeCountry>France</kdab:employeeCountry></kdab:getEmployeeCountryResponse>"
+              " </soap:Body>"
+            + xmlEnvEnd();
+    }
+    static QString countryMessageNamespace()
+    {
+        return QString::fromLatin1("http://www.kdab.com/xml/MyWsdl/");
+    }
+    static KDSoapMessage countryMessage()
+    {
+        KDSoapMessage message;
+        message.addArgument(QLatin1String("employeeName"), QString::fromUtf8("David Ä Faure"));
+        return message;
+    }
+};
+
+QTEST_MAIN(CoroutinesTest)
+
+#include "test_coroutines.moc"
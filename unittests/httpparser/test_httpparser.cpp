@@ -0,0 +1,301 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2024 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+
+#include "KDSoapHttpRequestParser_p.h"
+
+#include <QTest>
+
+#include <cstring>
+
+class HttpParserTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testContentLength_data()
+    {
+        QTest::addColumn<int>("fragmentSize");
+        QTest::newRow("whole") << 100000;
+        QTest::newRow("10") << 10;
+        QTest::newRow("1") << 1;
+    }
+
+    void testContentLength()
+    {
+        QFETCH(int, fragmentSize);
+        KDSoapHttpRequestParser parser;
+        const QByteArray body = "<soap>Hello</soap>";
+        const QByteArray request = "POST /path/../service?wsdl HTTP/1.1\r\n"
+                                   "Content-Type:  text/xml \r\n"
+                                   "SOAPAction: \"urn:action\"\r\n"
+                                   "Content-Length: "
+            + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+
+        QCOMPARE(feed(parser, request, fragmentSize), KDSoapHttpRequestParser::Complete);
+        const KDSoapHttpHeaders &headers = parser.headers();
+        QCOMPARE(headers.requestType(), QByteArray("POST"));
+        QCOMPARE(headers.path(), QByteArray("/service"));
+        QCOMPARE(headers.query(), QByteArray("?wsdl"));
+        QCOMPARE(headers.httpVersion(), QByteArray("HTTP/1.1"));
+        QCOMPARE(headers.value(KDSoapHttpHeaders::ContentType), QByteArray("text/xml"));
+        QCOMPARE(headers.value("content-type"), QByteArray("text/xml"));
+        QCOMPARE(headers.value(KDSoapHttpHeaders::SoapAction), QByteArray("\"urn:action\""));
+        QCOMPARE(parser.body(), body);
+    }
+
+    void testConsumeBody()
+    {
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n01234"), KDSoapHttpRequestParser::Body);
+        QCOMPARE(parser.body(), QByteArray("01234"));
+        QCOMPARE(parser.remainingBodySize(), 5);
+        parser.consumeBody();
+        QCOMPARE(parser.body(), QByteArray());
+        QCOMPARE(parser.remainingBodySize(), 5);
+        QCOMPARE(feed(parser, "56789"), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.body(), QByteArray("56789"));
+        QCOMPARE(parser.remainingBodySize(), 0);
+    }
+
+    void testChunked_data()
+    {
+        QTest::addColumn<int>("fragmentSize");
+        QTest::newRow("whole") << 100000;
+        QTest::newRow("7") << 7;
+        QTest::newRow("1") << 1;
+    }
+
+    void testChunked()
+    {
+        QFETCH(int, fragmentSize);
+        KDSoapHttpRequestParser parser;
+        const QByteArray request = "POST / HTTP/1.1\r\n"
+                                   "Transfer-Encoding: chunked\r\n"
+                                   "\r\n"
+                                   "5\r\nHello\r\n"
+                                   "1;name=value;other=\"quoted;value\"\r\n \r\n" // extensions are ignored
+                                   "A \r\nSOAP world\r\n" // whitespace before the (empty) extensions
+                                   "0\r\n"
+                                   "Checksum: 42\r\n"
+                                   "X-Other:  foo \r\n"
+                                   "\r\n";
+        QCOMPARE(feed(parser, request, fragmentSize), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.body(), QByteArray("Hello SOAP world"));
+        QCOMPARE(parser.trailers().value("checksum"), QByteArray("42"));
+        QCOMPARE(parser.trailers().value("x-other"), QByteArray("foo"));
+        QVERIFY(!parser.headers().contains("checksum"));
+        QVERIFY(parser.trailers().requestType().isEmpty());
+    }
+
+    void testChunkedConsumeBody()
+    {
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n4\r\nde"), KDSoapHttpRequestParser::ChunkedBody);
+        QCOMPARE(parser.body(), QByteArray("abcde"));
+        QCOMPARE(parser.remainingBodySize(), -1); // unknown
+        parser.consumeBody();
+        QCOMPARE(feed(parser, "fg\r\n0\r\n\r\n"), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.body(), QByteArray("fg"));
+    }
+
+    void testPipelinedRequests()
+    {
+        KDSoapHttpRequestParser parser;
+        const QByteArray requests = "POST /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                                    "POST /b HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nde\r\n0\r\n\r\n"
+                                    "GET /c HTTP/1.1\r\n";
+        QCOMPARE(feed(parser, requests), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.headers().path(), QByteArray("/a"));
+        QCOMPARE(parser.body(), QByteArray("abc"));
+
+        parser.reset();
+        QVERIFY(parser.hasData());
+        QCOMPARE(parser.parse(), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.headers().path(), QByteArray("/b"));
+        QCOMPARE(parser.body(), QByteArray("de"));
+
+        parser.reset();
+        QCOMPARE(parser.parse(), KDSoapHttpRequestParser::Headers);
+        QCOMPARE(feed(parser, "\r\n"), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.headers().path(), QByteArray("/c"));
+        QCOMPARE(parser.body(), QByteArray());
+
+        parser.reset();
+        QVERIFY(!parser.hasData());
+    }
+
+    void testInvalidChunks_data()
+    {
+        QTest::addColumn<QByteArray>("chunks");
+        QTest::newRow("not_hex") << QByteArray("xyz\r\n");
+        QTest::newRow("empty_size") << QByteArray(";ext\r\n");
+        QTest::newRow("too_big") << QByteArray("123456789\r\n");
+        QTest::newRow("missing_crlf") << QByteArray("3\r\nabcdef\r\n");
+        QTest::newRow("endless_line") << QByteArray(10000, '1');
+    }
+
+    void testInvalidChunks()
+    {
+        QFETCH(QByteArray, chunks);
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" + chunks), KDSoapHttpRequestParser::Error);
+    }
+
+    void testHeaders()
+    {
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, "GET /a?b HTTP/1.0\r\n"
+                              "Content-TYPE: text/xml\r\n"
+                              "X-Custom: first\r\n"
+                              "Empty:\r\n"
+                              "x-custom: second\r\n"
+                              "Connection: Keep-Alive\r\n"
+                              "\r\n"),
+                 KDSoapHttpRequestParser::Complete);
+        const KDSoapHttpHeaders &headers = parser.headers();
+        QCOMPARE(headers.count(), 5);
+        // Names are case-insensitive, the last field wins
+        QCOMPARE(headers.value("content-type"), QByteArray("text/xml"));
+        QCOMPARE(headers.value("X-CUSTOM"), QByteArray("second"));
+        QCOMPARE(headers.value(KDSoapHttpHeaders::Connection), QByteArray("Keep-Alive"));
+        QVERIFY(headers.contains("empty"));
+        QVERIFY(headers.value("empty").isEmpty());
+        QVERIFY(!headers.contains("missing"));
+        QVERIFY(!headers.contains(KDSoapHttpHeaders::SoapAction));
+        QVERIFY(headers.value(KDSoapHttpHeaders::SoapAction).isNull());
+
+        // What the raw XML and custom verb interfaces get
+        const QMap<QByteArray, QByteArray> map = headers.toMap();
+        QCOMPARE(map.value("_requestType"), QByteArray("GET"));
+        QCOMPARE(map.value("_path"), QByteArray("/a"));
+        QCOMPARE(map.value("_query"), QByteArray("?b"));
+        QCOMPARE(map.value("_httpVersion"), QByteArray("HTTP/1.0"));
+        QCOMPARE(map.value("content-type"), QByteArray("text/xml"));
+        QCOMPARE(map.value("x-custom"), QByteArray("second"));
+        QCOMPARE(map.count(), 8);
+
+        parser.reset();
+        QVERIFY(parser.headers().isEmpty());
+        QVERIFY(!parser.headers().contains(KDSoapHttpHeaders::Connection));
+        QCOMPARE(feed(parser, "POST / HTTP/1.1\r\nSOAPAction: foo\r\n\r\n"), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.headers().value(KDSoapHttpHeaders::SoapAction), QByteArray("foo"));
+        QCOMPARE(parser.headers().requestType(), QByteArray("POST"));
+
+        // Values point into the parser's buffer, which the next request reuses: keep a detached copy instead
+        const QByteArray soapAction = KDSoapHttpHeaders::detached(parser.headers().value(KDSoapHttpHeaders::SoapAction));
+        QVERIFY(soapAction.constData() != parser.headers().value(KDSoapHttpHeaders::SoapAction).constData());
+        parser.reset();
+        QCOMPARE(feed(parser, "POST / HTTP/1.1\r\nSOAPAction: bar\r\n\r\n"), KDSoapHttpRequestParser::Complete);
+        QCOMPARE(parser.headers().value(KDSoapHttpHeaders::SoapAction), QByteArray("bar"));
+        QCOMPARE(soapAction, QByteArray("foo"));
+    }
+
+    void testCleanPath_data()
+    {
+        QTest::addColumn<QByteArray>("path");
+        QTest::addColumn<QByteArray>("expected");
+        QTest::newRow("root") << QByteArray("/") << QByteArray("/");
+        QTest::newRow("simple") << QByteArray("/path/to/file.txt") << QByteArray("/path/to/file.txt");
+        QTest::newRow("trailing_slash") << QByteArray("/path/") << QByteArray("/path");
+        QTest::newRow("double_slash") << QByteArray("/subdir/../other//../path//to/file") << QByteArray("/path/to/file");
+        QTest::newRow("leading_double_slash") << QByteArray("//path") << QByteArray("/path");
+        QTest::newRow("dot") << QByteArray("/./a/./b/.") << QByteArray("/a/b");
+        QTest::newRow("dot_dot_to_root") << QByteArray("/a/..") << QByteArray("/");
+        QTest::newRow("dot_dot_above_root") << QByteArray("///../path") << QByteArray("/../path");
+        QTest::newRow("dot_dot_twice_above_root") << QByteArray("/a/../../../b") << QByteArray("/../../b");
+        QTest::newRow("dots_in_names") << QByteArray("/a../..b/...") << QByteArray("/a../..b/...");
+        QTest::newRow("dot_dot_after_dots_in_name") << QByteArray("/a../..") << QByteArray("/");
+        QTest::newRow("relative") << QByteArray("../../path") << QByteArray("../../path");
+        QTest::newRow("relative_fragment") << QByteArray("#/../../../path") << QByteArray("../../path");
+        QTest::newRow("relative_to_nothing") << QByteArray("a/..") << QByteArray(".");
+        QTest::newRow("empty") << QByteArray() << QByteArray();
+    }
+
+    void testCleanPath()
+    {
+        QFETCH(QByteArray, path);
+        QFETCH(QByteArray, expected);
+        // Same results as QDir::cleanPath (used before), without the QString conversions
+        QCOMPARE(KDSoapHttpRequestParser::cleanPath(path.constData(), int(path.size())), expected);
+    }
+
+    void testMalformedRequestLine()
+    {
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, "GARBAGE\r\n"), KDSoapHttpRequestParser::Error);
+        QVERIFY(!parser.headersTooLarge());
+    }
+
+    void testHeadersTooLarge_data()
+    {
+        QTest::addColumn<QByteArray>("request");
+        QTest::newRow("endless_request_line") << QByteArray("GET /" + QByteArray(20000, 'a'));
+        QTest::newRow("endless_header_line") << QByteArray("GET / HTTP/1.1\r\nX-Long: " + QByteArray(20000, 'a'));
+        QByteArray manyHeaders("GET / HTTP/1.1\r\n");
+        for (int i = 0; i < 5000; ++i) {
+            manyHeaders += "X-Header: value\r\n";
+        }
+        QTest::newRow("too_many_headers") << manyHeaders;
+    }
+
+    void testHeadersTooLarge()
+    {
+        QFETCH(QByteArray, request);
+        KDSoapHttpRequestParser parser;
+        QCOMPARE(feed(parser, request), KDSoapHttpRequestParser::Error);
+        QVERIFY(parser.headersTooLarge());
+
+        // The limits apply to each request, not to the connection
+        parser.reset();
+        QVERIFY(!parser.headersTooLarge());
+        QCOMPARE(feed(parser, "GET /" + QByteArray(10000, 'a') + " HTTP/1.1\r\n\r\n"), KDSoapHttpRequestParser::Complete);
+    }
+
+    // Uploads 50 MB in 1 KB chunks, delivered in TCP-sized segments
+    void benchmarkChunkedUpload()
+    {
+        const int chunkSize = 1024;
+        const int totalSize = 50 * 1024 * 1024;
+        const QByteArray chunk = QByteArray::number(chunkSize, 16) + "\r\n" + QByteArray(chunkSize, 'x') + "\r\n";
+        QByteArray request = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+        request.reserve(request.size() + (totalSize / chunkSize) * chunk.size() + 5);
+        for (int i = 0; i < totalSize / chunkSize; ++i) {
+            request += chunk;
+        }
+        request += "0\r\n\r\n";
+
+        QBENCHMARK {
+            KDSoapHttpRequestParser parser;
+            QCOMPARE(feed(parser, request, 1460), KDSoapHttpRequestParser::Complete);
+            QCOMPARE(int(parser.body().size()), totalSize);
+        }
+    }
+
+private:
+    // Feeds \p data to the parser, \p fragmentSize bytes at a time, like the socket does
+    static KDSoapHttpRequestParser::State feed(KDSoapHttpRequestParser &parser, const QByteArray &data, int fragmentSize = 100000)
+    {
+        KDSoapHttpRequestParser::State state = parser.state();
+        for (int pos = 0; pos < data.size(); pos += fragmentSize) {
+            const int size = qMin(fragmentSize, int(data.size()) - pos);
+            memcpy(parser.prepareWrite(size), data.constData() + pos, size);
+            parser.commitWrite(size);
+            state = parser.parse();
+            if (state == KDSoapHttpRequestParser::Error) {
+                break;
+            }
+        }
+        return state;
+    }
+};
+
+QTEST_MAIN(HttpParserTest)
+
+#include "test_httpparser.moc"
@@ -13,25 +13,34 @@
 #include "KDSoapMessage.h"
 #include "KDSoapNamespaceManager.h"
 #include "KDSoapPendingCallWatcher.h"
+#include "KDSoapResponseStream.h"
 #include "KDSoapServer.h"
 #include "KDSoapServerAuthInterface.h"
 #include "KDSoapServerCustomVerbRequestInterface.h"
 #include "KDSoapServerObjectInterface.h"
 #include "KDSoapServerRawXMLInterface.h"
+#include "KDSoapServerReuseInterface.h"
 #include "KDSoapThreadPool.h"
 #include "KDSoapValue.h"
 #include "httpserver_p.h" // KDSoapUnitTestHelpers
 #include <QAuthenticator>
+#include <QBuffer>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QPointer>
 #include <QTest>
+#include <QThreadPool>
 #ifndef QT_NO_OPENSSL
 #include <QSslConfiguration>
 #endif
 #include <QSignalSpy>
 #include <QTimer>
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
 using namespace KDSoapUnitTestHelpers;
 
 Q_DECLARE_METATYPE(QFile::Permissions)
@@ -42,6 +51,26 @@ class CountryServerObject;
 typedef QList<CountryServerObject *> ServerObjectsList;
 ServerObjectsList s_serverObjects;
 QMutex s_serverObjectsMutex;
+QSet<QThread *> s_slowCallThreads; // protected by s_serverObjectsMutex
+QHash<QThread *, QList<int>> s_threadCpuSets; // protected by s_serverObjectsMutex
+
+// The CPUs the calling thread may run on
+static QList<int> currentThreadCpuSet()
+{
+    QList<int> cpus;
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.append(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
 
 class PublicThread : public QThread
 {
@@ -93,13 +122,15 @@ class CountryServerObject : public QObject,
                             public KDSoapServerObjectInterface,
                             public KDSoapServerAuthInterface,
                             public KDSoapServerRawXMLInterface,
-                            public KDSoapServerCustomVerbRequestInterface
+                            public KDSoapServerCustomVerbRequestInterface,
+                            public KDSoapServerReuseInterface
 {
     Q_OBJECT
     Q_INTERFACES(KDSoapServerObjectInterface)
     Q_INTERFACES(KDSoapServerAuthInterface)
     Q_INTERFACES(KDSoapServerRawXMLInterface)
     Q_INTERFACES(KDSoapServerCustomVerbRequestInterface)
+    Q_INTERFACES(KDSoapServerReuseInterface)
 public:
     CountryServerObject(bool auth, bool rawXML)
         : QObject()
@@ -129,6 +160,13 @@ public:
             contentType = "text/plain";
             return file; // will be deleted by KDSoap
         }
+        if (path == QLatin1String("/path/to/buffer_download.txt")) {
+            // Not a QFile, so never sent with sendfile()
+            QBuffer *buffer = new QBuffer;
+            buffer->setData(QByteArray(1000000, 'b'));
+            contentType = "text/plain";
+            return buffer;
+        }
         return 0;
     }
 
@@ -198,6 +236,15 @@ public:
         return false;
     }
 
+    void prepareForReuse() override
+    {
+        ++m_reuseCount;
+    }
+    int reuseCount() const
+    {
+        return m_reuseCount;
+    }
+
     virtual HttpResponseHeaderItems additionalHttpResponseHeaderItems() const override
     {
         static KDSoapServerObjectInterface::HttpResponseHeaderItems result = KDSoapServerObjectInterface::HttpResponseHeaderItems()
@@ -220,7 +267,14 @@ public: // SOAP-accessible methods
         }
         // qDebug() << "getEmployeeCountry(" << employeeName << ") called";
         if (employeeName == QLatin1String("Slow")) {
+            s_serverObjectsMutex.lock();
+            s_slowCallThreads.insert(QThread::currentThread());
+            s_serverObjectsMutex.unlock();
             PublicThread::msleep(100);
+        } else if (employeeName == QLatin1String("CpuSet")) {
+            s_serverObjectsMutex.lock();
+            s_threadCpuSets.insert(QThread::currentThread(), currentThreadCpuSet());
+            s_serverObjectsMutex.unlock();
         }
         return employeeName + QString::fromLatin1(" France");
     }
@@ -254,11 +308,27 @@ public: // SOAP-accessible methods
         return input1 + input2;
     }
 
+    // Streamed response: as many employees as requested, written while the client reads them
+    void streamEmployees()
+    {
+        while (m_stream && m_stream->canWriteMore() && m_streamedCount < m_streamTotal) {
+            m_stream->writeValue(KDSoapValue(QString::fromLatin1("employeeName"), QString::fromLatin1("Employee %1").arg(m_streamedCount)));
+            ++m_streamedCount;
+        }
+        if (m_stream && m_streamedCount == m_streamTotal) {
+            m_stream->finish();
+        }
+    }
+
 private:
     bool m_requireAuth;
     bool m_useRawXML;
     bool m_rawXMLValid;
     QByteArray m_assembledXML;
+    QPointer<KDSoapResponseStream> m_stream;
+    int m_streamedCount = 0;
+    int m_streamTotal = 0;
+    int m_reuseCount = 0;
 };
 
 class CountryServer : public KDSoapServer
@@ -320,6 +390,7 @@ class CountryServerThread : public QThread
 public:
     CountryServerThread(KDSoapThreadPool *pool = 0)
         : m_threadPool(pool)
+        , m_listenInThreads(false)
         , m_pServer(0)
     {
     }
@@ -331,6 +402,10 @@ public:
         }
         wait();
     }
+    void setListenInThreads(bool listenInThreads)
+    {
+        m_listenInThreads = listenInThreads;
+    }
     CountryServer *startThread()
     {
         start();
@@ -355,7 +430,7 @@ protected:
         if (m_threadPool) {
             server.setThreadPool(m_threadPool);
         }
-        if (server.listen()) {
+        if (m_listenInThreads ? server.listenInThreads() : server.listen()) {
             m_pServer = &server;
         }
         connect(&server, &CountryServer::releaseSemaphore, this, &CountryServerThread::slotReleaseSemaphore, Qt::DirectConnection);
@@ -371,6 +446,7 @@ private Q_SLOTS:
 
 private:
     KDSoapThreadPool *m_threadPool;
+    bool m_listenInThreads;
     QSemaphore m_semaphore;
     CountryServer *m_pServer;
 };
@@ -564,6 +640,368 @@ private Q_SLOTS:
         QCOMPARE(s_serverObjects.count(), 0);
     }
 
+    void testElasticThreadPool()
+    {
+        {
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(3);
+            threadPool.setMinThreadCount(1);
+            QCOMPARE(threadPool.threadCount(), 1); // started right away
+            threadPool.setIdleThreadTimeout(100);
+            QCOMPARE(threadPool.idleThreadTimeout(), 100);
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+
+            QList<ClientSocket *> sockets;
+            const QByteArray message = rawCountryMessage();
+            for (int i = 0; i < 3; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(message));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+            QCOMPARE(threadPool.threadCount(), 3);
+
+            // Draining: the extra threads keep their connections, but don't get new ones
+            threadPool.setMaxThreadCount(2);
+            QTest::qWait(300);
+            QCOMPARE(threadPool.threadCount(), 3);
+            for (ClientSocket *socket : std::as_const(sockets)) {
+                socket->write(countryRequest(message));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+
+            // Raising the maximum again resumes the draining thread, rather than starting another one
+            threadPool.setMaxThreadCount(3);
+            ClientSocket *socket = new ClientSocket(server);
+            sockets.append(socket);
+            QVERIFY(socket->waitForConnected());
+            socket->write(countryRequest(message));
+            QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            QCOMPARE(threadPool.threadCount(), 3);
+
+            // Once the connections are closed, the idle threads are stopped, down to the minimum
+            qDeleteAll(sockets);
+            QTRY_COMPARE(threadPool.threadCount(), 1);
+            QCOMPARE(server->totalConnectionCount(), 4);
+
+            KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+            const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+            QCOMPARE(response.childValues().first().value().toString(), expectedCountry());
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testListenInThreads()
+    {
+#ifndef Q_OS_LINUX
+        QSKIP("SO_REUSEPORT is tested on Linux only");
+#endif
+        {
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(2);
+            CountryServerThread serverThread(&threadPool);
+            serverThread.setListenInThreads(true);
+            CountryServer *server = serverThread.startThread();
+            QVERIFY(server);
+            QVERIFY(server->isListening());
+
+            KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+            m_returnMessages.clear();
+            m_expectedMessages = 5;
+            makeAsyncCalls(client, m_expectedMessages);
+            m_eventLoop.exec();
+
+            QCOMPARE(m_returnMessages.count(), m_expectedMessages);
+            for (const KDSoapMessage &response : std::as_const(m_returnMessages)) {
+                QCOMPARE(response.childValues().first().value().toString(), expectedCountry());
+            }
+            for (CountryServerObject *obj : std::as_const(s_serverObjects)) {
+                QVERIFY(obj->thread() != qApp->thread());
+                QVERIFY(obj->thread() != &serverThread);
+            }
+
+            // No connections once suspended, all threads listen again once resumed
+            serverThread.suspend();
+            QVERIFY(!server->isListening());
+            serverThread.resume();
+            QVERIFY(server->isListening());
+            const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+            QCOMPARE(response.childValues().first().value().toString(), expectedCountry());
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testListenInThreadsDraining()
+    {
+#ifndef Q_OS_LINUX
+        QSKIP("SO_REUSEPORT is tested on Linux only");
+#endif
+        {
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(2);
+            CountryServerThread serverThread(&threadPool);
+            serverThread.setListenInThreads(true);
+            CountryServer *server = serverThread.startThread();
+            QVERIFY(server);
+            QCOMPARE(threadPool.threadCount(), 2);
+
+            // The drained thread stops listening, so it's stopped as soon as it has no connections
+            threadPool.setMaxThreadCount(1);
+            QTRY_COMPARE(threadPool.threadCount(), 1);
+
+            QList<ClientSocket *> sockets;
+            for (int i = 0; i < 4; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(rawCountryMessage()));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+            QCOMPARE(s_serverObjects.count(), 4);
+            QSet<QThread *> threads;
+            for (CountryServerObject *obj : std::as_const(s_serverObjects)) {
+                threads.insert(obj->thread());
+            }
+            QCOMPARE(threads.count(), 1);
+            QCOMPARE(threadPool.threadCount(), 1);
+            qDeleteAll(sockets);
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testBalancingStrategy()
+    {
+        {
+            KDSoapThreadPool threadPool;
+            QCOMPARE(threadPool.balancingStrategy(), KDSoapThreadPool::LeastConnections);
+            threadPool.setMaxThreadCount(2);
+            threadPool.setBalancingStrategy(KDSoapThreadPool::RoundRobin);
+            QCOMPARE(threadPool.balancingStrategy(), KDSoapThreadPool::RoundRobin);
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+
+            // The connections stay open, so the threads don't become idle again
+            QList<ClientSocket *> sockets;
+            const QByteArray message = rawCountryMessage();
+            for (int i = 0; i < 4; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(message));
+                const QList<QByteArray> responses = readHttpResponses(*socket, 1);
+                QCOMPARE(responses.count(), 1);
+                QVERIFY2(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"), responses.at(0).constData());
+            }
+
+            QCOMPARE(s_serverObjects.count(), 4);
+            QHash<QThread *, int> objectsPerThread;
+            for (CountryServerObject *obj : std::as_const(s_serverObjects)) {
+                ++objectsPerThread[obj->thread()];
+            }
+            QCOMPARE(objectsPerThread.count(), 2);
+            for (int count : std::as_const(objectsPerThread)) {
+                QCOMPARE(count, 2);
+            }
+            qDeleteAll(sockets);
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testServerDeletedBeforeThreadPool()
+    {
+        KDSoapThreadPool threadPool;
+        ClientSocket *socket = nullptr;
+        {
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+            socket = new ClientSocket(server);
+            QVERIFY(socket->waitForConnected());
+            socket->write(countryRequest(rawCountryMessage()));
+            QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            QCOMPARE(threadPool.numConnectedSockets(server), 1);
+            QCOMPARE(s_serverObjects.count(), 1);
+        }
+        // The connection was closed with its server, not left behind in the pool's thread
+        QCOMPARE(s_serverObjects.count(), 0);
+        QTRY_COMPARE(socket->state(), QAbstractSocket::UnconnectedState);
+        delete socket;
+
+        // The pool is still usable by another server
+        CountryServerThread serverThread(&threadPool);
+        CountryServer *server = serverThread.startThread();
+        ClientSocket otherSocket(server);
+        QVERIFY(otherSocket.waitForConnected());
+        otherSocket.write(countryRequest(rawCountryMessage()));
+        const QList<QByteArray> responses = readHttpResponses(otherSocket, 1);
+        QCOMPARE(responses.count(), 1);
+        QVERIFY2(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"), responses.at(0).constData());
+    }
+
+    void testBalancingStrategyLoad_data()
+    {
+        QTest::addColumn<int>("strategy");
+        QTest::addColumn<bool>("waitForSlowResponse");
+        QTest::addColumn<int>("expectedInFastThread");
+
+        // The last connection goes to the thread with the most connections, if it's less loaded
+        QTest::newRow("least_in_flight") << int(KDSoapThreadPool::LeastInFlightRequests) << false << 3;
+        QTest::newRow("least_recent_latency") << int(KDSoapThreadPool::LeastRecentLatency) << true << 3;
+        QTest::newRow("least_connections") << int(KDSoapThreadPool::LeastConnections) << true << 2;
+    }
+
+    void testBalancingStrategyLoad()
+    {
+        QFETCH(int, strategy);
+        QFETCH(bool, waitForSlowResponse);
+        QFETCH(int, expectedInFastThread);
+
+        {
+            s_serverObjectsMutex.lock();
+            s_slowCallThreads.clear();
+            s_serverObjectsMutex.unlock();
+
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(2);
+            threadPool.setBalancingStrategy(KDSoapThreadPool::BalancingStrategy(strategy));
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+
+            // One connection per thread: the second thread is started since the first one isn't idle anymore
+            QList<ClientSocket *> sockets;
+            for (int i = 0; i < 2; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(rawCountryMessage()));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+
+            // The second thread gets a slow request (100ms): it's either in flight, or it raised the recent latency
+            ClientSocket *slowSocket = sockets.at(1);
+            slowSocket->write(countryRequest(rawCountryMessage("Slow")));
+            if (waitForSlowResponse) {
+                QCOMPARE(readHttpResponses(*slowSocket, 1).count(), 1);
+            } else {
+                QTRY_COMPARE(server->numInFlightRequests(), 1);
+            }
+
+            for (int i = 0; i < 2; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(rawCountryMessage()));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+            if (!waitForSlowResponse) {
+                QCOMPARE(readHttpResponses(*slowSocket, 1).count(), 1);
+            }
+
+            QCOMPARE(s_serverObjects.count(), 4);
+            QMutexLocker locker(&s_serverObjectsMutex);
+            QCOMPARE(s_slowCallThreads.count(), 1);
+            int inFastThread = 0;
+            for (CountryServerObject *obj : std::as_const(s_serverObjects)) {
+                if (!s_slowCallThreads.contains(obj->thread())) {
+                    ++inFastThread;
+                }
+            }
+            QCOMPARE(inFastThread, expectedInFastThread);
+            locker.unlock();
+            qDeleteAll(sockets);
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testCpuAffinity()
+    {
+#ifndef Q_OS_LINUX
+        QSKIP("CPU affinity is only supported on Linux");
+#endif
+        const QList<int> availableCpus = currentThreadCpuSet();
+        QVERIFY(!availableCpus.isEmpty());
+        const int cpu = availableCpus.last();
+        {
+            KDSoapThreadPool threadPool;
+            QVERIFY(threadPool.cpuAffinity().isEmpty());
+            threadPool.setMaxThreadCount(2);
+            threadPool.setMinThreadCount(1);
+            // Both threads share the same CPU; the one after it isn't available, it's ignored
+            const QList<QList<int>> cpuSets{{cpu, cpu + 1}};
+            threadPool.setCpuAffinity(cpuSets);
+            QCOMPARE(threadPool.cpuAffinity(), cpuSets);
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+            s_threadCpuSets.clear();
+
+            QList<ClientSocket *> sockets;
+            for (int i = 0; i < 2; ++i) {
+                ClientSocket *socket = new ClientSocket(server);
+                sockets.append(socket);
+                QVERIFY(socket->waitForConnected());
+                socket->write(countryRequest(rawCountryMessage("CpuSet")));
+                const QList<QByteArray> responses = readHttpResponses(*socket, 1);
+                QCOMPARE(responses.count(), 1);
+                QVERIFY2(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"), responses.at(0).constData());
+            }
+            QCOMPARE(threadPool.threadCount(), 2);
+            QCOMPARE(s_threadCpuSets.count(), 2);
+            for (const QList<int> &threadCpus : std::as_const(s_threadCpuSets)) {
+                QCOMPARE(threadCpus, QList<int>{cpu});
+            }
+
+            // Running threads can run on all the available CPUs again
+            threadPool.setCpuAffinity(QList<QList<int>>());
+            s_threadCpuSets.clear();
+            for (ClientSocket *socket : std::as_const(sockets)) {
+                socket->write(countryRequest(rawCountryMessage("CpuSet")));
+                QCOMPARE(readHttpResponses(*socket, 1).count(), 1);
+            }
+            QCOMPARE(s_threadCpuSets.count(), 2);
+            for (const QList<int> &threadCpus : std::as_const(s_threadCpuSets)) {
+                QCOMPARE(threadCpus, availableCpus);
+            }
+            qDeleteAll(sockets);
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testProcessingThreadPool()
+    {
+        {
+            QThreadPool processingPool;
+            processingPool.setMaxThreadCount(4);
+            KDSoapThreadPool threadPool;
+            threadPool.setMaxThreadCount(1); // all connections in the same thread
+            CountryServerThread serverThread(&threadPool);
+            CountryServer *server = serverThread.startThread();
+            server->setProcessingThreadPool(&processingPool);
+            QCOMPARE(server->processingThreadPool(), &processingPool);
+            s_slowCallThreads.clear();
+
+            KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+            m_returnMessages.clear();
+            m_expectedMessages = 4;
+            makeAsyncCalls(client, m_expectedMessages, true /*slow*/);
+            m_eventLoop.exec();
+
+            QCOMPARE(m_returnMessages.count(), m_expectedMessages);
+            for (const KDSoapMessage &response : std::as_const(m_returnMessages)) {
+                QCOMPARE(response.childValues().first().value().toString(), QString::fromLatin1("Slow France"));
+            }
+            QCOMPARE(s_serverObjects.count(), m_expectedMessages);
+            QThread *ioThread = s_serverObjects.at(0)->thread();
+            for (CountryServerObject *obj : std::as_const(s_serverObjects)) {
+                QCOMPARE(obj->thread(), ioThread);
+            }
+            // The slow calls didn't wait for each other in the connections' thread
+            QVERIFY(s_slowCallThreads.count() > 1);
+            QVERIFY(!s_slowCallThreads.contains(ioThread));
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
     void testMultipleThreads_data()
     {
         QTest::addColumn<int>("maxThreads");
@@ -792,6 +1230,40 @@ private Q_SLOTS:
         serverThread.resume();
     }
 
+    void testSuspendDrain()
+    {
+        QThreadPool processingPool;
+        KDSoapThreadPool threadPool;
+        threadPool.setMaxThreadCount(1);
+        CountryServerThread serverThread(&threadPool);
+        CountryServer *server = serverThread.startThread();
+        server->setProcessingThreadPool(&processingPool);
+        server->setDrainTimeout(5000);
+        QCOMPARE(server->drainTimeout(), 5000);
+
+        ClientSocket idleSocket(server);
+        QVERIFY(idleSocket.waitForConnected());
+        idleSocket.write(countryRequest(rawCountryMessage()));
+        QCOMPARE(readHttpResponses(idleSocket, 1).count(), 1);
+
+        ClientSocket busySocket(server);
+        QVERIFY(busySocket.waitForConnected());
+        busySocket.write(countryRequest(rawCountryMessage("Slow")));
+        QTRY_COMPARE(server->numInFlightRequests(), 1);
+
+        QSignalSpy drainedSpy(server, &KDSoapServer::drained);
+        serverThread.suspend();
+
+        // The idle connection is closed at once, the other one once its response is sent
+        QVERIFY(idleSocket.state() == QAbstractSocket::UnconnectedState || idleSocket.waitForDisconnected());
+        const QList<QByteArray> responses = readHttpResponses(busySocket, 1);
+        QCOMPARE(responses.count(), 1);
+        QVERIFY(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(responses.at(0).contains("\r\nConnection: close\r\n"));
+        QVERIFY(busySocket.state() == QAbstractSocket::UnconnectedState || busySocket.waitForDisconnected());
+        QTRY_COMPARE(drainedSpy.count(), 1);
+    }
+
     void testSuspendUnderLoad()
     {
 #ifdef Q_OS_MAC
@@ -932,6 +1404,52 @@ private Q_SLOTS:
         QFile::remove(fileName);
     }
 
+    void testWsdlFileCache()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("cached.wsdl");
+        const QString gzipFileName = fileName + QLatin1String(".gz");
+        QVERIFY(writeFile(fileName, "Hello world"));
+        QVERIFY(writeFile(gzipFileName, "Not really gzip"));
+        server->setWsdlFile(fileName, QString::fromLatin1("/service.wsdl"));
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        auto get = [&socket](const QByteArray &headers) {
+            socket.write("GET /service.wsdl HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers + "\r\n");
+            return readHttpResponses(socket, 1).value(0);
+        };
+
+        // The gzipped copy is sent to clients which accept it
+        QByteArray response = get("Accept-Encoding: deflate, gzip\r\n");
+        QVERIFY2(response.contains("\r\nContent-Encoding: gzip\r\n"), response.constData());
+        QVERIFY(response.endsWith("\r\n\r\nNot really gzip"));
+        const QByteArray gzipETag = headerValue(response, "ETag");
+
+        response = get("Accept-Encoding: gzip;q=0\r\n");
+        QVERIFY2(!response.contains("Content-Encoding"), response.constData());
+        QVERIFY(response.contains("\r\nVary: Accept-Encoding\r\n"));
+        QVERIFY(response.endsWith("\r\n\r\nHello world"));
+        const QByteArray etag = headerValue(response, "ETag");
+        QVERIFY(!etag.isEmpty());
+        QVERIFY(etag != gzipETag);
+
+        socket.write("GET /service.wsdl HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n");
+        response = readHttpHeaders(socket);
+        QVERIFY2(response.startsWith("HTTP/1.1 304 Not Modified\r\n"), response.constData());
+        QCOMPARE(headerValue(response, "ETag"), etag);
+
+        // Changes to the file are picked up. The .gz file is older now, so it's ignored.
+        QTest::qWait(100);
+        QVERIFY(writeFile(fileName, "Hello again, world"));
+        QTRY_VERIFY(get("Accept-Encoding: gzip\r\n").endsWith("\r\n\r\nHello again, world"));
+
+        QFile::remove(fileName);
+        QFile::remove(gzipFileName);
+    }
+
     void testFileDownload_data()
     {
         QTest::addColumn<QString>("fileToDownload"); // client
@@ -1019,6 +1537,123 @@ private Q_SLOTS:
         }
     }
 
+    void testLargeFileDownload()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        // Small watermarks, so the file is sent in many refills
+        server->setWriteWatermarks(4096, 16384);
+        QCOMPARE(server->writeLowWatermark(), qint64(4096));
+        QCOMPARE(server->writeHighWatermark(), qint64(16384));
+
+        QByteArray contents;
+        for (int i = 0; contents.size() < 2 * 1024 * 1024; ++i) {
+            contents += "Line " + QByteArray::number(i) + '\n';
+        }
+        const QString fileName = QString::fromLatin1("file_download.txt");
+        QFile file(fileName);
+        QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable(file.errorString()));
+        file.write(contents);
+        file.close();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        // Pipelined: the responses must not be mixed up with the file data still being sent
+        const QByteArray get = "GET /path/to/file_download.txt HTTP/1.1\r\n"
+                               "Host: 127.0.0.1:12345\r\n"
+                               "\r\n";
+        const QByteArray rangeGet = "GET /path/to/file_download.txt HTTP/1.1\r\n"
+                                    "Range: bytes=100000-\r\n"
+                                    "\r\n";
+        socket.write(get + rangeGet + countryRequest(rawCountryMessage(s_longEmployeeName)));
+        QVERIFY(socket.waitForBytesWritten());
+
+        const QList<QByteArray> responses = readHttpResponses(socket, 3);
+        QFile::remove(fileName);
+        QCOMPARE(responses.count(), 3);
+        QVERIFY(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(responses.at(0).mid(responses.at(0).indexOf("\r\n\r\n") + 4) == contents);
+        QVERIFY(responses.at(1).startsWith("HTTP/1.1 206 Partial Content\r\n"));
+        QVERIFY(responses.at(1).mid(responses.at(1).indexOf("\r\n\r\n") + 4) == contents.mid(100000));
+        QVERIFY(xmlBufferCompare(responses.at(2).mid(responses.at(2).indexOf("\r\n\r\n") + 4), expectedCountryResponse(s_longEmployeeName)));
+    }
+
+    void testFileDownloadHeadAndConditional()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("file_download.txt");
+        QFile file(fileName);
+        QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable(file.errorString()));
+        file.write("Hello world");
+        file.close();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        const QByteArray requestStart = "/path/to/file_download.txt HTTP/1.1\r\n"
+                                        "Host: 127.0.0.1:12345\r\n";
+
+        // HEAD: same headers as GET, no body
+        socket.write("HEAD " + requestStart + "\r\n");
+        const QByteArray headResponse = readHttpHeaders(socket);
+        QVERIFY2(headResponse.startsWith("HTTP/1.1 200 OK\r\n"), headResponse.constData());
+        QVERIFY(headResponse.contains("\r\nContent-Length: 11\r\n"));
+        const QByteArray etag = headerValue(headResponse, "ETag");
+        const QByteArray lastModified = headerValue(headResponse, "Last-Modified");
+        QVERIFY(etag.startsWith('"'));
+        QVERIFY(lastModified.endsWith(" GMT"));
+
+        // The client's copy is up to date
+        socket.write("GET " + requestStart + "If-None-Match: \"other\", " + etag + "\r\n\r\n");
+        QByteArray response = readHttpHeaders(socket);
+        QVERIFY2(response.startsWith("HTTP/1.1 304 Not Modified\r\n"), response.constData());
+        QCOMPARE(headerValue(response, "ETag"), etag);
+        QVERIFY(!response.contains("Content-Length"));
+
+        socket.write("GET " + requestStart + "If-Modified-Since: " + lastModified + "\r\n\r\n");
+        response = readHttpHeaders(socket);
+        QVERIFY2(response.startsWith("HTTP/1.1 304 Not Modified\r\n"), response.constData());
+
+        // The client's copy is outdated
+        socket.write("GET " + requestStart + "If-None-Match: \"other\"\r\n\r\n");
+        const QList<QByteArray> responses = readHttpResponses(socket, 1);
+        QFile::remove(fileName);
+        QCOMPARE(responses.count(), 1);
+        QVERIFY(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(responses.at(0).endsWith("\r\n\r\nHello world"));
+    }
+
+    void testDeviceDownloadThenNotModified()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        const QString fileName = QString::fromLatin1("file_download.txt");
+        QFile file(fileName);
+        QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable(file.errorString()));
+        file.write("Hello world");
+        file.close();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        const QByteArray host = "Host: 127.0.0.1:12345\r\n";
+        socket.write("HEAD /path/to/file_download.txt HTTP/1.1\r\n" + host + "\r\n");
+        const QByteArray etag = headerValue(readHttpHeaders(socket), "ETag");
+        QVERIFY(!etag.isEmpty());
+
+        // The 304 is queued after the large response read from a QBuffer, not written before it
+        socket.write("GET /path/to/buffer_download.txt HTTP/1.1\r\n" + host + "\r\n" + "GET /path/to/file_download.txt HTTP/1.1\r\n" + host
+                     + "If-None-Match: " + etag + "\r\n\r\n");
+        const QList<QByteArray> responses = readHttpResponses(socket, 2);
+        QFile::remove(fileName);
+        QCOMPARE(responses.count(), 2);
+        QVERIFY(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(responses.at(0).endsWith("\r\n\r\n" + QByteArray(1000000, 'b')));
+        QVERIFY2(responses.at(1).startsWith("HTTP/1.1 304 Not Modified\r\n"), responses.at(1).constData());
+        QCOMPARE(headerValue(responses.at(1), "ETag"), etag);
+    }
+
     void testFileDownloadAuth_data()
     {
         QTest::addColumn<bool>("requireAuth"); // server
@@ -1153,8 +1788,10 @@ private Q_SLOTS:
         QTest::newRow("50") << 50 << false;
         QTest::newRow("20") << 20 << false;
         QTest::newRow("10") << 10 << false;
+        QTest::newRow("1") << 1 << false;
 
         QTest::newRow("rawXML") << 50 << true;
+        QTest::newRow("rawXML_1") << 1 << true;
     }
 
     // Even more low-level, using a QTcpSocket to send the request
@@ -1187,6 +1824,354 @@ private Q_SLOTS:
         verifySocketResponse(socket, s_longEmployeeName);
     }
 
+    void testMalformedRequestLine()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write("POST\r\nContent-Length: 0\r\n\r\n");
+        QVERIFY(socket.waitForBytesWritten());
+        QVERIFY(socket.waitForReadyRead());
+        const QByteArray response = socket.readAll();
+        QVERIFY2(response.startsWith("HTTP/1.1 400 Bad Request\r\n"), response.constData());
+        // The server closes the connection, since it can't know where the next request starts
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+    }
+
+    void testPipelinedRequests()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        // Three requests in a single write, the second one with a chunked body
+        const QByteArray message = rawCountryMessage(s_longEmployeeName);
+        socket.write(countryRequest(message) + chunkedCountryRequest(message) + countryRequest(message));
+        QVERIFY(socket.waitForBytesWritten());
+
+        const QList<QByteArray> responses = readHttpResponses(socket, 3);
+        QCOMPARE(responses.count(), 3);
+        for (const QByteArray &response : responses) {
+            QVERIFY2(response.startsWith("HTTP/1.1 200 OK\r\n"), response.constData());
+            QVERIFY(!response.contains("Connection: close"));
+            QVERIFY(xmlBufferCompare(response.mid(response.indexOf("\r\n\r\n") + 4), expectedCountryResponse(s_longEmployeeName)));
+        }
+        QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+        QCOMPARE(server->totalConnectionCount(), 3);
+    }
+
+    void testTruncatedMessage()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        // The whole body is sent (per Content-Length), but the XML document ends too early
+        const QByteArray message = rawCountryMessage(s_longEmployeeName);
+        socket.write(countryRequest(message.left(message.size() / 2)) + countryRequest(message));
+        QVERIFY(socket.waitForBytesWritten());
+
+        // A response rather than waiting for the client's timeout, and the pipelined request is ignored
+        const QList<QByteArray> responses = readHttpResponses(socket, 2);
+        QCOMPARE(responses.count(), 1);
+        QVERIFY2(responses.at(0).startsWith("HTTP/1.1 400 Bad Request\r\n"), responses.at(0).constData());
+        QVERIFY(responses.at(0).contains("\r\nConnection: close\r\n"));
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+    }
+
+    void testConnectionClose_data()
+    {
+        QTest::addColumn<QByteArray>("httpVersion");
+        QTest::addColumn<QByteArray>("connectionHeader");
+        QTest::addColumn<bool>("expectKeepAlive");
+
+        QTest::newRow("1.1") << QByteArray("HTTP/1.1") << QByteArray() << true;
+        QTest::newRow("1.1_close") << QByteArray("HTTP/1.1") << QByteArray("Connection: Close\r\n") << false;
+        QTest::newRow("1.0") << QByteArray("HTTP/1.0") << QByteArray() << false;
+        QTest::newRow("1.0_keep-alive") << QByteArray("HTTP/1.0") << QByteArray("Connection: keep-alive\r\n") << true;
+    }
+
+    void testConnectionClose()
+    {
+        QFETCH(QByteArray, httpVersion);
+        QFETCH(QByteArray, connectionHeader);
+        QFETCH(bool, expectKeepAlive);
+
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        QByteArray request = countryRequest(rawCountryMessage(s_longEmployeeName), connectionHeader);
+        request.replace("HTTP/1.1", httpVersion);
+        // A second request, which must be ignored if the connection is closed
+        socket.write(request + request);
+        QVERIFY(socket.waitForBytesWritten());
+
+        const QList<QByteArray> responses = readHttpResponses(socket, 2);
+        if (expectKeepAlive) {
+            QCOMPARE(responses.count(), 2);
+            QCOMPARE(responses.at(0).contains("Connection: keep-alive"), httpVersion == "HTTP/1.0");
+            QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+        } else {
+            QCOMPARE(responses.count(), 1);
+            QVERIFY(responses.at(0).contains("\r\nConnection: close\r\n"));
+            QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+        }
+    }
+
+    void testMaxRequestsPerConnection()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setMaxRequestsPerConnection(2);
+        QCOMPARE(server->maxRequestsPerConnection(), 2);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        const QByteArray request = countryRequest(rawCountryMessage(s_longEmployeeName));
+        socket.write(request + request + request);
+        QVERIFY(socket.waitForBytesWritten());
+
+        const QList<QByteArray> responses = readHttpResponses(socket, 3);
+        QCOMPARE(responses.count(), 2);
+        QVERIFY(!responses.at(0).contains("Connection: close"));
+        QVERIFY(responses.at(1).contains("\r\nConnection: close\r\n"));
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+    }
+
+    void testKeepAliveTimeout()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setKeepAliveTimeout(200);
+        QCOMPARE(server->keepAliveTimeout(), 200);
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        socket.write(countryRequest(rawCountryMessage(s_longEmployeeName)));
+        QVERIFY(socket.waitForBytesWritten());
+        QCOMPARE(readHttpResponses(socket, 1).count(), 1);
+
+        // Idle after the response: the server closes the connection
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(5000));
+        QVERIFY(timer.elapsed() < 5000);
+    }
+
+    void testServerObjectPool()
+    {
+        {
+            CountryServerThread serverThread;
+            CountryServer *server = serverThread.startThread();
+            server->setServerObjectPoolSize(1);
+            QCOMPARE(server->serverObjectPoolSize(), 1);
+
+            // A new connection for each call: the server object is reused anyway
+            for (int i = 0; i < 3; ++i) {
+                KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+                KDSoapMessage message = countryMessage();
+                if (i == 1) {
+                    message = KDSoapMessage();
+                    message.addArgument(QLatin1String("employeeName"), QString()); // the server object sets a fault
+                }
+                const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), message);
+                QCOMPARE(response.isFault(), i == 1);
+                if (i != 1) {
+                    QCOMPARE(response.childValues().first().value().toString(), expectedCountry());
+                }
+                QCOMPARE(s_serverObjects.count(), 1);
+                QCOMPARE(s_serverObjects.at(0)->reuseCount(), i + 1);
+                QVERIFY(!s_serverObjects.at(0)->hasFault()); // reset before reuse
+            }
+        }
+        QCOMPARE(s_serverObjects.count(), 0);
+    }
+
+    void testAdmissionControl()
+    {
+        QThreadPool processingPool;
+        processingPool.setMaxThreadCount(2);
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setProcessingThreadPool(&processingPool);
+        server->setMaxInFlightRequests(1);
+        QCOMPARE(server->maxInFlightRequests(), 1);
+        server->setRetryAfter(5);
+
+        // Each check is made while a slow call is in flight on another connection
+        ClientSocket slowSocket(server);
+        QVERIFY(slowSocket.waitForConnected());
+        const QByteArray slowRequest = countryRequest(rawCountryMessage("Slow"));
+
+        slowSocket.write(slowRequest);
+        QTRY_COMPARE(server->numInFlightRequests(), 1);
+        {
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            socket.write(countryRequest(rawCountryMessage()));
+            const QByteArray response = readHttpHeaders(socket);
+            QVERIFY2(response.startsWith("HTTP/1.1 503 Service Unavailable\r\n"), response.constData());
+            QCOMPARE(headerValue(response, "Retry-After"), QByteArray("5"));
+            QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected());
+        }
+        QCOMPARE(readHttpResponses(slowSocket, 1).count(), 1);
+
+        slowSocket.write(slowRequest);
+        QTRY_COMPARE(server->numInFlightRequests(), 1);
+        server->setOverloadResponse(KDSoapServer::BusyFault);
+        {
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            socket.write(countryRequest(rawCountryMessage()));
+            const QList<QByteArray> responses = readHttpResponses(socket, 1);
+            QCOMPARE(responses.count(), 1);
+            QVERIFY(responses.at(0).startsWith("HTTP/1.1 500 Internal Server Error\r\n"));
+            QVERIFY(responses.at(0).contains("Server.Busy"));
+        }
+        QCOMPARE(readHttpResponses(slowSocket, 1).count(), 1);
+
+        // Priority requests get through anyway
+        slowSocket.write(slowRequest);
+        QTRY_COMPARE(server->numInFlightRequests(), 1);
+        server->setPrioritySoapActions(QList<QByteArray>() << "http://www.kdab.com/xml/MyWsdl/getEmployeeCountry");
+        QCOMPARE(server->prioritySoapActions().count(), 1);
+        {
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            socket.write(countryRequest(rawCountryMessage()));
+            const QList<QByteArray> responses = readHttpResponses(socket, 1);
+            QCOMPARE(responses.count(), 1);
+            QVERIFY(responses.at(0).startsWith("HTTP/1.1 200 OK\r\n"));
+        }
+        QCOMPARE(readHttpResponses(slowSocket, 1).count(), 1);
+        QTRY_COMPARE(server->numInFlightRequests(), 0);
+    }
+
+    void testRejectedRequestBody_data()
+    {
+        QTest::addColumn<int>("bodySize");
+        QTest::newRow("small_body") << 100 * 1024; // read before closing the connection
+        QTest::newRow("large_body") << 16 * 1024 * 1024; // more than the socket buffers: the server closes its side first
+    }
+
+    // The response to a rejected request must reach the client, even if the server doesn't wait for the whole body
+    void testRejectedRequestBody()
+    {
+        QFETCH(int, bodySize);
+        QThreadPool processingPool;
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+        server->setProcessingThreadPool(&processingPool);
+        server->setMaxInFlightRequests(1);
+
+        ClientSocket slowSocket(server);
+        QVERIFY(slowSocket.waitForConnected());
+        slowSocket.write(countryRequest(rawCountryMessage("Slow")));
+        QTRY_COMPARE(server->numInFlightRequests(), 1);
+        {
+            ClientSocket socket(server);
+            QVERIFY(socket.waitForConnected());
+            socket.write(countryRequest(QByteArray(bodySize, ' ')));
+            const QByteArray response = readHttpHeaders(socket); // while the body is being sent
+            QVERIFY2(response.startsWith("HTTP/1.1 503 Service Unavailable\r\n"), response.constData());
+            if (bodySize < 256 * 1024) {
+                // The server reads the whole body before closing the connection
+                while (socket.bytesToWrite() > 0 && socket.waitForBytesWritten(2000)) {
+                }
+                QCOMPARE(socket.bytesToWrite(), 0);
+            }
+            QVERIFY(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+        }
+        QCOMPARE(readHttpResponses(slowSocket, 1).count(), 1);
+        QTRY_COMPARE(server->numInFlightRequests(), 0);
+    }
+
+    void testStreamedResponse_data()
+    {
+        QTest::addColumn<int>("count");
+        QTest::newRow("finished_during_call") << 10;
+        QTest::newRow("back_pressure") << 50000; // well above the high watermark
+    }
+
+    void testStreamedResponse()
+    {
+        QFETCH(int, count);
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+        KDSoapMessage message;
+        message.addArgument(QLatin1String("count"), count);
+        const KDSoapMessage response = client.call(QLatin1String("listEmployees"), message);
+        QVERIFY2(!response.isFault(), qPrintable(response.faultAsString()));
+        QCOMPARE(response.name(), QString::fromLatin1("listEmployeesResponse"));
+        const KDSoapValueList employees = response.childValues();
+        QCOMPARE(employees.count(), count);
+        QCOMPARE(employees.first().value().toString(), QString::fromLatin1("Employee 0"));
+        QCOMPARE(employees.last().value().toString(), QString::fromLatin1("Employee %1").arg(count - 1));
+
+        // The connection is usable for the next call
+        const KDSoapMessage countryResponse = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+        QCOMPARE(countryResponse.childValues().first().value().toString(), expectedCountry());
+        QCOMPARE(server->totalConnectionCount(), 2);
+    }
+
+    void testStreamedResponseRaw()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        ClientSocket socket(server);
+        QVERIFY(socket.waitForConnected());
+        const QByteArray message = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\">"
+                                   "<soap:Body><n1:listEmployees xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\"><count>2</count></n1:listEmployees>"
+                                   "</soap:Body></soap:Envelope>";
+        socket.write(countryRequest(message));
+        QVERIFY(socket.waitForBytesWritten());
+
+        QByteArray response;
+        while (!response.endsWith("\r\n0\r\n\r\n") && socket.waitForReadyRead(2000)) {
+            response += socket.readAll();
+        }
+        const int headersEnd = response.indexOf("\r\n\r\n");
+        QVERIFY2(headersEnd > 0, response.constData());
+        const QByteArray headers = response.left(headersEnd + 2);
+        QVERIFY2(headers.startsWith("HTTP/1.1 200 OK\r\n"), headers.constData());
+        QVERIFY(headers.contains("\r\nTransfer-Encoding: chunked\r\n"));
+        QVERIFY(!headers.contains("Content-Length"));
+        QVERIFY(headers.contains("\r\nAccess-Control-Allow-Origin: *\r\n"));
+
+        // Decode the chunks
+        QByteArray xml;
+        int pos = headersEnd + 4;
+        while (true) {
+            const int lineEnd = response.indexOf("\r\n", pos);
+            QVERIFY(lineEnd > pos);
+            bool ok;
+            const int chunkSize = response.mid(pos, lineEnd - pos).toInt(&ok, 16);
+            QVERIFY(ok);
+            if (chunkSize == 0) {
+                break;
+            }
+            xml += response.mid(lineEnd + 2, chunkSize);
+            QCOMPARE(response.mid(lineEnd + 2 + chunkSize, 2), QByteArray("\r\n"));
+            pos = lineEnd + 4 + chunkSize;
+        }
+        const QByteArray expected = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+                                    "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+                                    "xmlns:soap-enc=\"http://schemas.xmlsoap.org/soap/encoding/\"><soap:Body><n1:listEmployeesResponse "
+                                    "xmlns:n1=\"http://www.kdab.com/xml/MyWsdl/\"><employeeName>Employee 0</employeeName><employeeName>Employee 1</employeeName>"
+                                    "</n1:listEmployeesResponse></soap:Body></soap:Envelope>\n";
+        QVERIFY(xmlBufferCompare(xml, expected));
+        QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+    }
+
     void testChunkedTransferEncoding_data()
     {
         QTest::addColumn<int>("chunkSize");
@@ -1395,6 +2380,135 @@ private Q_SLOTS:
         QCOMPARE(pendingCall.returnMessage().faultAsString(), QString::fromLatin1("Fault code 4: Operation timed out"));
     }
 
+    void testResponseCache()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+        QCOMPARE(client.responseCacheTimeout(QLatin1String("getEmployeeCountry")), 0);
+        client.setResponseCacheTimeout(QLatin1String("getEmployeeCountry"), 60000);
+
+        // The second call is answered from the cache
+        for (int i = 0; i < 2; ++i) {
+            const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+            QVERIFY(!response.isFault());
+            QCOMPARE(response.childValues().first().value().toString(), expectedCountry());
+        }
+        QCOMPARE(server->totalConnectionCount(), 1);
+        QCOMPARE(client.responseCacheStatistics().misses, 1);
+        QCOMPARE(client.responseCacheStatistics().hits, 1);
+
+        // Identical calls in progress share the same request
+        m_returnMessages.clear();
+        m_expectedMessages = 3;
+        const QList<KDSoapPendingCallWatcher *> watchers = makeAsyncCalls(client, 3, true);
+        m_eventLoop.exec();
+        QCOMPARE(m_returnMessages.count(), 3);
+        for (const KDSoapMessage &response : std::as_const(m_returnMessages)) {
+            QCOMPARE(response.childValues().first().value().toString(), QString::fromLatin1("Slow France"));
+        }
+        qDeleteAll(watchers);
+        QCOMPARE(server->totalConnectionCount(), 2);
+        QCOMPARE(client.responseCacheStatistics().misses, 2);
+        QCOMPARE(client.responseCacheStatistics().coalesced, 2);
+
+        // Faults are not cached
+        KDSoapMessage faultyMessage;
+        faultyMessage.addArgument(QLatin1String("employeeName"), QString());
+        for (int i = 0; i < 2; ++i) {
+            QVERIFY(client.call(QLatin1String("getEmployeeCountry"), faultyMessage).isFault());
+        }
+        QCOMPARE(server->totalConnectionCount(), 4);
+        QCOMPARE(client.responseCacheStatistics().misses, 4);
+
+        client.clearResponseCache();
+        QVERIFY(!client.call(QLatin1String("getEmployeeCountry"), countryMessage()).isFault());
+        QCOMPARE(server->totalConnectionCount(), 5);
+        QCOMPARE(client.responseCacheStatistics().hits, 1);
+    }
+
+    void testRetryPolicy()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+        KDSoapRetryPolicy policy;
+        policy.setMaxAttempts(3);
+        policy.setInitialBackoff(10);
+        policy.setRetryableFaultCodes(QStringList() << QLatin1String("Client.Data"));
+        client.setRetryPolicy(policy);
+        QCOMPARE(client.retryPolicy().maxAttempts(), 3);
+
+        KDSoapMessage faultyMessage;
+        faultyMessage.addArgument(QLatin1String("employeeName"), QString());
+
+        // Not idempotent: a fault isn't retried
+        QVERIFY(client.call(QLatin1String("getEmployeeCountry"), faultyMessage).isFault());
+        QCOMPARE(server->totalConnectionCount(), 1);
+
+        // Idempotent: retried until maxAttempts, then the last fault is returned
+        client.setOperationIdempotent(QLatin1String("getEmployeeCountry"));
+        QVERIFY(client.isOperationIdempotent(QLatin1String("getEmployeeCountry")));
+        server->resetTotalConnectionCount();
+        const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), faultyMessage);
+        QVERIFY(response.isFault());
+        QCOMPARE(response.arguments().child(QLatin1String("faultcode")).value().toString(), QString::fromLatin1("Client.Data"));
+        QCOMPARE(server->totalConnectionCount(), 3);
+
+        // Same with asyncCall
+        server->resetTotalConnectionCount();
+        KDSoapPendingCallWatcher watcher(client.asyncCall(QLatin1String("getEmployeeCountry"), faultyMessage));
+        QSignalSpy spy(&watcher, &KDSoapPendingCallWatcher::finished);
+        QVERIFY(spy.wait());
+        QVERIFY(watcher.returnMessage().isFault());
+        QCOMPARE(server->totalConnectionCount(), 3);
+
+        // Successful calls aren't retried
+        server->resetTotalConnectionCount();
+        const KDSoapMessage success = client.call(QLatin1String("getEmployeeCountry"), countryMessage());
+        QVERIFY(!success.isFault());
+        QCOMPARE(success.childValues().first().value().toString(), expectedCountry());
+        QCOMPARE(server->totalConnectionCount(), 1);
+    }
+
+    void testResponseCacheWithHedging()
+    {
+        CountryServerThread serverThread;
+        CountryServer *server = serverThread.startThread();
+
+        KDSoapClientInterface client(server->endPoint(), countryMessageNamespace());
+        KDSoapRetryPolicy policy;
+        policy.setMaxAttempts(2);
+        policy.setHedgingDelay(20);
+        client.setRetryPolicy(policy);
+        client.setOperationIdempotent(QLatin1String("getEmployeeCountry"));
+        client.setResponseCacheTimeout(QLatin1String("getEmployeeCountry"), 60000);
+
+        // The slow call is hedged, the identical call in progress shares its final response
+        m_returnMessages.clear();
+        m_expectedMessages = 2;
+        const QList<KDSoapPendingCallWatcher *> watchers = makeAsyncCalls(client, 2, true);
+        m_eventLoop.exec();
+        QCOMPARE(m_returnMessages.count(), 2);
+        for (const KDSoapMessage &response : std::as_const(m_returnMessages)) {
+            QVERIFY2(!response.isFault(), qPrintable(response.faultAsString()));
+            QCOMPARE(response.childValues().first().value().toString(), QString::fromLatin1("Slow France"));
+        }
+        qDeleteAll(watchers);
+        QTRY_COMPARE(server->totalConnectionCount(), 2); // the first attempt and the hedged one
+        QCOMPARE(client.responseCacheStatistics().misses, 1);
+        QCOMPARE(client.responseCacheStatistics().coalesced, 1);
+
+        // The response of the winning attempt was cached
+        const KDSoapMessage response = client.call(QLatin1String("getEmployeeCountry"), countryMessage(true));
+        QVERIFY(!response.isFault());
+        QCOMPARE(response.childValues().first().value().toString(), QString::fromLatin1("Slow France"));
+        QCOMPARE(server->totalConnectionCount(), 2);
+        QCOMPARE(client.responseCacheStatistics().hits, 1);
+    }
+
 public Q_SLOTS:
     void slotFinished(KDSoapPendingCallWatcher *watcher)
     {
@@ -1482,6 +2596,81 @@ private:
         return QString::fromUtf8("David Ä Faure France");
     }
 
+    static QByteArray countryRequest(const QByteArray &message, const QByteArray &extraHeaders = QByteArray())
+    {
+        return "POST / HTTP/1.1\r\n"
+               "SoapAction: http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\r\n"
+               "Content-Type: text/xml;charset=utf-8\r\n"
+               "Content-Length: "
+            + QByteArray::number(message.size()) + "\r\n" + extraHeaders + "\r\n" + message;
+    }
+    static QByteArray chunkedCountryRequest(const QByteArray &message)
+    {
+        const int half = message.size() / 2;
+        return "POST / HTTP/1.1\r\n"
+               "SoapAction: http://www.kdab.com/xml/MyWsdl/getEmployeeCountry\r\n"
+               "Content-Type: text/xml;charset=utf-8\r\n"
+               "Transfer-Encoding: chunked\r\n"
+               "\r\n"
+            + QByteArray::number(half, 16) + "\r\n" + message.left(half) + "\r\n" + QByteArray::number(message.size() - half, 16) + "\r\n"
+            + message.mid(half) + "\r\n0\r\n\r\n";
+    }
+    static bool writeFile(const QString &fileName, const QByteArray &contents)
+    {
+        QFile file(fileName);
+        return file.open(QIODevice::WriteOnly) && file.write(contents) == contents.size();
+    }
+    // Reads the headers of a response without a body (HEAD, 304)
+    static QByteArray readHttpHeaders(QTcpSocket &socket)
+    {
+        QByteArray response;
+        while (!response.endsWith("\r\n\r\n") && socket.waitForReadyRead(2000)) {
+            response += socket.readAll();
+        }
+        return response;
+    }
+    static QByteArray headerValue(const QByteArray &headers, const QByteArray &name)
+    {
+        const int pos = headers.indexOf("\r\n" + name + ": ");
+        if (pos < 0) {
+            return QByteArray();
+        }
+        const int start = pos + name.size() + 4;
+        return headers.mid(start, headers.indexOf("\r\n", start) - start);
+    }
+    // Reads up to \p count responses (with a Content-Length, or 304), until the server stops sending
+    static QList<QByteArray> readHttpResponses(QTcpSocket &socket, int count)
+    {
+        QList<QByteArray> responses;
+        QByteArray buffer;
+        while (responses.count() < count) {
+            const int headersEnd = buffer.indexOf("\r\n\r\n");
+            if (headersEnd >= 0) {
+                if (buffer.startsWith("HTTP/1.1 304 ")) {
+                    responses.append(buffer.left(headersEnd + 4));
+                    buffer.remove(0, headersEnd + 4);
+                    continue;
+                }
+                const int lengthPos = buffer.indexOf("Content-Length: ");
+                if (lengthPos >= 0 && lengthPos < headersEnd) {
+                    const int lengthEnd = buffer.indexOf("\r\n", lengthPos);
+                    const int length = buffer.mid(lengthPos + 16, lengthEnd - lengthPos - 16).toInt();
+                    const int responseSize = headersEnd + 4 + length;
+                    if (buffer.size() >= responseSize) {
+                        responses.append(buffer.left(responseSize));
+                        buffer.remove(0, responseSize);
+                        continue;
+                    }
+                }
+            }
+            if (!socket.waitForReadyRead(2000)) {
+                break;
+            }
+            buffer += socket.readAll();
+        }
+        return responses;
+    }
+
     void verifySocketResponse(ClientSocket &socket, const QByteArray &employeeName)
     {
         QVERIFY(socket.waitForReadyRead());
@@ -1607,6 +2796,12 @@ void CountryServerObject::processRequest(const KDSoapMessage &request, KDSoapMes
         if (!hasFault()) {
             response.setValue(QVariant(hex));
         }
+    } else if (method == "listEmployees") {
+        m_streamTotal = request.childValues().child(QLatin1String("count")).value().toInt();
+        m_streamedCount = 0;
+        m_stream = startStreamedResponse(QLatin1String("listEmployeesResponse"));
+        connect(m_stream, &KDSoapResponseStream::readyForMoreData, this, &CountryServerObject::streamEmployees);
+        streamEmployees();
     } else {
         KDSoapServerObjectInterface::processRequest(request, response, soapAction);
     }
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** This file is part of the KD Soap project.
+**
+** SPDX-FileCopyrightText: 2026 Klarälvdalens Datakonsult AB, a KDAB Group company <info@kdab.com>
+**
+** SPDX-License-Identifier: MIT
+**
+****************************************************************************/
+
+#include "wsdl_dispatch.h"
+
+#include "httpserver_p.h"
+#include <KDSoapClientInterface.h>
+#include <KDSoapMessage.h>
+#include <KDSoapServer.h>
+#include <QTest>
+
+using namespace KDSoapUnitTestHelpers;
+
+class DispatchServerObject : public Dispatch_ServiceServerBase
+{
+public:
+    QString first(const QString &text) override
+    {
+        return QLatin1String("first: ") + text;
+    }
+    QString second(const QString &text) override
+    {
+        return QLatin1String("second: ") + text;
+    }
+};
+
+class DispatchServer : public KDSoapServer
+{
+    Q_OBJECT
+public:
+    DispatchServer()
+        : KDSoapServer()
+    {
+        setPath(QLatin1String("/dispatch"));
+    }
+    QObject *createServerObject() override
+    {
+        return new DispatchServerObject;
+    }
+};
+
+class ServerDispatchTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    // Tests the processRequest() generated by kdwsdl2cpp -server, see Converter::generateServerDispatch
+    void testDispatch_data()
+    {
+        QTest::addColumn<QString>("method");
+        QTest::addColumn<QString>("soapAction");
+        QTest::addColumn<QString>("expectedResult"); // empty if no operation matches
+
+        QTest::newRow("method_and_action") << "second" << "urn:dispatch#second" << "second: hello";
+        QTest::newRow("method_only") << "second" << "urn:dispatch#unknown" << "second: hello";
+        QTest::newRow("action_only") << "unknown" << "urn:dispatch#second" << "second: hello";
+        // The request matches both operations, the first declared one wins
+        QTest::newRow("first_by_method") << "first" << "urn:dispatch#second" << "first: hello";
+        QTest::newRow("first_by_action") << "second" << "urn:dispatch#first" << "first: hello";
+        QTest::newRow("no_match") << "unknown" << "urn:dispatch#unknown" << QString();
+    }
+
+    void testDispatch()
+    {
+        QFETCH(QString, method);
+        QFETCH(QString, soapAction);
+        QFETCH(QString, expectedResult);
+
+        TestServerThread<DispatchServer> serverThread;
+        DispatchServer *server = serverThread.startThread();
+
+        KDSoapClientInterface client(server->endPoint(), QString::fromLatin1("urn:dispatch"));
+        KDSoapMessage message;
+        message.addArgument(QLatin1String("text"), QString::fromLatin1("hello"));
+        const KDSoapMessage response = client.call(method, message, soapAction);
+        if (expectedResult.isEmpty()) {
+            // Falls through to KDSoapServerObjectInterface::processRequest
+            QVERIFY(response.isFault());
+            QCOMPARE(response.arguments().child(QLatin1String("faultcode")).value().toString(), QString::fromLatin1("Server.MethodNotFound"));
+            QCOMPARE(response.arguments().child(QLatin1String("faultstring")).value().toString(), method + QLatin1String(" not found"));
+        } else {
+            QVERIFY2(!response.isFault(), qPrintable(response.faultAsString()));
+            QCOMPARE(response.arguments().child(QLatin1String("result")).value().toString(), expectedResult);
+        }
+    }
+};
+
+QTEST_MAIN(ServerDispatchTest)
+
+#include "test_wsdl_server_dispatch.moc"